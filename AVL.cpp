@@ -1,11 +1,14 @@
 //AVL 
 
 #include "AVL.h"
+#include "TreeCounters.h"
+#include "ParallelBuild.h"
 #include<iostream>
 #include<stdio.h>
+#include<thread>
 
-AVL* AVLTree::New_Node(KEY_TYPE key, AVL* lchild, AVL* rchild, int height) {
-    AVL* p_avl = new AVL;
+AVL* AVLTree::New_Node(KEY_TYPE key, AVL* lchild, AVL* rchild, int height, NodeArena* arena) {
+    AVL* p_avl = (AVL*) NodeArena::allocateIn(arena, sizeof (AVL));
     p_avl->key = key;
     p_avl->lchild = lchild;
     p_avl->rchild = rchild;
@@ -34,6 +37,7 @@ inline int AVLTree::max(int a, int b) {
  Retornar a donde deberia apuntar el nodo raiz
  */
 AVL* AVLTree::RR_Rotate(AVL* k2) {
+    TREE_COUNT(AVL_ROTATIONS, 1);
     AVL* k1 = k2->lchild;
     k2->lchild = k1->rchild;
     k1->rchild = k2;
@@ -51,6 +55,7 @@ AVL* AVLTree::RR_Rotate(AVL* k2) {
          Y    Z              X    Y
  */
 AVL* AVLTree::LL_Rotate(AVL* k2) {
+    TREE_COUNT(AVL_ROTATIONS, 1);
     AVL* k1 = k2->rchild;
     k2->rchild = k1->lchild;
     k1->lchild = k2;
@@ -98,13 +103,15 @@ AVL* AVLTree::RL_Rotate(AVL* k3) {
  * Retornar a donde deberia apuntar el nodo raiz. El nodo raiz cambia frecuentemente en
  * insercion y eliminacion, asi que el nodo raiz deberia apuntar al nodo raiz REAL.
  */
-AVL* AVLTree::Insert(AVL* root, KEY_TYPE key) {
+AVL* AVLTree::Insert(AVL* root, KEY_TYPE key, NodeArena* arena, bool unique) {
     if (root == NULL)
-        return (root = New_Node(key, NULL, NULL));
+        return (root = New_Node(key, NULL, NULL, 0, arena));
+    else if (unique && key == root->key)
+        return root; //no cambio nada, las alturas siguen igual
     else if (key < root->key)
-        root->lchild = Insert(root->lchild, key);
+        root->lchild = Insert(root->lchild, key, arena, unique);
     else //key >= root->key
-        root->rchild = Insert(root->rchild, key);
+        root->rchild = Insert(root->rchild, key, arena, unique);
 
     root->height = max(getHeight(root->lchild), getHeight(root->rchild)) + 1;
     if (getHeight(root->lchild) - getHeight(root->rchild) == 2) {
@@ -126,7 +133,7 @@ AVL* AVLTree::Insert(AVL* root, KEY_TYPE key) {
  * Retornar a donde deberia apuntar el nodo raiz. El nodo raiz cambia frecuentemente en
  * insercion y eliminacion, asi que el nodo raiz deberia apuntar al nodo raiz REAL.
  */
-AVL* AVLTree::Delete(AVL* root, KEY_TYPE key) {
+AVL* AVLTree::Delete(AVL* root, KEY_TYPE key, NodeArena* arena) {
     if (!root)
         return NULL;
     if (key == root->key) {
@@ -137,7 +144,7 @@ AVL* AVLTree::Delete(AVL* root, KEY_TYPE key) {
              */
             AVL* temp = root;
             root = NULL;
-            delete(temp);
+            NodeArena::deallocateIn(arena, temp, sizeof (AVL));
             return root;
             
         } else if (root->lchild != NULL) {
@@ -151,7 +158,7 @@ AVL* AVLTree::Delete(AVL* root, KEY_TYPE key) {
             /* reemplazar el valor */
             root->key = temp->key;
             /* Eliminar el nodo (sucesor) que en realidad deberia ser eliminado */
-            root->lchild = Delete(root->lchild, temp->key);
+            root->lchild = Delete(root->lchild, temp->key, arena);
 
         } else if (root->rchild != NULL) {
             /* Si no hay un subarbol izquierdo, entonces obtenemos el elemento mas pequeño del subarbol derecho */
@@ -161,13 +168,13 @@ AVL* AVLTree::Delete(AVL* root, KEY_TYPE key) {
             /* reemplazar el valor */
             root->key = temp->key;
             /* Eliminar el nodo (sucesor) que en realidad deberia ser eliminado */
-            root->rchild = Delete(root->rchild, temp->key);
+            root->rchild = Delete(root->rchild, temp->key, arena);
         }
 
     } else if (key < root->key)
-        root->lchild = Delete(root->lchild, key);
+        root->lchild = Delete(root->lchild, key, arena);
     else
-        root->rchild = Delete(root->rchild, key);
+        root->rchild = Delete(root->rchild, key, arena);
     
     /* 
      Obtenemos la nueva altura y rotamos el arbol si es necesario. Notese que esta parte
@@ -189,6 +196,46 @@ AVL* AVLTree::Delete(AVL* root, KEY_TYPE key) {
     return root;
 }
 
+AVL* AVLTree::Search(AVL* root, KEY_TYPE key) {
+    TREE_LOOKUP_BEGIN();
+    while (root != NULL) {
+        TREE_LOOKUP_VISIT(1);
+        if (key == root->key)
+            break;
+        root = key < root->key ? root->lchild : root->rchild;
+    }
+    TREE_LOOKUP_END();
+    return root;
+}
+
+void AVLTree::Destroy(AVL* root, NodeArena* arena) {
+    if (root == NULL)
+        return;
+    Destroy(root->lchild, arena);
+    Destroy(root->rchild, arena);
+    NodeArena::deallocateIn(arena, root, sizeof (AVL));
+}
+
+AVL* AVLTree::BuildSorted(const KEY_TYPE* keys, size_t count, NodeArena* arena, int threads) {
+    if (count == 0)
+        return NULL;
+    threads = buildThreads(threads); //0: todos los cpus (en las llamadas recursivas ya es >= 1)
+    size_t mid = count / 2;
+    AVL *left, *right;
+    if (threads > 1 && count >= PARALLEL_BUILD_MIN) {
+        //La mitad izquierda en otro hilo, los hilos que quedan se reparten entre las dos mitades
+        std::thread worker([&] {
+            left = BuildSorted(keys, mid, arena, threads / 2);
+        });
+        right = BuildSorted(keys + mid + 1, count - mid - 1, arena, threads - threads / 2);
+        worker.join();
+    } else {
+        left = BuildSorted(keys, mid, arena, 1);
+        right = BuildSorted(keys + mid + 1, count - mid - 1, arena, 1);
+    }
+    return New_Node(keys[mid], left, right, max(getHeight(left), getHeight(right)) + 1, arena);
+}
+
 void AVLTree::InOrder(AVL* root) {
     if (root == NULL)
         return;
@@ -1,6 +1,8 @@
 #ifndef __AVL_H__
 #define __AVL_H__
 
+#include "NodeArena.h"
+
 typedef int KEY_TYPE;
 
 /* No hay punter padre */
@@ -13,10 +15,13 @@ typedef struct AVL{
 
 class AVLTree{
 private:
+    static const size_t PARALLEL_BUILD_MIN = 1 << 15; // Subarboles mas chicos se arman en el mismo hilo
     static void AVLmenu(AVL* root);
 public:
     static void AVLmenu();
-	static AVL* New_Node(KEY_TYPE key, AVL* lchild, AVL* rchild, int height = 0);
+	/* Con 'arena' el nodo sale del arena (ver NodeArena) en vez del heap. Un arbol tiene que usar
+	 el mismo arena en todas sus inserciones y eliminaciones */
+	static AVL* New_Node(KEY_TYPE key, AVL* lchild, AVL* rchild, int height = 0, NodeArena* arena = NULL);
 	static inline int getHeight(AVL* node);
 	static inline int max(int a, int b);
 	/*
@@ -33,8 +38,19 @@ public:
 	static AVL* RL_Rotate(AVL* k3);
 
 
-	static AVL* Insert(AVL* root, KEY_TYPE key);
-	static AVL* Delete(AVL* root, KEY_TYPE key);
+	/* Con 'unique' una llave que ya esta no se vuelve a insertar (el arbol se usa como conjunto) */
+	static AVL* Insert(AVL* root, KEY_TYPE key, NodeArena* arena = NULL, bool unique = false);
+	static AVL* Delete(AVL* root, KEY_TYPE key, NodeArena* arena = NULL);
+
+	/* Nodo con la llave 'key' o NULL si no esta */
+	static AVL* Search(AVL* root, KEY_TYPE key);
+
+	/* Arma un arbol balanceado con las llaves ordenadas y sin repetir 'keys' en O(n), sin rotaciones.
+	 Con 'threads' > 1 los subarboles grandes se arman en hilos distintos, 0 usa todos los cpus (ver ParallelBuild.h) */
+	static AVL* BuildSorted(const KEY_TYPE* keys, size_t count, NodeArena* arena = NULL, int threads = 1);
+
+	/* Libera todos los nodos del arbol */
+	static void Destroy(AVL* root, NodeArena* arena = NULL);
 	static void InOrder(AVL* root);
 	static void PreOrder(AVL* root);
 	static void PostOrder(AVL* root);
@@ -0,0 +1,293 @@
+#include "BenchBaseline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+/* Lo minimo de JSON para leer un baseline: objetos, arreglos, textos sin escapes raros y numeros */
+struct JsonValue {
+    enum Type {
+        NUMBER, TEXT, ARRAY, OBJECT, NONE
+    } type;
+    double number;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue> > fields;
+
+    JsonValue() {
+        type = NONE;
+        number = 0;
+    }
+
+    const JsonValue *field(const char *name) const {
+        for (size_t i = 0; i < fields.size(); i++)
+            if (fields[i].first == name)
+                return &fields[i].second;
+        return NULL;
+    }
+};
+
+static void skipSpace(const char *&p) {
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')
+        p++;
+}
+
+static bool parseString(const char *&p, std::string& out) {
+    if (*p != '"')
+        return false;
+    p++;
+    while (*p != '"') {
+        if (*p == 0)
+            return false;
+        if (*p == '\\' && p[1] != 0)
+            p++;
+        out += *p++;
+    }
+    p++;
+    return true;
+}
+
+static bool parseValue(const char *&p, JsonValue& value) {
+    skipSpace(p);
+    if (*p == '{') {
+        value.type = JsonValue::OBJECT;
+        p++;
+        skipSpace(p);
+        while (*p != '}') {
+            std::string name;
+            JsonValue field;
+            skipSpace(p);
+            if (!parseString(p, name))
+                return false;
+            skipSpace(p);
+            if (*p++ != ':' || !parseValue(p, field))
+                return false;
+            value.fields.push_back(std::make_pair(name, field));
+            skipSpace(p);
+            if (*p == ',')
+                p++;
+            else if (*p != '}')
+                return false;
+        }
+        p++;
+    } else if (*p == '[') {
+        value.type = JsonValue::ARRAY;
+        p++;
+        skipSpace(p);
+        while (*p != ']') {
+            JsonValue item;
+            if (!parseValue(p, item))
+                return false;
+            value.items.push_back(item);
+            skipSpace(p);
+            if (*p == ',')
+                p++;
+            else if (*p != ']')
+                return false;
+        }
+        p++;
+    } else if (*p == '"') {
+        value.type = JsonValue::TEXT;
+        return parseString(p, value.text);
+    } else {
+        char *end;
+        value.type = JsonValue::NUMBER;
+        value.number = strtod(p, &end);
+        if (end == p)
+            return false;
+        p = end;
+    }
+    return true;
+}
+
+static double median(std::vector<double> values) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+int BenchBaseline::find(const Entry& like) const {
+    for (size_t i = 0; i < entries.size(); i++)
+        if (entries[i].engine == like.engine && entries[i].workload == like.workload && entries[i].size == like.size)
+            return (int) i;
+    return -1;
+}
+
+void BenchBaseline::add(const BenchResult& result) {
+    Entry like;
+    like.engine = result.engine;
+    like.workload = result.workload;
+    like.size = result.size;
+    int i = find(like);
+    if (i < 0) {
+        entries.push_back(like);
+        i = (int) entries.size() - 1;
+    }
+    entries[i].ops_per_sec.push_back(result.ops_per_sec);
+    entries[i].p99.push_back(result.p99);
+}
+
+static void writeList(FILE *file, const std::vector<double>& values, const char *format) {
+    fprintf(file, "[");
+    for (size_t i = 0; i < values.size(); i++) {
+        fprintf(file, i > 0 ? ", " : "");
+        fprintf(file, format, values[i]);
+    }
+    fprintf(file, "]");
+}
+
+bool BenchBaseline::save(const char *path) const {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(file, "{\"version\": 1, \"results\": [\n");
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& e = entries[i];
+        fprintf(file, "  {\"engine\": \"%s\", \"workload\": \"%s\", \"size\": %lld, \"ops_per_sec\": ",
+                e.engine.c_str(), e.workload.c_str(), e.size);
+        writeList(file, e.ops_per_sec, "%.1f");
+        fprintf(file, ", \"p99_ns\": ");
+        writeList(file, e.p99, "%.0f");
+        fprintf(file, "}%s\n", i + 1 < entries.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    return fclose(file) == 0;
+}
+
+bool BenchBaseline::load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    std::string text;
+    char block[4096];
+    size_t n;
+    while ((n = fread(block, 1, sizeof (block), file)) > 0)
+        text.append(block, n);
+    fclose(file);
+
+    JsonValue root;
+    const char *p = text.c_str();
+    const JsonValue *version, *results;
+    if (!parseValue(p, root) || root.type != JsonValue::OBJECT || (version = root.field("version")) == NULL
+            || version->number != 1 || (results = root.field("results")) == NULL || results->type != JsonValue::ARRAY) {
+        printf("%s: no es un baseline del benchmark (version 1)\n", path);
+        return false;
+    }
+    entries.clear();
+    for (size_t i = 0; i < results->items.size(); i++) {
+        const JsonValue& item = results->items[i];
+        const JsonValue *engine = item.field("engine"), *workload = item.field("workload");
+        const JsonValue *size = item.field("size"), *ops = item.field("ops_per_sec"), *p99 = item.field("p99_ns");
+        if (engine == NULL || workload == NULL || size == NULL || ops == NULL || ops->type != JsonValue::ARRAY) {
+            printf("%s: resultado %zu incompleto\n", path, i);
+            return false;
+        }
+        Entry e;
+        e.engine = engine->text;
+        e.workload = workload->text;
+        e.size = (long long) size->number;
+        for (size_t j = 0; j < ops->items.size(); j++)
+            e.ops_per_sec.push_back(ops->items[j].number);
+        if (p99 != NULL)
+            for (size_t j = 0; j < p99->items.size(); j++)
+                e.p99.push_back(p99->items[j].number);
+        entries.push_back(e);
+    }
+    return true;
+}
+
+/* Cantidad de formas de ordenar m valores de x y n de y que dan U = u (U: pares con y > x) */
+static double countArrangements(int m, int n, int u, std::vector<double>& memo) {
+    if (u < 0 || u > m * n)
+        return 0;
+    if (m == 0 || n == 0)
+        return u == 0 ? 1 : 0;
+    double& cached = memo[(m * 21 + n) * 401 + u];
+    if (cached < 0) // El mayor de todos es de y (aporta m pares) o es de x (no aporta)
+        cached = countArrangements(m, n - 1, u - m, memo) + countArrangements(m - 1, n, u, memo);
+    return cached;
+}
+
+double BenchBaseline::mannWhitneyLess(const std::vector<double>& x, const std::vector<double>& y) {
+    size_t m = x.size(), n = y.size();
+    if (m == 0 || n == 0)
+        return 1;
+    double u = 0;
+    bool ties = false;
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = 0; j < n; j++) {
+            if (y[j] > x[i])
+                u += 1;
+            else if (y[j] == x[i]) {
+                u += 0.5;
+                ties = true;
+            }
+        }
+
+    if (!ties && m <= 20 && n <= 20) {
+        std::vector<double> memo(21 * 21 * 401, -1);
+        double total = 0, low = 0;
+        for (int k = 0; k <= (int) (m * n); k++) {
+            double count = countArrangements((int) m, (int) n, k, memo);
+            total += count;
+            if (k <= u)
+                low += count;
+        }
+        return low / total;
+    }
+
+    // Aproximacion normal con correccion por empates y por continuidad
+    std::vector<double> all(x);
+    all.insert(all.end(), y.begin(), y.end());
+    std::sort(all.begin(), all.end());
+    double tie_sum = 0, total = (double) all.size();
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j] == all[i])
+            j++;
+        double t = (double) (j - i);
+        tie_sum += t * t * t - t;
+        i = j;
+    }
+    double mean = m * n / 2.0;
+    double variance = m * n / 12.0 * ((total + 1) - tie_sum / (total * (total - 1)));
+    if (variance <= 0)
+        return 1;
+    double z = (u - mean + 0.5) / sqrt(variance);
+    return 0.5 * erfc(-z / sqrt(2.0));
+}
+
+int BenchBaseline::compare(const BenchBaseline& baseline, double alpha, double threshold) const {
+    int regressions = 0;
+    printf("%-8s %-13s %12s %14s %14s %8s %8s  %s\n", "engine", "workload", "size", "base ops/s", "ops/s",
+            "change", "p", "verdict");
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& now = entries[i];
+        int found = baseline.find(now);
+        if (found < 0) {
+            printf("%-8s %-13s %12lld %14s %14.0f %8s %8s  sin baseline\n", now.engine.c_str(), now.workload.c_str(),
+                    now.size, "-", median(now.ops_per_sec), "-", "-");
+            continue;
+        }
+        const Entry *base = &baseline.entries[found];
+        double before = median(base->ops_per_sec), after = median(now.ops_per_sec);
+        double change = before > 0 ? after / before - 1 : 0;
+        double slower = mannWhitneyLess(base->ops_per_sec, now.ops_per_sec);
+        double faster = mannWhitneyLess(now.ops_per_sec, base->ops_per_sec);
+        const char *verdict = "ok";
+        if (slower < alpha && change < -threshold) {
+            verdict = "REGRESION";
+            regressions++;
+        } else if (faster < alpha && change > threshold)
+            verdict = "mejor";
+        printf("%-8s %-13s %12lld %14.0f %14.0f %+7.1f%% %8.4f  %s\n", now.engine.c_str(), now.workload.c_str(),
+                now.size, before, after, change * 100, change < 0 ? slower : faster, verdict);
+    }
+    return regressions;
+}
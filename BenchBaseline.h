@@ -0,0 +1,68 @@
+#ifndef BENCHBASELINE_H
+#define	BENCHBASELINE_H
+
+/*
+ * Resultados del benchmark guardados como referencia (baseline) para detectar regresiones.
+ *
+ * Cada carga (arbol, carga y tamanno) se corre varias veces y se guardan las operaciones por segundo
+ * de todas las repeticiones en un archivo JSON. Despues se vuelve a correr el benchmark y, para cada
+ * carga, la prueba de Mann-Whitney dice si las repeticiones nuevas son mas lentas que las guardadas
+ * sin suponer que el ruido es normal. Una carga es una regresion si la diferencia es significativa
+ * (p < alpha) y ademas la mediana bajo mas que 'threshold' (una diferencia real pero minima no cuenta).
+ *
+ * Formato del archivo:
+ *      {"version": 1, "results": [
+ *          {"engine": "avl", "workload": "seq-insert", "size": 10000, "ops_per_sec": [..], "p99_ns": [..]},
+ *          ...]}
+ */
+#include <string>
+#include <vector>
+
+struct BenchResult {
+    std::string engine;
+    std::string workload;
+    long long size;
+    long long ops;
+    double ops_per_sec;
+    double p50; // Nanosegundos
+    double p99;
+    double p999;
+    double bytes_per_key;
+};
+
+class BenchBaseline {
+private:
+    struct Entry {
+        std::string engine;
+        std::string workload;
+        long long size;
+        std::vector<double> ops_per_sec; // Una por repeticion
+        std::vector<double> p99;
+    };
+    std::vector<Entry> entries;
+
+    // Posicion de la entrada de la misma carga o -1
+    int find(const Entry& like) const;
+
+public:
+    // Agrega una repeticion de una carga
+    void add(const BenchResult& result);
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    bool save(const char *path) const;
+    bool load(const char *path);
+
+    /* Compara estos resultados contra 'baseline' y escribe una linea por carga. Retorna la cantidad
+     de regresiones */
+    int compare(const BenchBaseline& baseline, double alpha, double threshold) const;
+
+    /* Prueba de Mann-Whitney de una cola: probabilidad de ver valores tan bajos en 'y' comparados con
+     'x' si las dos muestras vienen de la misma distribucion. Exacta sin empates y con muestras de
+     hasta 20, si no con la aproximacion normal */
+    static double mannWhitneyLess(const std::vector<double>& x, const std::vector<double>& y);
+};
+
+#endif	/* BENCHBASELINE_H */
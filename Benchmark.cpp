@@ -0,0 +1,469 @@
+/*
+ * Benchmark de los tres arboles (make bench).
+ *
+ * Para cada arbol y cada tamanno corre estas cargas:
+ *      seq-insert      inserta 0..n-1 en orden
+ *      rand-insert     inserta 0..n-1 en orden aleatorio (este arbol se usa en las cargas siguientes)
+ *      bulk-build      arma un arbol con 0..n-1 en orden aleatorio con parallelBuild (ordena, quita repetidas
+ *                      y arma el arbol con --threads hilos, ver ParallelBuild.h; sin latencias)
+ *      uniform-read    busquedas de llaves al azar, todas con la misma probabilidad
+ *      ycsb-c          100% busquedas, llaves con distribucion Zipfian (pocas llaves muy pedidas)
+ *      ycsb-b          95% busquedas, 5% actualizaciones, Zipfian
+ *      ycsb-a          50% busquedas, 50% actualizaciones, Zipfian
+ *      ycsb-d          95% busquedas de las llaves mas nuevas, 5% inserciones de llaves nuevas
+ *      rand-delete     elimina las llaves 0..n-1 en orden aleatorio (bytes/key no aplica: queda en 0)
+ *
+ * Un arbol guarda llaves sin datos, asi que "actualizar" una llave es eliminarla y volverla a insertar.
+ * Por cada carga se reporta operaciones por segundo, latencia p50/p99/p999 y bytes por llave. Los bytes
+ * por llave son los que los nodos del arbol ocupan en su NodeArena (incluye el redondeo a 16 bytes).
+ *
+ * Uso: benchmark [--engines avl,rb,bigtree] [--sizes 1K,10K,100K,1M] [--workloads seq-insert,...]
+ *                [--ops N] [--degree N] [--seed N] [--json archivo] [--repeat N] [--threads N]
+ *                [--save-baseline archivo] [--compare archivo] [--alpha 0.01] [--threshold 0.05]
+ * Los tamannos aceptan K, M y G (100M = 100 millones).
+ *
+ * Con --repeat todo se corre N veces. --save-baseline guarda las repeticiones como referencia y
+ * --compare las compara contra una referencia guardada (ver BenchBaseline): si alguna carga es mas
+ * lenta de forma significativa el programa termina con codigo 2 (make bench-check falla).
+ *
+ * Compilado con -DTREE_COUNTERS (make bench BENCH_FLAGS=-DTREE_COUNTERS) despues de cada carga se
+ * escriben los contadores de TreeCounters de esa carga.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "OrderedSet.h"
+#include "NodeArena.h"
+#include "TreeCounters.h"
+#include "LatencyRecorder.h"
+#include "BenchBaseline.h"
+#include "ParallelBuild.h"
+
+static const char *ALL_WORKLOADS = "seq-insert,rand-insert,bulk-build,uniform-read,ycsb-c,ycsb-b,ycsb-a,ycsb-d,rand-delete";
+
+// Se toma la latencia de a lo mas tantas operaciones por carga (repartidas en toda la carga)
+static const long long MAX_SAMPLES = 1000000;
+
+struct BenchOptions {
+    std::vector<std::string> engines;
+    std::vector<long long> sizes;
+    std::vector<std::string> workloads;
+    long long ops; // Operaciones de las cargas de lectura (0: segun el tamanno)
+    int degree; // Grado del BigTree
+    unsigned long long seed;
+    const char *json;
+    int repeat;
+    int threads; // Hilos de bulk-build (0: todos los cpus)
+    const char *save_baseline;
+    const char *compare;
+    double alpha; // Significancia de la prueba de Mann-Whitney
+    double threshold; // Cuanto tiene que bajar la mediana para que sea regresion (0.05: 5%)
+};
+
+enum OpKind {
+    OP_READ, OP_UPDATE, OP_INSERT
+};
+
+struct BenchOp {
+    int key;
+    int kind;
+};
+
+/*
+ * Generador Zipfian de YCSB (Gray et al., "Quickly generating billion-record synthetic databases"):
+ * devuelve un rango entre 0 y n-1, el rango 0 es el mas probable. Con theta 0.99 como en YCSB.
+ */
+class ZipfianGenerator {
+private:
+    long long n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+
+    static double zeta(long long n, double theta) {
+        double sum = 0;
+        for (long long i = 1; i <= n; i++)
+            sum += 1 / pow((double) i, theta);
+        return sum;
+    }
+
+public:
+    ZipfianGenerator(long long _n, double _theta = 0.99) {
+        n = _n;
+        theta = _theta;
+        alpha = 1 / (1 - theta);
+        zetan = zeta(n, theta);
+        eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+    }
+
+    template<class Random>
+    long long next(Random& rng) {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + pow(0.5, theta))
+            return 1;
+        long long rank = (long long) (n * pow(eta * u - eta + 1, alpha));
+        return rank < n ? rank : n - 1;
+    }
+};
+
+/* Las llaves mas pedidas quedan repartidas por todo el arbol y no juntas al principio (como en YCSB) */
+static long long scramble(long long rank, long long n) {
+    unsigned long long h = 0xcbf29ce484222325ULL; // FNV-1a
+    for (int i = 0; i < 8; i++) {
+        h ^= (rank >> (i * 8)) & 0xff;
+        h *= 0x100000001b3ULL;
+    }
+    return (long long) (h % (unsigned long long) n);
+}
+
+static volatile long long sink; // Para que el compilador no quite las busquedas
+
+/* Corre 'ops' veces 'op(i)' y toma la latencia (con el TSC) de una de cada 'stride' */
+template<class Operation>
+static void measure(long long ops, BenchResult& result, Operation op) {
+    LatencyHistogram latencies;
+    long long stride = ops / MAX_SAMPLES + 1;
+    long long countdown = 1;
+    TreeCounters::reset();
+    unsigned long long start = TscClock::nowNs();
+    for (long long i = 0; i < ops; i++) {
+        if (--countdown == 0) {
+            unsigned long long t0 = TscClock::start();
+            op(i);
+            latencies.record(TscClock::stop() - t0);
+            countdown = stride;
+        } else
+            op(i);
+    }
+    double seconds = (TscClock::nowNs() - start) / 1e9;
+    double ns = TscClock::nsPerTick();
+    result.ops = ops;
+    result.ops_per_sec = seconds > 0 ? ops / seconds : 0;
+    result.p50 = latencies.percentile(0.5) * ns;
+    result.p99 = latencies.percentile(0.99) * ns;
+    result.p999 = latencies.percentile(0.999) * ns;
+}
+
+template<OrderedSet Set>
+static void runOps(Set& set, const std::vector<BenchOp>& ops, BenchResult& result) {
+    long long found = 0;
+    measure((long long) ops.size(), result, [&](long long i) {
+        const BenchOp& op = ops[i];
+        if (op.kind == OP_READ)
+            found += set.contains(op.key);
+        else if (op.kind == OP_UPDATE) {
+            set.erase(op.key);
+            set.insert(op.key);
+        } else
+            set.insert(op.key);
+    });
+    sink = found;
+}
+
+/* Operaciones de una carga de lectura sobre un arbol con las llaves 0..n-1 */
+static std::vector<BenchOp> makeOps(const std::string& workload, long long n, long long ops, ZipfianGenerator& zipf, std::mt19937_64& rng) {
+    std::vector<BenchOp> result(ops);
+    int update_percent = workload == "ycsb-a" ? 50 : workload == "ycsb-b" ? 5 : 0;
+    long long next_key = n; // ycsb-d
+    for (long long i = 0; i < ops; i++) {
+        BenchOp& op = result[i];
+        op.kind = OP_READ;
+        if (workload == "uniform-read")
+            op.key = (int) (rng() % n);
+        else if (workload == "ycsb-d") {
+            if (rng() % 100 < 5) {
+                op.kind = OP_INSERT;
+                op.key = (int) next_key++;
+            } else {
+                long long rank = zipf.next(rng); // Rango 0 es la ultima llave insertada
+                op.key = (int) (rank < next_key ? next_key - 1 - rank : 0);
+            }
+        } else {
+            op.key = (int) scramble(zipf.next(rng), n);
+            if ((int) (rng() % 100) < update_percent)
+                op.kind = OP_UPDATE;
+        }
+    }
+    return result;
+}
+
+static bool wanted(const std::vector<std::string>& list, const std::string& name) {
+    return std::find(list.begin(), list.end(), name) != list.end();
+}
+
+static void report(const BenchResult& r, std::vector<BenchResult>& results) {
+    printf("%-8s %-13s %12lld %12lld %14.0f %9.0f %9.0f %9.0f %10.1f\n", r.engine.c_str(), r.workload.c_str(),
+            r.size, r.ops, r.ops_per_sec, r.p50, r.p99, r.p999, r.bytes_per_key);
+    if (TreeCounters::enabled())
+        TreeCounters::snapshot().print(stdout, "    ");
+    fflush(stdout);
+    results.push_back(r);
+}
+
+/* Corre todas las cargas pedidas en un arbol. 'make(arena)' crea un arbol vacio que usa 'arena' */
+template<OrderedSet Set, class Factory>
+static void runEngine(const char *engine, Factory make, long long n, const BenchOptions& options, std::vector<BenchResult>& results) {
+    std::mt19937_64 rng(options.seed + n);
+    BenchResult result;
+    result.engine = engine;
+    result.size = n;
+
+    if (wanted(options.workloads, "seq-insert")) {
+        NodeArena arena;
+        Set *set = make(&arena);
+        measure(n, result, [&](long long i) {
+            set->insert((int) i);
+        });
+        result.workload = "seq-insert";
+        result.bytes_per_key = (double) arena.usedBytes() / n;
+        report(result, results);
+        delete set;
+    }
+
+    bool reads = false;
+    for (size_t i = 0; i < options.workloads.size(); i++)
+        reads |= options.workloads[i] != "seq-insert";
+    if (!reads)
+        return;
+
+    NodeArena arena;
+    Set *set = make(&arena);
+    std::vector<int> keys(n);
+    for (long long i = 0; i < n; i++)
+        keys[i] = (int) i;
+    std::shuffle(keys.begin(), keys.end(), rng);
+    measure(n, result, [&](long long i) {
+        set->insert(keys[i]);
+    });
+    result.workload = "rand-insert";
+    result.bytes_per_key = (double) arena.usedBytes() / n;
+    if (wanted(options.workloads, "rand-insert"))
+        report(result, results);
+
+    if (wanted(options.workloads, "bulk-build")) {
+        NodeArena bulk_arena;
+        Set *bulk = make(&bulk_arena);
+        unsigned long long start = TscClock::nowNs();
+        parallelBuild(*bulk, keys, options.threads);
+        double seconds = (TscClock::nowNs() - start) / 1e9;
+        BenchResult built = result;
+        built.workload = "bulk-build";
+        built.ops = n;
+        built.ops_per_sec = seconds > 0 ? n / seconds : 0;
+        built.p50 = built.p99 = built.p999 = 0;
+        built.bytes_per_key = (double) bulk_arena.usedBytes() / n;
+        report(built, results);
+        delete bulk;
+    }
+
+    long long ops = options.ops;
+    if (ops <= 0)
+        ops = std::min(std::max(n, 1000000LL), 10000000LL);
+    ZipfianGenerator zipf(n);
+    long long size = n; // Llaves en el arbol
+    // ycsb-d va al final porque agrega llaves; las actualizaciones no cambian el conjunto de llaves
+    const char *order[] = {"uniform-read", "ycsb-c", "ycsb-b", "ycsb-a", "ycsb-d"};
+    for (int w = 0; w < 5; w++) {
+        if (!wanted(options.workloads, order[w]))
+            continue;
+        std::vector<BenchOp> operations = makeOps(order[w], n, ops, zipf, rng);
+        result.workload = order[w];
+        runOps(*set, operations, result);
+        for (size_t i = 0; i < operations.size(); i++)
+            size += operations[i].kind == OP_INSERT;
+        result.bytes_per_key = (double) arena.usedBytes() / size;
+        report(result, results);
+    }
+
+    if (wanted(options.workloads, "rand-delete")) {
+        std::shuffle(keys.begin(), keys.end(), rng);
+        measure(n, result, [&](long long i) {
+            set->erase(keys[i]);
+        });
+        result.workload = "rand-delete";
+        result.bytes_per_key = 0;
+        report(result, results);
+    }
+    delete set;
+}
+
+static std::vector<std::string> splitList(const char *text) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char *c = text;; c++) {
+        if (*c == ',' || *c == 0) {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*c == 0)
+                break;
+        } else
+            item += *c;
+    }
+    return items;
+}
+
+static long long parseSize(const std::string& text) {
+    char *end;
+    double value = strtod(text.c_str(), &end);
+    switch (*end) {
+        case 'k': case 'K': value *= 1e3;
+            break;
+        case 'm': case 'M': value *= 1e6;
+            break;
+        case 'g': case 'G': value *= 1e9;
+            break;
+    }
+    return (long long) value;
+}
+
+static void writeJson(const char *path, const std::vector<BenchResult>& results) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(file, "[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(file, "  {\"engine\": \"%s\", \"workload\": \"%s\", \"size\": %lld, \"ops\": %lld, \"ops_per_sec\": %.1f, "
+                "\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"bytes_per_key\": %.2f}%s\n",
+                r.engine.c_str(), r.workload.c_str(), r.size, r.ops, r.ops_per_sec, r.p50, r.p99, r.p999,
+                r.bytes_per_key, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]\n");
+    fclose(file);
+}
+
+static void usage() {
+    printf("Uso: benchmark [--engines avl,rb,bigtree] [--sizes 1K,10K,100K,1M] [--workloads %s]\n", ALL_WORKLOADS);
+    printf("               [--ops N] [--degree N] [--seed N] [--json archivo] [--repeat N] [--threads N]\n");
+    printf("               [--save-baseline archivo] [--compare archivo] [--alpha 0.01] [--threshold 0.05]\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    options.engines = splitList("avl,rb,bigtree");
+    const char *sizes = "1K,10K,100K,1M";
+    options.workloads = splitList(ALL_WORKLOADS);
+    options.ops = 0;
+    options.degree = 16;
+    options.seed = 42;
+    options.json = NULL;
+    options.repeat = 1;
+    options.threads = 0;
+    options.save_baseline = NULL;
+    options.compare = NULL;
+    options.alpha = 0.01;
+    options.threshold = 0.05;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc || arg.compare(0, 2, "--") != 0) {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+        const char *value = argv[++i];
+        if (arg == "--engines")
+            options.engines = splitList(value);
+        else if (arg == "--sizes")
+            sizes = value;
+        else if (arg == "--workloads")
+            options.workloads = splitList(value);
+        else if (arg == "--ops")
+            options.ops = parseSize(value);
+        else if (arg == "--degree")
+            options.degree = atoi(value);
+        else if (arg == "--seed")
+            options.seed = strtoull(value, NULL, 10);
+        else if (arg == "--json")
+            options.json = value;
+        else if (arg == "--repeat")
+            options.repeat = atoi(value);
+        else if (arg == "--threads")
+            options.threads = atoi(value);
+        else if (arg == "--save-baseline")
+            options.save_baseline = value;
+        else if (arg == "--compare")
+            options.compare = value;
+        else if (arg == "--alpha")
+            options.alpha = atof(value);
+        else if (arg == "--threshold")
+            options.threshold = atof(value);
+        else {
+            usage();
+            return 1;
+        }
+    }
+    std::vector<std::string> size_list = splitList(sizes);
+    for (size_t i = 0; i < size_list.size(); i++) {
+        long long n = parseSize(size_list[i]);
+        if (n < 2 || n > 0x7fffffffLL) {
+            printf("Tamanno invalido: %s\n", size_list[i].c_str());
+            return 1;
+        }
+        options.sizes.push_back(n);
+    }
+
+    BenchBaseline baseline;
+    if (options.compare != NULL && !baseline.load(options.compare))
+        return 1;
+    if (options.repeat < 1)
+        options.repeat = 1;
+
+    std::vector<BenchResult> results;
+    printf("%-8s %-13s %12s %12s %14s %9s %9s %9s %10s\n", "engine", "workload", "size", "ops", "ops/s",
+            "p50(ns)", "p99(ns)", "p999(ns)", "bytes/key");
+    int degree = options.degree;
+    for (int r = 0; r < options.repeat; r++)
+        for (size_t s = 0; s < options.sizes.size(); s++) {
+            long long n = options.sizes[s];
+            for (size_t e = 0; e < options.engines.size(); e++) {
+                const std::string& engine = options.engines[e];
+                if (engine == "avl")
+                    runEngine<AVLSet>("avl", [](NodeArena * arena) {
+                        return new AVLSet(arena);
+                    }, n, options, results);
+                else if (engine == "rb")
+                    runEngine<RedBlackSet>("rb", [](NodeArena * arena) {
+                        return new RedBlackSet(arena);
+                    }, n, options, results);
+                else if (engine == "bigtree")
+                    runEngine<BigTreeSet>("bigtree", [degree](NodeArena * arena) {
+                        return new BigTreeSet(degree, false, 0, arena);
+                    }, n, options, results);
+                else {
+                    printf("Arbol desconocido: %s (avl, rb o bigtree)\n", engine.c_str());
+                    return 1;
+                }
+            }
+        }
+    if (options.json != NULL)
+        writeJson(options.json, results);
+
+    BenchBaseline current;
+    for (size_t i = 0; i < results.size(); i++)
+        current.add(results[i]);
+    if (options.save_baseline != NULL && !current.save(options.save_baseline))
+        return 1;
+    if (options.compare != NULL) {
+        printf("\nComparacion con %s (%d repeticiones, alpha %g, umbral %.0f%%):\n", options.compare,
+                options.repeat, options.alpha, options.threshold * 100);
+        int regressions = current.compare(baseline, options.alpha, options.threshold);
+        if (regressions > 0) {
+            printf("%d regresiones\n", regressions);
+            return 2;
+        }
+        printf("Sin regresiones\n");
+    }
+    return 0;
+}
@@ -1,18 +1,264 @@
 #include "BigTree.h"
+#include "ParallelBuild.h"
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <climits>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/* Hojas que se descomprimieron durante la operacion actual del arbol (NULL si el arbol no comprime) */
+static thread_local std::vector<BTreeNode*> *expanded_leaves = NULL;
+
+/* Llaves eliminadas en modo perezoso que revivio la insercion actual (ver BTreeNode::revive) */
+static thread_local size_t revived_keys = 0;
+
+/* Si es false no se avisa cuando se elimina una llave que no esta (ver BigTree::erase) */
+static thread_local bool report_missing = true;
+
+/* Cantidad de palabras de 32 bits para 'n' llaves de 'width' bits. Siempre sobra una palabra
+ * al final, asi una llave siempre se puede leer con dos palabras seguidas */
+static int packedWords(int n, int width) {
+    return (int) (((long long) n * width) / 32) + 2;
+}
+
+/* Palabras de 64 bits del mapa de llaves eliminadas de un nodo de grado 'degree' */
+static int deadWords(int degree) {
+    return (2 * degree - 1 + 63) / 64;
+}
+
+/* Orden de los mensajes en un buffer, para std::lower_bound */
+static bool messageBefore(const TreeMessage& m, int k) {
+    return m.key < k;
+}
+
+static bool messageLess(const TreeMessage& a, const TreeMessage& b) {
+    return a.key < b.key;
+}
+
+static void forgetExpanded(BTreeNode *node) {
+    if (expanded_leaves == NULL)
+        return;
+    for (size_t i = 0; i < expanded_leaves->size(); i++) {
+        if ((*expanded_leaves)[i] == node) {
+            (*expanded_leaves)[i] = expanded_leaves->back();
+            expanded_leaves->pop_back();
+            return;
+        }
+    }
+}
 
 /* Constructor para la clase del nodo del Big Tree */
-BTreeNode::BTreeNode(int _degree, bool _leaf) {
+BTreeNode::BTreeNode(int _degree, bool _leaf, NodeArena *_arena) {
 
     // Asignamos los valores a las variables del objeto
     degree = _degree;
     leaf = _leaf;
+    arena = _arena;
 
     //Reservamos la maxima cantidad de memoria para el arreglo de las llavs y para el de los hijos
-    keys = new int[2 * degree - 1]; //El valor maximo de llaves es 2*grado-1
-    children = new BTreeNode *[2 * degree]; //El valor maximo de hijos es de 2*grado
+    newArrays();
 
     // inicializamos el numero actual de llaves en 0, ya que no hay llaves al crearse el nodo
     number_keys = 0;
+
+    // El nodo empieza con una sola referencia: la de quien lo creo
+    ref_count.store(1);
+
+    // Los nodos se crean sin comprimir
+    packed = NULL;
+    base = 0;
+    width = 0;
+
+    // Sin llaves eliminadas
+    dead = NULL;
+}
+
+BTreeNode::~BTreeNode() {
+    freeArrays();
+    if (packed != NULL)
+        NodeArena::deallocateIn(arena, packed, packedWords(number_keys, width) * sizeof (unsigned int));
+    if (dead != NULL)
+        NodeArena::deallocateIn(arena, dead, deadWords(degree) * sizeof (unsigned long long));
+}
+
+void BTreeNode::newArrays() {
+    keys = (int*) NodeArena::allocateIn(arena, (2 * degree - 1) * sizeof (int)); //El valor maximo de llaves es 2*grado-1
+    children = (BTreeNode**) NodeArena::allocateIn(arena, 2 * degree * sizeof (BTreeNode*)); //El valor maximo de hijos es de 2*grado
+}
+
+void BTreeNode::freeArrays() {
+    if (keys != NULL)
+        NodeArena::deallocateIn(arena, keys, (2 * degree - 1) * sizeof (int));
+    if (children != NULL)
+        NodeArena::deallocateIn(arena, children, 2 * degree * sizeof (BTreeNode*));
+    keys = NULL;
+    children = NULL;
+}
+
+/* Copia las llaves y los punteros a los hijos. Ahora los hijos tienen un padre mas */
+BTreeNode *BTreeNode::clone() {
+    BTreeNode *copy = new (arena) BTreeNode(degree, leaf, arena);
+    copy->number_keys = number_keys;
+    for (int i = 0; dead != NULL && i < number_keys; i++)
+        copy->setDead(i, isDead(i));
+
+    //Una hoja comprimida se copia comprimida
+    if (packed != NULL) {
+        copy->freeArrays();
+        int words = packedWords(number_keys, width);
+        copy->packed = (unsigned int*) NodeArena::allocateIn(arena, words * sizeof (unsigned int));
+        for (int i = 0; i < words; i++)
+            copy->packed[i] = packed[i];
+        copy->base = base;
+        copy->width = width;
+        return copy;
+    }
+    for (int i = 0; i < number_keys; i++)
+        copy->keys[i] = keys[i];
+    copy->buffer = buffer;
+    if (!leaf) {
+        for (int i = 0; i <= number_keys; i++) {
+            copy->children[i] = children[i];
+            children[i]->ref_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return copy;
+}
+
+/* Suelta una referencia. El ultimo en soltar el nodo lo libera junto con las referencias a sus hijos */
+void BTreeNode::release(BTreeNode *node) {
+    if (node == NULL)
+        return;
+    if (node->ref_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    if (!node->leaf) {
+        for (int i = 0; i <= node->number_keys; i++)
+            release(node->children[i]);
+    }
+    delete node;
+}
+
+/* Copy-on-write: si el hijo tambien lo usa un snapshot, este nodo se queda con una copia propia */
+BTreeNode *BTreeNode::ownChild(int idx) {
+    BTreeNode *child = children[idx];
+    if (child->ref_count.load(std::memory_order_acquire) > 1) {
+        children[idx] = child->clone();
+        release(child);
+    }
+
+    //Una hoja comprimida se descomprime para modificarla y se vuelve a comprimir al final de la operacion
+    if (children[idx]->packed != NULL) {
+        children[idx]->expand();
+        if (expanded_leaves != NULL)
+            expanded_leaves->push_back(children[idx]);
+    }
+    return children[idx];
+}
+
+/*
+ * Frame-of-reference: la llave menor de la hoja es la base y cada llave se guarda como su
+ * distancia a la base, usando solo los bits que necesita la distancia mas grande. Las llaves
+ * ya estan ordenadas, asi que la distancia mas grande es la de la ultima llave.
+ */
+void BTreeNode::compress() {
+    if (!leaf || packed != NULL)
+        return;
+
+    base = number_keys > 0 ? keys[0] : 0;
+    unsigned int range = number_keys > 0 ? (unsigned int) keys[number_keys - 1] - (unsigned int) base : 0;
+    width = 0;
+    while (width < 32 && (range >> width) != 0)
+        width++;
+
+    int words = packedWords(number_keys, width);
+    packed = (unsigned int*) NodeArena::allocateIn(arena, words * sizeof (unsigned int));
+    for (int i = 0; i < words; i++)
+        packed[i] = 0;
+    for (int i = 0; i < number_keys; i++) {
+        unsigned int value = (unsigned int) keys[i] - (unsigned int) base;
+        unsigned int bit = (unsigned int) i * width;
+        unsigned int word = bit >> 5, shift = bit & 31;
+        packed[word] |= value << shift;
+        if (shift + width > 32)
+            packed[word + 1] |= value >> (32 - shift);
+    }
+
+    freeArrays();
+}
+
+void BTreeNode::expand() {
+    if (packed == NULL)
+        return;
+    newArrays();
+    decode(0, number_keys, keys);
+    NodeArena::deallocateIn(arena, packed, packedWords(number_keys, width) * sizeof (unsigned int));
+    packed = NULL;
+}
+
+int BTreeNode::keyAt(int i) const {
+    if (packed == NULL)
+        return keys[i];
+    unsigned int bit = (unsigned int) i * width;
+    unsigned long long window = packed[bit >> 5] | ((unsigned long long) packed[(bit >> 5) + 1] << 32);
+    unsigned int mask = width == 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+    //La suma se hace sin signo (modulo 2^32) como en pack(): con signo se desborda si la distancia es grande
+    return (int) (((unsigned int) (window >> (bit & 31)) & mask) + (unsigned int) base);
+}
+
+/*
+ * Desempaca varias llaves. Con AVX2 se desempacan 8 llaves a la vez: para cada una se leen las
+ * dos palabras donde puede estar (gather) y se juntan con corrimientos variables.
+ */
+void BTreeNode::decode(int first, int count, int *out) const {
+    if (packed == NULL) {
+        for (int i = 0; i < count; i++)
+            out[i] = keys[first + i];
+        return;
+    }
+    int i = 0;
+#ifdef __AVX2__
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i w = _mm256_set1_epi32(width);
+    const __m256i mask = _mm256_set1_epi32(width == 32 ? -1 : (int) ((1u << width) - 1));
+    const __m256i b = _mm256_set1_epi32(base);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i bits31 = _mm256_set1_epi32(31);
+    const __m256i bits32 = _mm256_set1_epi32(32);
+    for (; i + 8 <= count; i += 8) {
+        __m256i bit = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_set1_epi32(first + i), lane), w);
+        __m256i word = _mm256_srli_epi32(bit, 5);
+        __m256i shift = _mm256_and_si256(bit, bits31);
+        __m256i lo = _mm256_i32gather_epi32((const int*) packed, word, 4);
+        __m256i hi = _mm256_i32gather_epi32((const int*) packed, _mm256_add_epi32(word, one), 4);
+        //Si 'shift' es 0 el corrimiento de 'hi' es de 32 bits y da 0
+        __m256i value = _mm256_or_si256(_mm256_srlv_epi32(lo, shift),
+                _mm256_sllv_epi32(hi, _mm256_sub_epi32(bits32, shift)));
+        value = _mm256_add_epi32(_mm256_and_si256(value, mask), b);
+        _mm256_storeu_si256((__m256i*) (out + i), value);
+    }
+#endif
+    for (; i < count; i++)
+        out[i] = keyAt(first + i);
+}
+
+size_t BTreeNode::memoryBytes() const {
+    size_t bytes = sizeof (BTreeNode);
+    if (packed != NULL)
+        bytes += packedWords(number_keys, width) * sizeof (unsigned int);
+    if (keys != NULL)
+        bytes += (2 * degree - 1) * sizeof (int);
+    bytes += buffer.capacity() * sizeof (TreeMessage);
+    if (children != NULL)
+        bytes += 2 * degree * sizeof (BTreeNode*);
+    if (dead != NULL)
+        bytes += deadWords(degree) * sizeof (unsigned long long);
+    if (!leaf) {
+        for (int i = 0; i <= number_keys; i++)
+            bytes += children[i]->memoryBytes();
+    }
+    return bytes;
 }
 
 /* Muestra el arbol en forma de 'cortes' transversales de forma recursiva */
@@ -25,7 +271,8 @@ void BTreeNode::traverse() {
         if (!leaf) {
             children[i]->traverse();
         }
-        cout << " " << keys[i];
+        if (!isDead(i))
+            cout << " " << keyAt(i);
     }
     //Ahora se realiza el ultimo hijo, nos fijamos que no sea hoja para evitar problemas
     if (!leaf) {
@@ -37,6 +284,30 @@ void BTreeNode::traverse() {
 /* Esta funcion retorna un puntero al nodo que contiene un valor 'k' */
 BTreeNode *BTreeNode::search(int k) {
 
+    // Un mensaje pendiente para 'k' es mas nuevo que lo que haya mas abajo
+    if (!buffer.empty()) {
+        int m = findMessage(k);
+        if (m >= 0) {
+            TREE_LOOKUP_VISIT(0);
+            return buffer[m].insert ? this : NULL;
+        }
+    }
+
+    // En una hoja comprimida cualquier llave se puede leer directo, asi que se hace busqueda binaria
+    if (packed != NULL) {
+        int lo = 0, hi = number_keys;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (keyAt(mid) < k)
+                lo = mid + 1;
+            else
+                hi = mid;
+            TREE_COUNT(LOOKUP_COMPARISONS, 1);
+        }
+        TREE_LOOKUP_VISIT(1);
+        return (lo < number_keys && keyAt(lo) == k) ? this : NULL;
+    }
+
     // encuentra la primer llave mayor o igual a 'k'
     //en otras palabras, el siguiente while aumenta el valor de 'i' en 1 mientras con la condicion de que el valor de 
     // i sea menor al numero de llaves en el nodo y que al mismo tiempo el valor de k  sea mayor al valor de la llave que 
@@ -44,9 +315,10 @@ BTreeNode *BTreeNode::search(int k) {
     int i = 0;
     while (i < number_keys && k > keys[i])
         i++;
+    TREE_LOOKUP_VISIT(i < number_keys ? i + 1 : i);
 
     // Si la llave encontrada es igual a k entonces retornamos un puntero a este nodo
-    if (keys[i] == k)
+    if (i < number_keys && keys[i] == k)
         return this;
 
     //Si la llave no fue encontrada (su hibiera sido no esta parte de codigo no llegaria a ejecutarse nunca)
@@ -63,13 +335,81 @@ BTreeNode *BTreeNode::search(int k) {
  * es la que inicia toda la cadena de acciones necesarias para una correcta incercion */
 void BigTree::insert(int k) {
 
+    // Camino rapido para llaves crecientes: si la llave va al final de la hoja mas a la derecha y ahi
+    //hay lugar, se agrega sin bajar por el arbol
+    if (right_leaf != NULL && right_leaf->number_keys < 2 * tree_degree - 1
+            && k > right_leaf->keys[right_leaf->number_keys - 1]) {
+        right_leaf->keys[right_leaf->number_keys++] = k;
+        if (filter != NULL)
+            filter->add(k);
+        return;
+    }
+
+    //El filtro solo debe contar llaves nuevas: si dice que la llave puede estar hay que buscarla. Una
+    //llave eliminada en modo perezoso sigue en el filtro y en su nodo: solo se le quita la marca
+    if (filter != NULL) {
+        if (root != NULL && filter->mayContain(k)) {
+            BTreeNode *node = root->search(k);
+            if (node != NULL) {
+                if (node->dead != NULL && node->revive(node->keyIndex(k)))
+                    tombstones--;
+                return;
+            }
+        }
+        filter->add(k);
+    }
+
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    ownRoot();
+
+    // Con buffers la insercion queda como mensaje en la raiz (si la raiz es hoja se inserta directo)
+    if (buffer_capacity > 0 && root != NULL && !root->leaf) {
+        TreeMessage m = {k, true};
+        root->putMessage(m, true);
+        if ((int) root->buffer.size() >= buffer_capacity)
+            flushRoot(false);
+    } else {
+        //Solo una llave que baja hasta la hoja mas a la derecha puede separarla
+        bool edge = right_leaf == NULL || !has_floor || k > right_floor;
+        revived_keys = 0;
+        insertKey(k);
+        tombstones -= revived_keys;
+        if (edge && buffer_capacity == 0 && !compress_leaves)
+            findRightLeaf();
+    }
+    compressExpanded();
+}
+
+void BigTree::findRightLeaf() {
+    right_leaf = root;
+    has_floor = false;
+    while (right_leaf != NULL) {
+        //Si un snapshot comparte algun nodo del camino, la hoja no se puede modificar sin copiarla (y
+        //una hoja comprimida, que puede venir de otro arbol con merge, sin descomprimirla)
+        if (right_leaf->ref_count.load(std::memory_order_acquire) > 1 || right_leaf->packed != NULL) {
+            right_leaf = NULL;
+            return;
+        }
+        if (right_leaf->leaf)
+            return;
+        right_floor = right_leaf->keys[right_leaf->number_keys - 1];
+        has_floor = true;
+        right_leaf = right_leaf->children[right_leaf->number_keys];
+    }
+}
+
+void BigTree::insertKey(int k) {
+    ownRoot();
+
     // Si el arbol esta vacio entonces simplemente hacemos un nuevo nodo y le asignamos la llave que queremos insertar
     if (root == NULL) {
         //creamos un nuevo nodo que tiene un grado igual al grado del arbol y tambien le pasamos el parametro 'true' 
         //para simbolizar que dicho nodo es una hoja
-        root = new BTreeNode(tree_degree, true);
+        root = new (arena) BTreeNode(tree_degree, true, arena);
         root->keys[0] = k; // Insertamos la llave
         root->number_keys = 1; // Modificamos el numero de llaves que contiene el nodo para reflejar el cambio
+        if (compress_leaves)
+            expanded.push_back(root);
 
     } else { //en el caso de que el arbol no se encuentre vacio
 
@@ -78,13 +418,13 @@ void BigTree::insert(int k) {
         //que puede tener un nodo es de 2*grad_arbol -1
         if (root->number_keys == 2 * tree_degree - 1) {
 
-            BTreeNode * new_node = new BTreeNode(tree_degree, false);
+            BTreeNode * new_node = new (arena) BTreeNode(tree_degree, false, arena);
 
             // Asignamos al nodo que se encuentra actualmente en la raiz como hijo del nuevo nodo
             new_node->children[0] = root;
 
             //Separamos a la raiz y movemos una llave de la raiz al nuevo nodo
-            new_node->splitChild(0, root);
+            new_node->splitChild(0, root, k > root->keys[2 * tree_degree - 2]);
 
             //Actualmente la nueva raiz tiene 2 hijos, por lo tanto hay que decidir cual de los dos va a tener la una nueva llave
             //(esta seria la llave que estamos intentando insertar). Para decidir esto vemos si k es mayor que la raiz actual (en cuyo caso iria en 
@@ -93,24 +433,34 @@ void BigTree::insert(int k) {
             int i = 0;
             if (new_node->keys[0] < k)
                 i++;
-            new_node->children[i]->insertNonFull(k);
+            if (new_node->keys[0] != k)
+                new_node->ownChild(i)->insertNonFull(k, i == 1);
+            else
+                new_node->revive(0);
 
             // cambiamos el puntero de la razi para que apunte al nuevo nodo
             root = new_node;
         } else // Si la raiz no esta llena entonces llamamos al metodo insertNonFull sobre la raiz, pasandole 'k'
-            root->insertNonFull(k);
+            root->insertNonFull(k, true);
     }
 }
 
 /* Se encarga de insertar una llave en el nodo actual. Se asume que el nodo actual no esta lleno cuando esta
  * funcion se ejecuta, es responsabilidad de la funcion que llama a esta fijarse que este sea el caso */
-void BTreeNode::insertNonFull(int k) {
+void BTreeNode::insertNonFull(int k, bool right_edge) {
     // Inicializamos 'i' como el index del elemento de mayor tamanno (aquel que se encuentra mas a las derecha)
     int i = number_keys - 1; //Al final del metodo este 'i' va a ser la posicion en la que vamos a insertar el nuevo valor
 
     // Si el nodo actual es una hoja..
     if (leaf == true) {
 
+        //no queremos que haya valores repetidos
+        int pos = findKey(k);
+        if (pos < number_keys && keys[pos] == k) {
+            revive(pos); //Si estaba eliminada en modo perezoso vuelve a estar
+            return;
+        }
+
         /*El siguiente while hace dos cosas
              a) Encuentra la posicion en la que insertar la nueva llave
               b) Mueve todas las llaves mayores que la nueva llave un campo a la derecha
@@ -120,11 +470,15 @@ void BTreeNode::insertNonFull(int k) {
          Este es un metodo recursivo, la insercion solo se hace si el metodo actual es una hoja, si no lo es entonces
          se hacen las separaciones necesarias y recursivamente se elige en cual hoja debe de ser insertado el nuevo valor*/
         while (i >= 0 && keys[i] > k) {
-            if (k == keys[i]) return; //no queremos que haya valores repetidos
             keys[i + 1] = keys[i]; //movemos la llave que esta en el indice i un espacio para la derecha (a i+1)
             i--;
         }
 
+        //Las marcas de llaves eliminadas se mueven con sus llaves
+        for (int j = number_keys - 1; dead != NULL && j > i; j--)
+            setDead(j + 1, isDead(j));
+        setDead(i + 1, false);
+
         // Insertamos la nueva llave en la posicion encontrada
         keys[i + 1] = k;
         number_keys = number_keys + 1;
@@ -134,22 +488,35 @@ void BTreeNode::insertNonFull(int k) {
         //Para saber esto encontramos cual valor es inmediaatamente menor que 'k'
         while (i >= 0 && keys[i] > k) //empezamos desde el valor de la derecha que seria el mayor valor e iteramos hasta el valor de la izquierda (el menor valor)
             i--;
+        if (i >= 0 && keys[i] == k) {
+            revive(i);
+            return; //la llave ya esta en este nodo
+        }
+
+        //El hijo se va a modificar, asi que no puede seguir compartido con un snapshot
+        ownChild(i + 1);
 
         // Una vez encontrado donde poner el nuevo valor nos fijamos si el hijo [i+1] del nodo actual (el hijo que estaria a la derecha del valor que queremos insertar)
         //esta lleno (en cuyo caso tenemos que separarlo)
         if (children[i + 1]->number_keys == 2 * degree - 1) {
-            // Si esta lleno, entonces es separado 
-            splitChild(i + 1, children[i + 1]);
+            // Si esta lleno, entonces es separado. Si la llave va despues de todas las del ultimo hijo del borde
+            //derecho del arbol se separa dejando casi lleno al hijo (ver splitChild)
+            bool append = right_edge && i + 1 == number_keys && k > children[i + 1]->keys[2 * degree - 2];
+            splitChild(i + 1, children[i + 1], append);
 
             /* Despues de seperarse, la llave central del hijo[i] sube y nos fijamos si la nueva llave (la que subio) es menor que el hijo, si asi fuera el caso entonces
              * tenemos que escoger la posicion que esta a la derecha de esta nueva llave para insertar el hijo   */
+            if (keys[i + 1] == k) {
+                revive(i + 1);
+                return; //la llave que subio es la que queriamos insertar
+            }
             if (keys[i + 1] < k)
                 i++;
         }
         //Recursivamente volvemos a realizar el mismo metodo sobre el hijo en el que deberiamos de insertar el nuevo valor. La razon por la que se esta insertando en el 
         //hijo i+1 es porque ya sabemos que el hijo i contiene valores que son todos menores a la llave i del nodo actual , por lo tanto si insertamos el nuevo valor en este
         //hijo estariamos rompiendo la regla de que todos los valores tienen que estar ordenados por valor
-        children[i + 1]->insertNonFull(k);
+        ownChild(i + 1)->insertNonFull(k, right_edge && i + 1 == number_keys);
     }
 }
 
@@ -159,7 +526,8 @@ void BTreeNode::insertNonFull(int k) {
  * '*y'  es un puntero al nodo que queremos partir. Este DEBE de ser hijo del nodo mediante el cual se llama esta funcion 
  * 
  */
-void BTreeNode::splitChild(int i, BTreeNode *y) {
+void BTreeNode::splitChild(int i, BTreeNode *y, bool append) {
+    TREE_COUNT(BT_SPLITS, 1);
 
     /*Situacion inicial:
      *              <nodo actual>
@@ -170,27 +538,59 @@ void BTreeNode::splitChild(int i, BTreeNode *y) {
 
     //Nuevo nodo va a tener el mismo grado que el nodo 'y' y tambien el mismo valor de si es hora o no
     //este nodo 'z' va a simbolizar, despues de partir el nodo, la primera mitad de valores.
-    BTreeNode *z = new BTreeNode(y->degree, y->leaf);
-
-    z->number_keys = degree - 1; //el nuevo numero de llaves que va a tener este nodo va a ser de 'grado-1'
-    //(donde grado es el grado del nodo actual) [grado-1 es el minimo valor permitido] 
-
-    //Se copian las llaves desde el nodo 'y' al nodo 'z' . Se copian solamente la SEGUNDA mitad de las llaves - 1. Sabemos que este
+    BTreeNode *z = new (y->arena) BTreeNode(y->degree, y->leaf, y->arena);
+
+    /* 'keep' es la cantidad de llaves que se quedan en 'y'; la llave en esa posicion sube. Normalmente
+     'y' se queda con grado-1 llaves (la mitad). Si se esta agregando al final del borde derecho
+     (llaves crecientes) no va a llegar nada mas a 'y', asi que se queda casi lleno: una hoja le deja
+     a 'z' solo la llave nueva y un nodo interno le deja una llave (un nodo interno sin llaves no
+     podria llenarse despues con fill) */
+    int keep = degree - 1;
+    if (append)
+        keep = y->leaf ? 2 * degree - 2 : 2 * degree - 3;
+    z->number_keys = 2 * degree - 2 - keep;
+
+    //Se copian las llaves desde el nodo 'y' al nodo 'z' . Se copian solamente las llaves despues de la que sube. Sabemos que este
     //nodo tiene 2*grado-1 llaves (porque sino no habria razon para partirlo)
-    for (int j = 0; j < degree - 1; j++)
-        z->keys[j] = y->keys[j + degree];
+    for (int j = 0; j < z->number_keys; j++)
+        z->keys[j] = y->keys[j + keep + 1];
 
 
-    //si 'y' no es una hoja entonces copiamos los hijos de 'y' a 'z'. Se copian solamente la SEGUNDA mitad de los hijos
+    //si 'y' no es una hoja entonces copiamos los hijos de 'y' a 'z'. Se copian solamente los hijos despues de la llave que sube
     if (y->leaf == false) {
-        for (int j = 0; j < degree; j++)
-            z->children[j] = y->children[j + degree];
+        for (int j = 0; j <= z->number_keys; j++)
+            z->children[j] = y->children[j + keep + 1];
+    } else if (expanded_leaves != NULL)
+        expanded_leaves->push_back(z); //La nueva hoja se comprime al final de la operacion
+
+    //Los mensajes pendientes se reparten igual que las llaves: los mayores a la llave media van a 'z'
+    //y el de la llave media sube con ella a este nodo
+    if (!y->buffer.empty()) {
+        int middle = y->keys[keep];
+        std::vector<TreeMessage>::iterator it = std::lower_bound(y->buffer.begin(), y->buffer.end(), middle, messageBefore);
+        std::vector<TreeMessage>::iterator from = it;
+        if (from != y->buffer.end() && from->key == middle) {
+            putMessage(*from, false);
+            ++from;
+        }
+        z->buffer.assign(from, y->buffer.end());
+        y->buffer.erase(it, y->buffer.end());
     }
 
-    //Ahora el numero de llaves en Y es igual a grado-1 ... Esto quiere decir que 'y' ahora 'tiene'  (realmente los punteros todavia estan en el arreglo de punteros
+    //Las marcas de llaves eliminadas se van con sus llaves: las de 'z', la de la llave que sube y las de este nodo se corren
+    if (y->dead != NULL || dead != NULL) {
+        for (int j = 0; j < z->number_keys; j++)
+            z->setDead(j, y->isDead(j + keep + 1));
+        for (int j = number_keys - 1; j >= i; j--)
+            setDead(j + 1, isDead(j));
+        setDead(i, y->isDead(keep));
+        for (int j = keep; j < 2 * degree - 1; j++)
+            y->setDead(j, false);
+    }
+
+    //Ahora el numero de llaves en Y es igual a 'keep' ... Esto quiere decir que 'y' ahora 'tiene'  (realmente los punteros todavia estan en el arreglo de punteros
     // pero no se van a tomar en cuenta ya que el numero de llaves dice que no existen y pueden volver a ser usados libremente cuando se necesiten)
-    //la minima cantidad permitida de hijos para un nodo que no es raiz
-    y->number_keys = degree - 1;
+    y->number_keys = keep;
 
 
     /*Tenemos que hacerle espacio al nuevo hijo (z)  a insertar, por lo tanto corremos todas los hijos (en el nodo actual)
@@ -209,17 +609,49 @@ void BTreeNode::splitChild(int i, BTreeNode *y) {
         keys[j + 1] = keys[j];
 
 
-    //Copiamos la llave media del nodo 'y' al nodo actual. la llave media siempre se encuentra en la posicion [grado-1]ya que
-    //el maximo de llaves permitidas es de 2*grado-1 y si estamos partiendo este nodo entonces sabemos que esa es la cantidad
-    //llaves que 'tiene' (En este momento de ejecucion 'y' solo tiene la primera mitad del total maximo de llaves, la segunda 
-    //mitad la tiene 'z'). Lo que hace esta instruccion es subir el puntero (que apunta al valor medio del nodo que partimos)
-    //al arreglo de llaves del nodo actual. Hay que recordar de que 'y' es hijo del nodo actual
-    keys[i] = y->keys[degree - 1];
+    //Copiamos la llave que sube del nodo 'y' al nodo actual. Esa llave se encuentra en la posicion [keep] (en una division normal
+    //es la llave media, [grado-1]). En este momento de ejecucion 'y' solo tiene las llaves antes de ella y las de despues
+    //las tiene 'z'. Hay que recordar de que 'y' es hijo del nodo actual
+    keys[i] = y->keys[keep];
 
     //Incrementamos la cantidad de llaves en este nodo 
     number_keys = number_keys + 1;
 }
 
+int BTreeNode::keyIndex(int k) const {
+    int lo = 0, hi = number_keys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (keyAt(mid) < k)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < number_keys && keyAt(lo) == k) ? lo : -1;
+}
+
+void BTreeNode::setDead(int i, bool value) {
+    unsigned long long bit = 1ULL << (i & 63);
+    if (!value) {
+        if (dead == NULL)
+            return;
+        dead[i >> 6] &= ~bit;
+        for (int w = 0; w < deadWords(degree); w++) {
+            if (dead[w] != 0)
+                return;
+        }
+        NodeArena::deallocateIn(arena, dead, deadWords(degree) * sizeof (unsigned long long));
+        dead = NULL;
+        return;
+    }
+    if (dead == NULL) {
+        dead = (unsigned long long*) NodeArena::allocateIn(arena, deadWords(degree) * sizeof (unsigned long long));
+        for (int w = 0; w < deadWords(degree); w++)
+            dead[w] = 0;
+    }
+    dead[i >> 6] |= bit;
+}
+
 /* Retorna el indice de la primera llave que sea >=k. La busqueda de esta llave se realiza en el arreglo 
  * de llaves que tiene el nodo mediante el cual se invoca este metodo */
 int BTreeNode::findKey(int k) {
@@ -248,7 +680,8 @@ void BTreeNode::remove(int k) {
 
         //Si es hoja, la llave no esta en este arbol
         if (leaf) {
-            cout << "The key " << k << " does not exist in the tree\n";
+            if (report_missing)
+                cout << "The key " << k << " does not exist in the tree\n";
             return;
         }
 
@@ -257,15 +690,15 @@ void BTreeNode::remove(int k) {
         bool flag = ((idx == number_keys) ? true : false);
 
         // Si el hijo donde se supone que esta la llave tiene llaves de grado menor, llenamos ese hijo
-        if (children[idx]->number_keys < degree)
+        if (ownChild(idx)->number_keys < degree)
             fill(idx);
 
         /* Si el ultimo hijo se ha unido, se debio haber unido con el hijo previo y asi hacemos recursion con el  hijo en idx-1
          Si no, se realiza recursion con el hijo en idx que ahora debe tener por lo menos una cantidad de llaves igual a grado*/
         if (flag && idx > number_keys)
-            children[idx - 1]->remove(k);
+            ownChild(idx - 1)->remove(k);
         else
-            children[idx]->remove(k);
+            ownChild(idx)->remove(k);
     }
     return;
 }
@@ -296,18 +729,18 @@ void BTreeNode::removeFromNonLeaf(int idx) {
     if (children[idx]->number_keys >= degree) {
         int pred = getPred(idx);
         keys[idx] = pred;
-        children[idx]->remove(pred);
+        ownChild(idx)->remove(pred);
     }        /* Si el hijo[idx] tiene menos llaves de grado, examina hijo[idx+1]. Si este tiene por lo menos
      hijos de grado, encontrar el sucesor 'succ' de k en el subarbol arraigo en hijo [idx+1]*/
     else if (children[idx + 1]->number_keys >= degree) {
         int succ = getSucc(idx);
         keys[idx] = succ;
-        children[idx + 1]->remove(succ);
+        ownChild(idx + 1)->remove(succ);
     }        /* Si ambos hijos[idx] y [idx+1] tienen menos llaves de grado, unir k y todos los hijos [idx+1] con hijos[idx]. 
      Ahora hijos[idx] contienen 2t-1 llaves. Liberar hijos[idx+1] y eliminar recursivamente k de hijos[idx] */
     else {
         merge(idx);
-        children[idx]->remove(k);
+        ownChild(idx)->remove(k);
     }
     return;
 }
@@ -321,7 +754,7 @@ int BTreeNode::getPred(int idx) {
         cur = cur->children[cur->number_keys];
 
     //Retorna la ultima llave de la hoja
-    return cur->keys[cur->number_keys - 1];
+    return cur->keyAt(cur->number_keys - 1);
 }
 
 int BTreeNode::getSucc(int idx) {
@@ -332,7 +765,7 @@ int BTreeNode::getSucc(int idx) {
         cur = cur->children[0];
 
     //Retorna la primera llave de la hoja
-    return cur->keys[0];
+    return cur->keyAt(0);
 }
 
 /* Este metodo el hijo, lo llena con hijos[idx] que tienen una cantidad menor de grado-1 llaves */
@@ -359,9 +792,10 @@ void BTreeNode::fill(int idx) {
 
 /* Se toma una llave de hijo[idx-1] y se inserta en hijo    [idx] */
 void BTreeNode::borrowFromPrev(int idx) {
+    TREE_COUNT(BT_BORROWS, 1);
 
-    BTreeNode *child = children[idx]; //puntero que apunta al hijo presente en idx
-    BTreeNode *sibling = children[idx - 1]; //puntero que apunta al hijo presente en idx-1, que seria hermano de 'child'
+    BTreeNode *child = ownChild(idx); //puntero que apunta al hijo presente en idx
+    BTreeNode *sibling = ownChild(idx - 1); //puntero que apunta al hijo presente en idx-1, que seria hermano de 'child'
 
     //La ultima llave de hijos[idx-1] va hasta el padre y llave[idx-1] del padre se inserta
     //como la primera llave en hijos[idx]. Por ello, el hermano pierde una llave y el hijo gana una.
@@ -379,13 +813,25 @@ void BTreeNode::borrowFromPrev(int idx) {
     //Settear primera llave  del hijo 'child' igual a llaves[idx-1] del nodo actual
     child->keys[0] = keys[idx - 1];
 
-    //Si el nodo actual no es una hoja entonces movemos el ultimo hijo del hermano como el primer hijo de hijo[idx]
-    if (!leaf)
+    //Si el hijo no es una hoja entonces movemos el ultimo hijo del hermano como el primer hijo de hijo[idx]
+    if (!child->leaf)
         child->children[0] = sibling->children[sibling->number_keys];
 
     //Mover la llave del hermano al padre. Esto reduce las llaves del hermano
     keys[idx - 1] = sibling->keys[sibling->number_keys - 1];
 
+    //Los mensajes del hijo que se movio pasan al buffer de 'child' y el de la llave que subio, al padre
+    if (!sibling->buffer.empty()) {
+        std::vector<TreeMessage>::iterator it = std::lower_bound(sibling->buffer.begin(), sibling->buffer.end(), keys[idx - 1], messageBefore);
+        std::vector<TreeMessage>::iterator from = it;
+        if (from != sibling->buffer.end() && from->key == keys[idx - 1]) {
+            putMessage(*from, false);
+            ++from;
+        }
+        child->buffer.insert(child->buffer.begin(), from, sibling->buffer.end());
+        sibling->buffer.erase(it, sibling->buffer.end());
+    }
+
     child->number_keys += 1;
     sibling->number_keys -= 1;
 
@@ -395,9 +841,10 @@ void BTreeNode::borrowFromPrev(int idx) {
 //Se presta una llave de hijos[idx+1] y lo pone en hijos[idx]
 
 void BTreeNode::borrowFromNext(int idx) {
+    TREE_COUNT(BT_BORROWS, 1);
 
-    BTreeNode *child = children[idx];
-    BTreeNode *sibling = children[idx + 1];
+    BTreeNode *child = ownChild(idx);
+    BTreeNode *sibling = ownChild(idx + 1);
 
     //llaves[idx] se inserta en la ultima llave de hijos[idx]
     child->keys[(child->number_keys)] = keys[idx];
@@ -409,6 +856,18 @@ void BTreeNode::borrowFromNext(int idx) {
     //La primera llave del hermano se inserta en llaves[idx]
     keys[idx] = sibling->keys[0];
 
+    //Los mensajes del hijo que se movio pasan al buffer de 'child' y el de la llave que subio, al padre
+    if (!sibling->buffer.empty()) {
+        std::vector<TreeMessage>::iterator it = std::lower_bound(sibling->buffer.begin(), sibling->buffer.end(), keys[idx], messageBefore);
+        child->buffer.insert(child->buffer.end(), sibling->buffer.begin(), it);
+        std::vector<TreeMessage>::iterator to = it;
+        if (to != sibling->buffer.end() && to->key == keys[idx]) {
+            putMessage(*to, false);
+            ++to;
+        }
+        sibling->buffer.erase(sibling->buffer.begin(), to);
+    }
+
     //Mover todas la llaves en el hermano un paso atras
     for (int i = 1; i < sibling->number_keys; ++i)
         sibling->keys[i - 1] = sibling->keys[i];
@@ -430,22 +889,27 @@ void BTreeNode::borrowFromNext(int idx) {
 //Une hijos[idx] con hijos[idx+1]. Hijos[idx+1] se libera despues de unirse
 
 void BTreeNode::merge(int idx) {
-    BTreeNode *child = children[idx];
-    BTreeNode *sibling = children[idx + 1];
+    TREE_COUNT(BT_MERGES, 1);
+    BTreeNode *child = ownChild(idx);
+    BTreeNode *sibling = children[idx + 1]; //El hermano solo se lee, no hace falta copiarlo
 
-    //Sacar una llave del nodo presente e insertarla la posicion(grado-1) de hijos[idx]
-    child->keys[degree - 1] = keys[idx];
+    //Sacar una llave del nodo presente e insertarla despues de las llaves de hijos[idx]
+    //(normalmente hijos[idx] tiene grado-1 llaves, asi que va en la posicion grado-1)
+    int n = child->number_keys;
+    child->keys[n] = keys[idx];
 
-    //Copiar las llaves de hijos[idx+1] a hijos[idx] al final
-    for (int i = 0; i < sibling->number_keys; ++i)
-        child->keys[i + degree] = sibling->keys[i];
+    //Copiar las llaves de hijos[idx+1] a hijos[idx] al final (el hermano puede estar comprimido)
+    sibling->decode(0, sibling->number_keys, child->keys + n + 1);
 
     //Copiar los punters hijos de hijos[idx+1] a hijos[idx]
     if (!child->leaf) {
         for (int i = 0; i <= sibling->number_keys; ++i)
-            child->children[i + degree] = sibling->children[i];
+            child->children[i + n + 1] = sibling->children[i];
     }
 
+    //Los mensajes del hermano son todos mayores que los de hijos[idx]
+    child->buffer.insert(child->buffer.end(), sibling->buffer.begin(), sibling->buffer.end());
+
     //Mover todas las llaves despues de idx en el nodo actual un paso antes
     //para llenar el espacio creado por mover llaves[idx] a hijos[idx]
     for (int i = idx + 1; i < number_keys; ++i)
@@ -459,18 +923,768 @@ void BTreeNode::merge(int idx) {
     child->number_keys += sibling->number_keys + 1;
     number_keys--;
 
-    //Liberar la memoria ocupado por el hermano
-    delete(sibling);
+    //Liberar la memoria ocupado por el hermano. Si un snapshot todavia lo usa, sus hijos ahora
+    //tienen un padre mas (child) y solo se suelta nuestra referencia al hermano
+    if (sibling->ref_count.load(std::memory_order_acquire) == 1) {
+        forgetExpanded(sibling);
+        delete(sibling);
+    } else {
+        if (!child->leaf) {
+            for (int i = 0; i <= sibling->number_keys; ++i)
+                sibling->children[i]->ref_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        release(sibling);
+    }
     return;
 }
 
+/*
+ * Pone las llaves (y los hijos, si no es hoja) en este nodo y en los nodos nuevos que hagan falta,
+ * todos del mismo tamano: con n llaves se usan ceil((n+1)/(2*grado)) nodos, asi cada uno queda
+ * con entre grado-1 y 2*grado-1 llaves. La llave que separa cada nodo nuevo del anterior va a
+ * 'extra' junto con el nodo, para que el padre los enlace.
+ */
+void BTreeNode::spread(const std::vector<int>& all_keys, const std::vector<BTreeNode*>& all_children,
+        std::vector<std::pair<int, BTreeNode*> >& extra, int min_pieces) {
+    int total = (int) all_keys.size();
+    int pieces = (total + 2 * degree) / (2 * degree);
+    if (pieces < min_pieces && total >= 2 * min_pieces - 1)
+        pieces = min_pieces;
+    int payload = total - (pieces - 1); // Llaves sin contar las separadoras
+    int pos = 0;
+    for (int p = 0; p < pieces; p++) {
+        BTreeNode *node = this;
+        if (p > 0) {
+            node = new (arena) BTreeNode(degree, leaf, arena);
+            if (leaf && expanded_leaves != NULL)
+                expanded_leaves->push_back(node);
+            extra.push_back(std::make_pair(all_keys[pos], node));
+            pos++;
+        }
+        int count = payload / pieces + (p < payload % pieces ? 1 : 0);
+        for (int j = 0; j < count; j++)
+            node->keys[j] = all_keys[pos + j];
+        if (!leaf) {
+            for (int j = 0; j <= count; j++)
+                node->children[j] = all_children[pos + j];
+        }
+        node->number_keys = count;
+        pos += count;
+    }
+}
+
+/*
+ * Cada hijo recibe de una vez todas las llaves de su rango. Si algun hijo se tuvo que repartir
+ * en varios nodos, este nodo se arma de nuevo con todas las llaves y los hijos y se reparte una
+ * sola vez.
+ */
+void BTreeNode::insertSorted(const int *first, const int *last, std::vector<std::pair<int, BTreeNode*> >& extra) {
+    if (leaf) {
+        //Las hojas no tienen recursion debajo, asi que pueden compartir el arreglo de la mezcla
+        static thread_local std::vector<int> merged;
+        merged.clear();
+        int i = 0;
+        while (i < number_keys || first < last) {
+            if (first == last || (i < number_keys && keys[i] < *first))
+                merged.push_back(keys[i++]);
+            else {
+                if (i < number_keys && keys[i] == *first)
+                    i++; // Ya estaba
+                merged.push_back(*first++);
+            }
+        }
+        if ((int) merged.size() <= 2 * degree - 1) {
+            std::copy(merged.begin(), merged.end(), keys);
+            number_keys = (int) merged.size();
+        } else
+            spread(merged, std::vector<BTreeNode*>(), extra);
+        return;
+    }
+
+    std::vector<std::pair<int, BTreeNode*> > below; // Nodos nuevos de los hijos
+    std::vector<int> owner; // Hijo del que salio cada nodo de 'below'
+    for (int i = 0; i <= number_keys; i++) {
+        const int *end = first;
+        while (end < last && (i == number_keys || *end < keys[i]))
+            end++;
+        if (end > first) {
+            ownChild(i)->insertSorted(first, end, below);
+            owner.resize(below.size(), i);
+        }
+        first = end;
+        if (i < number_keys && first < last && *first == keys[i])
+            first++; // Ya estaba
+    }
+    if (below.empty())
+        return;
+
+    std::vector<int> all_keys;
+    std::vector<BTreeNode*> all_children;
+    size_t b = 0;
+    for (int i = 0; i <= number_keys; i++) {
+        all_children.push_back(children[i]);
+        for (; b < below.size() && owner[b] == i; b++) {
+            all_keys.push_back(below[b].first);
+            all_children.push_back(below[b].second);
+        }
+        if (i < number_keys)
+            all_keys.push_back(keys[i]);
+    }
+    spread(all_keys, all_children, extra);
+}
+
+/*
+ * Cada hijo recibe de una vez las llaves de su rango y despues se arreglan los hijos que
+ * quedaron con menos de grado-1 llaves. Las llaves de este nodo que hay que eliminar se dejan
+ * en 'internal': reemplazarlas por su predecesor obligaria a bajar otra vez al subarbol.
+ */
+void BTreeNode::removeSorted(const int *first, const int *last, std::vector<int>& internal) {
+    if (leaf) {
+        int kept = 0;
+        for (int i = 0; i < number_keys; i++) {
+            while (first < last && *first < keys[i])
+                first++;
+            if (first < last && *first == keys[i])
+                continue;
+            keys[kept++] = keys[i];
+        }
+        number_keys = kept;
+        return;
+    }
+
+    for (int i = 0; i <= number_keys; i++) {
+        const int *end = first;
+        while (end < last && (i == number_keys || *end < keys[i]))
+            end++;
+        if (end > first)
+            ownChild(i)->removeSorted(first, end, internal);
+        first = end;
+        if (i < number_keys && first < last && *first == keys[i])
+            internal.push_back(*first++);
+    }
+    rebalanceChildren();
+}
+
+/*
+ * Los hijos que estan completamente dentro del rango se sueltan enteros, sin visitarlos. Solo
+ * se baja por los dos hijos de los bordes (o por uno si el rango cae dentro de un solo hijo).
+ * La ultima llave del rango en este nodo se queda como separadora entre esos dos hijos y va a
+ * 'internal' para eliminarla al final, igual que en removeSorted.
+ */
+void BTreeNode::removeRange(int lo, int hi, std::vector<int>& internal) {
+    int first = 0; // Primera llave >= lo
+    while (first < number_keys && keys[first] < lo)
+        first++;
+    int end = first; // Primera llave > hi
+    while (end < number_keys && keys[end] <= hi)
+        end++;
+
+    if (leaf) {
+        for (int i = end; i < number_keys; i++)
+            keys[first + i - end] = keys[i];
+        number_keys -= end - first;
+        return;
+    }
+
+    bool split = end > first; // El rango tiene llaves de este nodo: hay dos hijos de borde
+    if (split) {
+        for (int i = first + 1; i < end; i++)
+            release(children[i]);
+        internal.push_back(keys[end - 1]);
+        keys[first] = keys[end - 1];
+        children[first + 1] = children[end];
+        int gone = end - 1 - first;
+        for (int i = first + 1; i + gone < number_keys; i++) {
+            keys[i] = keys[i + gone];
+            children[i + 1] = children[i + 1 + gone];
+        }
+        number_keys -= gone;
+    }
+
+    ownChild(first)->removeRange(lo, hi, internal);
+    if (split)
+        ownChild(first + 1)->removeRange(lo, hi, internal);
+    rebalanceChildren();
+}
+
+/* De abajo hacia arriba, para que un merge en un nivel no deje con pocas llaves a un nodo ya revisado */
+void BTreeNode::fixRightEdge() {
+    if (leaf)
+        return;
+    ownChild(number_keys)->fixRightEdge();
+    while (number_keys > 0 && children[number_keys]->number_keys < degree - 1)
+        rebalance(number_keys - 1);
+}
+
+/* Arregla los hijos que quedaron con menos de grado-1 llaves. Este nodo puede quedar sin llaves */
+void BTreeNode::rebalanceChildren() {
+    int i = 0;
+    while (i <= number_keys && number_keys > 0) {
+        if (children[i]->number_keys >= degree - 1)
+            i++;
+        else if (i < number_keys)
+            rebalance(i);
+        else
+            rebalance(--i);
+    }
+}
+
+/*
+ * Despues de eliminar un lote un hijo puede haber perdido muchas llaves, asi que no alcanza con
+ * prestarse una: los dos hijos se unen con merge si caben en un nodo y si no se reparten las
+ * llaves por la mitad.
+ */
+void BTreeNode::rebalance(int idx) {
+    BTreeNode *left = ownChild(idx);
+    BTreeNode *right = ownChild(idx + 1);
+    int total = left->number_keys + 1 + right->number_keys;
+    if (total <= 2 * degree - 1) {
+        merge(idx);
+        //Un hijo que se quedo sin llaves trae a su unico hijo sin arreglar (ver rebalanceChildren)
+        if (!left->leaf)
+            left->rebalanceChildren();
+        return;
+    }
+
+    std::vector<int> all_keys(left->keys, left->keys + left->number_keys);
+    all_keys.push_back(keys[idx]);
+    all_keys.insert(all_keys.end(), right->keys, right->keys + right->number_keys);
+    std::vector<BTreeNode*> all_children;
+    if (!left->leaf) {
+        all_children.assign(left->children, left->children + left->number_keys + 1);
+        all_children.insert(all_children.end(), right->children, right->children + right->number_keys + 1);
+    }
+
+    int half = total / 2;
+    std::copy(all_keys.begin(), all_keys.begin() + half, left->keys);
+    keys[idx] = all_keys[half];
+    std::copy(all_keys.begin() + half + 1, all_keys.end(), right->keys);
+    if (!left->leaf) {
+        std::copy(all_children.begin(), all_children.begin() + half + 1, left->children);
+        std::copy(all_children.begin() + half + 1, all_children.end(), right->children);
+    }
+    left->number_keys = half;
+    right->number_keys = total - half - 1;
+
+    //Con buffers los mensajes siguen a su rango; el de la llave que subio queda en este nodo
+    if (!left->buffer.empty() || !right->buffer.empty()) {
+        std::vector<TreeMessage> messages(left->buffer);
+        messages.insert(messages.end(), right->buffer.begin(), right->buffer.end());
+        left->buffer.clear();
+        right->buffer.clear();
+        for (size_t i = 0; i < messages.size(); i++) {
+            if (messages[i].key < keys[idx])
+                left->buffer.push_back(messages[i]);
+            else if (messages[i].key > keys[idx])
+                right->buffer.push_back(messages[i]);
+            else
+                putMessage(messages[i], false);
+        }
+    }
+    if (!left->leaf) {
+        left->rebalanceChildren();
+        right->rebalanceChildren();
+    }
+}
+
+/*
+ * Los hijos viejos se reemplazan por nodos nuevos: un snapshot puede seguir usando los viejos.
+ * Los nietos no cambian, solo cambian de padre. Los mensajes de los hijos pasan al hijo nuevo
+ * cuyo rango los contiene; el de una llave que subio a este nodo pasa a su buffer (es mas viejo
+ * que cualquier mensaje que ya tenga este nodo para esa llave).
+ */
+bool BTreeNode::repackChildren(int min_children) {
+    int total = number_keys;
+    for (int i = 0; i <= number_keys; i++)
+        total += children[i]->number_keys;
+    int pieces = (total + 2 * degree) / (2 * degree);
+    if (pieces < min_children && total >= 2 * min_children - 1)
+        pieces = min_children;
+    if (pieces >= number_keys + 1)
+        return false;
+
+    bool child_leaf = children[0]->leaf;
+    std::vector<int> all_keys(total);
+    std::vector<BTreeNode*> all_children;
+    std::vector<TreeMessage> messages;
+    int pos = 0;
+    for (int i = 0; i <= number_keys; i++) {
+        BTreeNode *child = children[i];
+        child->decode(0, child->number_keys, &all_keys[pos]);
+        pos += child->number_keys;
+        if (i < number_keys)
+            all_keys[pos++] = keys[i];
+        if (!child_leaf)
+            all_children.insert(all_children.end(), child->children, child->children + child->number_keys + 1);
+        messages.insert(messages.end(), child->buffer.begin(), child->buffer.end());
+    }
+
+    BTreeNode *first = new (arena) BTreeNode(degree, child_leaf, arena);
+    if (child_leaf && expanded_leaves != NULL)
+        expanded_leaves->push_back(first);
+    std::vector<std::pair<int, BTreeNode*> > extra;
+    first->spread(all_keys, all_children, extra, min_children);
+
+    for (int i = 0; i <= number_keys; i++) {
+        BTreeNode *old = children[i];
+        if (old->ref_count.load(std::memory_order_acquire) == 1) {
+            forgetExpanded(old);
+            delete old;
+        } else {
+            if (!old->leaf) {
+                for (int j = 0; j <= old->number_keys; j++)
+                    old->children[j]->ref_count.fetch_add(1, std::memory_order_relaxed);
+            }
+            release(old);
+        }
+    }
+
+    children[0] = first;
+    for (size_t i = 0; i < extra.size(); i++) {
+        keys[i] = extra[i].first;
+        children[i + 1] = extra[i].second;
+    }
+    number_keys = (int) extra.size();
+
+    //Los mensajes estan ordenados (los rangos de los hijos viejos no se enciman)
+    size_t c = 0;
+    for (size_t i = 0; i < messages.size(); i++) {
+        while (c < extra.size() && messages[i].key > keys[c])
+            c++;
+        if (c < extra.size() && messages[i].key == keys[c])
+            putMessage(messages[i], false);
+        else
+            children[c]->buffer.push_back(messages[i]);
+    }
+    return true;
+}
+
+int BTreeNode::findMessage(int k) const {
+    std::vector<TreeMessage>::const_iterator it = std::lower_bound(buffer.begin(), buffer.end(), k, messageBefore);
+    return (it != buffer.end() && it->key == k) ? (int) (it - buffer.begin()) : -1;
+}
+
+void BTreeNode::putMessage(const TreeMessage& m, bool newer) {
+    std::vector<TreeMessage>::iterator it = std::lower_bound(buffer.begin(), buffer.end(), m.key, messageBefore);
+    if (it != buffer.end() && it->key == m.key) {
+        if (newer)
+            *it = m;
+        return;
+    }
+    buffer.insert(it, m);
+}
+
+void BTreeNode::dropOlder(const TreeMessage *newer, size_t count) {
+    size_t kept = 0;
+    for (size_t i = 0; i < buffer.size(); i++) {
+        if (!std::binary_search(newer, newer + count, buffer[i], messageLess))
+            buffer[kept++] = buffer[i];
+    }
+    buffer.resize(kept);
+}
+
+/* Mezcla dos listas ordenadas. Si las dos tienen la misma llave gana la de 'batch' */
+void BTreeNode::addMessages(const TreeMessage *batch, size_t count) {
+    if (buffer.empty()) {
+        buffer.assign(batch, batch + count);
+        return;
+    }
+    static thread_local std::vector<TreeMessage> merged;
+    merged.clear();
+    size_t i = 0, j = 0;
+    while (i < buffer.size() || j < count) {
+        if (j == count || (i < buffer.size() && buffer[i].key < batch[j].key))
+            merged.push_back(buffer[i++]);
+        else {
+            if (i < buffer.size() && buffer[i].key == batch[j].key)
+                i++;
+            merged.push_back(batch[j++]);
+        }
+    }
+    buffer.swap(merged);
+}
+
+bool BTreeNode::hasMessages() const {
+    if (!buffer.empty())
+        return true;
+    if (!leaf) {
+        for (int i = 0; i <= number_keys; i++) {
+            if (children[i]->hasMessages())
+                return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Si hace falta llenar un hijo, fill() puede unirlo con un hermano y este nodo pierde una llave.
+ * Un nodo que no es raiz no puede quedar con menos de grado-1 llaves; la raiz puede quedar con 0
+ * (el arbol baja de altura).
+ */
+bool BTreeNode::canFill(int idx, bool is_root) {
+    if (idx != 0 && children[idx - 1]->number_keys >= degree)
+        return true;
+    if (idx != number_keys && children[idx + 1]->number_keys >= degree)
+        return true;
+    return number_keys >= (is_root ? 1 : degree);
+}
+
+void BTreeNode::liftMessages(int idx, int k, bool rightmost) {
+    std::vector<TreeMessage> lifted;
+    BTreeNode *cur = ownChild(idx);
+    while (!cur->leaf) {
+        std::vector<TreeMessage>::iterator it = std::lower_bound(cur->buffer.begin(), cur->buffer.end(), k, messageBefore);
+        if (rightmost) {
+            lifted.insert(lifted.end(), it, cur->buffer.end());
+            cur->buffer.erase(it, cur->buffer.end());
+        } else {
+            if (it != cur->buffer.end() && it->key == k)
+                ++it;
+            lifted.insert(lifted.end(), cur->buffer.begin(), it);
+            cur->buffer.erase(cur->buffer.begin(), it);
+        }
+        cur = cur->ownChild(rightmost ? cur->number_keys : 0);
+    }
+
+    //Se recorrio de arriba hacia abajo, asi que el primer mensaje de cada llave es el mas nuevo
+    for (size_t i = 0; i < lifted.size(); i++)
+        putMessage(lifted[i], false);
+}
+
+/*
+ * Un mensaje cuya llave esta en este nodo ya no puede bajar mas. Una insercion de una llave que
+ * ya existe no hace nada. Una eliminacion se hace como en removeFromNonLeaf: la llave se cambia
+ * por su predecesor o sucesor (ver liftMessages) o se unen los dos hijos y la llave baja con su
+ * mensaje al hijo unido.
+ */
+FlushStatus BTreeNode::applyLocal(bool is_root) {
+    //El buffer suele ser mucho mas grande que el nodo: se busca el mensaje de cada llave
+    int idx = 0;
+    while (idx < number_keys && !buffer.empty()) {
+        int m = findMessage(keys[idx]);
+        if (m < 0) {
+            idx++;
+            continue;
+        }
+        int k = keys[idx];
+        if (buffer[m].insert) {
+            buffer.erase(buffer.begin() + m);
+            idx++;
+            continue;
+        }
+
+        BTreeNode *left = ownChild(idx);
+        BTreeNode *right = ownChild(idx + 1);
+        if (left->number_keys >= degree) {
+            buffer.erase(buffer.begin() + m);
+            int pred = getPred(idx);
+            liftMessages(idx, pred, true);
+            keys[idx] = pred;
+            left->remove(pred);
+        } else if (right->number_keys >= degree) {
+            buffer.erase(buffer.begin() + m);
+            int succ = getSucc(idx);
+            liftMessages(idx + 1, succ, false);
+            keys[idx] = succ;
+            right->remove(succ);
+        } else {
+            if (number_keys < (is_root ? 1 : degree))
+                return FLUSH_THIN;
+            buffer.erase(buffer.begin() + m);
+            merge(idx);
+            BTreeNode *child = ownChild(idx);
+            TreeMessage removal = {k, false};
+            if (child->leaf)
+                child->removeFromLeaf(child->findKey(k));
+            else
+                child->putMessage(removal, true);
+            if (number_keys == 0)
+                return FLUSH_THIN;
+        }
+        //Las llaves y el buffer cambiaron, se vuelve a revisar desde el principio
+        idx = 0;
+    }
+    return FLUSH_DONE;
+}
+
+/*
+ * Los hijos son hojas: los mensajes se aplican uno por uno, separando una hoja llena antes de
+ * insertar y llenando una hoja con grado-1 llaves antes de eliminar (igual que insertNonFull y
+ * remove). Si este nodo no puede separar o unir mas hijos, los mensajes que faltan vuelven al buffer.
+ */
+FlushStatus BTreeNode::applyToLeaves(const TreeMessage *batch, size_t count, bool is_root) {
+    for (size_t b = 0; b < count; b++) {
+        const TreeMessage& m = batch[b];
+        int idx = findKey(m.key);
+
+        //La llave subio a este nodo al separar una hoja: se aplica con applyLocal
+        if (idx < number_keys && keys[idx] == m.key) {
+            putMessage(m, true);
+            continue;
+        }
+
+        BTreeNode *child = ownChild(idx);
+        int pos = child->findKey(m.key);
+        bool present = pos < child->number_keys && child->keys[pos] == m.key;
+        FlushStatus status = FLUSH_DONE;
+        if (m.insert && !present) {
+            if (child->number_keys < 2 * degree - 1)
+                child->insertNonFull(m.key);
+            else if (number_keys < 2 * degree - 1) {
+                splitChild(idx, child);
+                b--;
+            } else
+                status = FLUSH_FULL;
+        } else if (!m.insert && present) {
+            if (child->number_keys >= degree)
+                child->removeFromLeaf(pos);
+            else if (canFill(idx, is_root)) {
+                fill(idx);
+                b--;
+            } else
+                status = FLUSH_THIN;
+        }
+        if (status != FLUSH_DONE) {
+            addMessages(batch + b, count - b);
+            return status;
+        }
+    }
+    return FLUSH_DONE;
+}
+
+FlushStatus BTreeNode::fixChild(int idx, FlushStatus status, bool is_root) {
+    if (status == FLUSH_FULL) {
+        if (number_keys == 2 * degree - 1)
+            return FLUSH_FULL;
+        splitChild(idx, ownChild(idx));
+        return FLUSH_DONE;
+    }
+    if (!canFill(idx, is_root))
+        return FLUSH_THIN;
+    fill(idx);
+    return FLUSH_DONE;
+}
+
+/*
+ * Cuando el buffer se llena se reparte completo: los mensajes de cada hijo se le pasan juntos a
+ * su buffer (o a sus hojas) y ese hijo solo baja los suyos si su buffer tambien se lleno. Un
+ * recorrido del buffer alcanza para todos los hijos porque mensajes y llaves estan ordenados. Si
+ * un hijo se detiene porque necesita separarse o llenarse, este nodo lo arregla y sigue.
+ */
+FlushStatus BTreeNode::flush(int capacity, bool force, bool is_root) {
+    std::vector<TreeMessage> pending;
+    while (true) {
+        if (number_keys == 0)
+            return FLUSH_THIN;
+        FlushStatus status = applyLocal(is_root);
+        if (status != FLUSH_DONE)
+            return status;
+        if (buffer.empty() || (!force && (int) buffer.size() < capacity))
+            break;
+
+        pending.clear();
+        pending.swap(buffer);
+        size_t first = 0;
+        while (first < pending.size()) {
+            int idx = findKey(pending[first].key);
+
+            //La llave esta en este nodo (subio al separar un hijo): se aplica con applyLocal
+            if (idx < number_keys && keys[idx] == pending[first].key) {
+                putMessage(pending[first++], true);
+                continue;
+            }
+            size_t last = first;
+            while (last < pending.size() && (idx == number_keys || pending[last].key < keys[idx]))
+                last++;
+
+            BTreeNode *child = ownChild(idx);
+            if (child->leaf)
+                status = applyToLeaves(&pending[first], last - first, is_root);
+            else {
+                child->addMessages(&pending[first], last - first);
+                if (force || (int) child->buffer.size() >= capacity) {
+                    FlushStatus child_status = child->flush(capacity, force, false);
+                    if (child_status != FLUSH_DONE) {
+                        status = fixChild(idx, child_status, is_root);
+
+                        //Al prestar o separar pueden subir mensajes de llaves que todavia tienen
+                        //un mensaje mas nuevo en lo que falta de 'pending'
+                        if (status == FLUSH_DONE && last < pending.size())
+                            dropOlder(&pending[last], pending.size() - last);
+                    }
+                }
+            }
+            first = last;
+            if (status != FLUSH_DONE) {
+                addMessages(&pending[0] + first, pending.size() - first);
+                return status;
+            }
+        }
+    }
+    if (!force || children[0]->leaf)
+        return FLUSH_DONE;
+
+    //Vaciar tambien los hijos que todavia tienen mensajes (de vaciados anteriores que se detuvieron)
+    for (int i = 0; i <= number_keys; i++) {
+        if (!children[i]->hasMessages())
+            continue;
+        FlushStatus child_status = ownChild(i)->flush(capacity, true, false);
+        if (child_status == FLUSH_DONE)
+            continue;
+        FlushStatus status = fixChild(i, child_status, is_root);
+        if (status != FLUSH_DONE)
+            return status;
+
+        //El hijo se separo o se unio con un hermano: se revisa otra vez desde el hermano anterior
+        i = i > 0 ? i - 2 : -1;
+        status = applyLocal(is_root);
+        if (status != FLUSH_DONE)
+            return status;
+    }
+    return FLUSH_DONE;
+}
+
 void BigTree::remove(int k) {
     if (!root) {
-        cout << "El arbol esta vacio/no hay llaves";
+        if (report_missing)
+            cout << "El arbol esta vacio/no hay llaves";
+        return;
+    }
+    if (filter != NULL && !filter->mayContain(k))
+        return; // No esta: no hay nada que eliminar
+
+    // En modo perezoso la llave solo se marca (sigue contando en el filtro hasta que se purga)
+    if (max_tombstones > 0 && buffer_capacity == 0) {
+        expanded_leaves = compress_leaves ? &expanded : NULL;
+        if (markDead(k))
+            tombstones++;
+        else if (filter == NULL && report_missing)
+            cout << "The key " << k << " does not exist in the tree\n";
+        compressExpanded();
+        if (tombstones > max_tombstones)
+            purgeTombstones();
         return;
     }
 
+    if (filter != NULL) {
+        if (root->search(k) == NULL)
+            return;
+        filter->remove(k);
+    }
+    right_leaf = NULL;
+
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    ownRoot();
+
+    // Con buffers la eliminacion queda como mensaje en la raiz (si la raiz es hoja se elimina directo)
+    if (buffer_capacity > 0 && !root->leaf) {
+        TreeMessage m = {k, false};
+        root->putMessage(m, true);
+        if ((int) root->buffer.size() >= buffer_capacity)
+            flushRoot(false);
+    } else
+        removeKey(k);
+    compressExpanded();
+}
+
+void BigTree::erase(int k) {
+    report_missing = false;
+    remove(k);
+    report_missing = true;
+}
+
+/* Con buffers primero se aplican los mensajes, asi las llaves de los nodos son las del conjunto */
+bool BigTree::lowerBound(int k, int& out) {
+    flushAll();
+    return root != NULL && firstAtLeast(root, k, out);
+}
+
+/* Despues del primer hijo que se revisa, todos los demas tienen llaves > k: si no dan una llave es
+ * porque todas estan marcadas, asi que casi siempre se baja por un solo camino */
+bool BigTree::firstAtLeast(const BTreeNode *node, int k, int& out) {
+    int lo = 0, hi = node->number_keys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->keyAt(mid) < k)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (int i = lo; i <= node->number_keys; i++) {
+        if (!node->leaf && firstAtLeast(node->children[i], k, out))
+            return true;
+        if (i < node->number_keys && !node->isDead(i)) {
+            out = node->keyAt(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Baja copiando los nodos compartidos con snapshots (la marca no debe verse en ellos) */
+bool BigTree::markDead(int k) {
+    ownRoot();
+    BTreeNode *node = root;
+    while (true) {
+        int idx = node->findKey(k);
+        if (idx < node->number_keys && node->keys[idx] == k) {
+            if (node->isDead(idx))
+                return false;
+            node->setDead(idx, true);
+            return true;
+        }
+        if (node->leaf)
+            return false;
+        node = node->ownChild(idx);
+    }
+}
+
+/* Un nodo con marcas nunca esta compartido (snapshot() purga antes), asi que se modifica sin copiarlo */
+bool BTreeNode::revive(int i) {
+    if (!isDead(i))
+        return false;
+    setDead(i, false);
+    revived_keys++;
+    return true;
+}
+
+/* Marcas en orden: solo los nodos propios tienen marcas, asi que quitarlas no afecta a ningun snapshot */
+void BigTree::collectDead(BTreeNode *node, std::vector<int>& out) {
+    for (int i = 0; i <= node->number_keys; i++) {
+        if (!node->leaf)
+            collectDead(node->children[i], out);
+        if (i < node->number_keys && node->isDead(i)) {
+            out.push_back(node->keyAt(i));
+            node->setDead(i, false);
+        }
+    }
+}
+
+void BigTree::setLazyDelete(size_t _max_tombstones) {
+    max_tombstones = _max_tombstones;
+    if (max_tombstones == 0 || tombstones > max_tombstones)
+        purgeTombstones();
+}
+
+/*
+ * Un recorrido del arbol junta las llaves marcadas (y les quita la marca) y se eliminan con un
+ * solo removeBatch: cada nodo del camino se visita y se rebalancea una vez por purga y no una vez
+ * por llave. El recorrido cuesta lo mismo que unas pocas busquedas por cada nodo del arbol, asi que
+ * con un 'max_tombstones' de al menos un nodo por marca se paga poco por llave.
+ */
+void BigTree::purgeTombstones() {
+    if (tombstones == 0)
+        return;
+    std::vector<int> batch;
+    batch.reserve(tombstones);
+    collectDead(root, batch);
+    tombstones = 0;
+    removeBatch(batch);
+}
+
+void BigTree::removeKey(int k) {
     //Llama la funcion para eliminar en raiz
+    ownRoot();
     root->remove(k);
 
     //Si el nodo raiz tiene 0 llaves, hacer su primer hijo como nueva raiz si tiene un hijo. Si no, settear raiz como NULL
@@ -482,11 +1696,777 @@ void BigTree::remove(int k) {
             root = root->children[0];
 
         //Liberar la raiz vieja
+        forgetExpanded(tmp);
         delete tmp;
     }
     return;
 }
 
+/*
+ * Si la raiz se detiene por estar llena el arbol crece en altura, y si se quedo sin llaves baja
+ * de altura: sus mensajes pasan al hijo (o se aplican directo si el hijo es una hoja).
+ */
+void BigTree::flushRoot(bool force) {
+    while (root != NULL && !root->leaf) {
+        FlushStatus status = root->flush(buffer_capacity, force, true);
+        if (status == FLUSH_DONE)
+            return;
+        if (status == FLUSH_FULL) {
+            BTreeNode *new_node = new (arena) BTreeNode(tree_degree, false, arena);
+            new_node->children[0] = root;
+            new_node->splitChild(0, root);
+            root = new_node;
+            continue;
+        }
+
+        lowerRoot();
+    }
+}
+
+/* La raiz se quedo sin llaves: su unico hijo pasa a ser la raiz y recibe sus mensajes (si es una hoja se aplican directo) */
+void BigTree::lowerRoot() {
+    BTreeNode *old_root = root;
+    std::vector<TreeMessage> pending;
+    pending.swap(old_root->buffer);
+    root = old_root->ownChild(0);
+    delete old_root;
+    if (!root->leaf) {
+        if (!pending.empty())
+            root->addMessages(&pending[0], pending.size());
+        return;
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+        bool present = root != NULL && root->search(pending[i].key) != NULL;
+        if (pending[i].insert && !present)
+            insertKey(pending[i].key);
+        else if (!pending[i].insert && present)
+            removeKey(pending[i].key);
+    }
+}
+
+/*
+ * Sin buffers el lote ordenado baja por el arbol en un solo recorrido (ver insertSorted). Con
+ * buffers se agrega a la raiz como mensajes, que ya bajan por grupos.
+ */
+void BigTree::insertBatch(const std::vector<int>& batch) {
+    purgeTombstones();
+    std::vector<int> sorted(batch);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    if (filter != NULL)
+        keepForFilter(sorted, true);
+    if (sorted.empty())
+        return;
+
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    ownRoot();
+    right_leaf = NULL;
+    if (buffer_capacity > 0 && root != NULL && !root->leaf)
+        addToRoot(sorted, true);
+    else {
+        if (root == NULL) {
+            root = new (arena) BTreeNode(tree_degree, true, arena);
+            if (compress_leaves)
+                expanded.push_back(root);
+        }
+        std::vector<std::pair<int, BTreeNode*> > extra;
+        root->insertSorted(&sorted[0], &sorted[0] + sorted.size(), extra);
+        growRoot(extra);
+    }
+    compressExpanded();
+}
+
+void BigTree::growRoot(std::vector<std::pair<int, BTreeNode*> >& extra) {
+    //La raiz se repartio en varios nodos: el arbol crece uno o mas niveles
+    while (!extra.empty()) {
+        std::vector<int> all_keys;
+        std::vector<BTreeNode*> all_children(1, root);
+        for (size_t i = 0; i < extra.size(); i++) {
+            all_keys.push_back(extra[i].first);
+            all_children.push_back(extra[i].second);
+        }
+        extra.clear();
+        root = new (arena) BTreeNode(tree_degree, false, arena);
+        root->spread(all_keys, all_children, extra);
+    }
+}
+
+void BigTree::removeBatch(const std::vector<int>& batch) {
+    purgeTombstones();
+    std::vector<int> sorted(batch);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    if (filter != NULL && root != NULL)
+        keepForFilter(sorted, false);
+    if (sorted.empty() || root == NULL)
+        return;
+
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    ownRoot();
+    right_leaf = NULL;
+    if (buffer_capacity > 0 && !root->leaf)
+        addToRoot(sorted, false);
+    else {
+        std::vector<int> internal;
+        root->removeSorted(&sorted[0], &sorted[0] + sorted.size(), internal);
+        shrinkRoot(internal);
+    }
+    compressExpanded();
+}
+
+/*
+ * Con buffers primero se aplican todos los mensajes: asi no queda ningun mensaje del rango en los
+ * subarboles que se sueltan ni en los nodos de los bordes.
+ */
+void BigTree::removeRange(int lo, int hi) {
+    if (root == NULL || lo > hi)
+        return;
+    purgeTombstones();
+    flushAll();
+    if (filter != NULL) {
+        std::vector<int> gone;
+        collectRange(root, lo, hi, gone);
+        for (size_t i = 0; i < gone.size(); i++)
+            filter->remove(gone[i]);
+    }
+
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    ownRoot();
+    right_leaf = NULL;
+    std::vector<int> internal;
+    root->removeRange(lo, hi, internal);
+    shrinkRoot(internal);
+    compressExpanded();
+}
+
+/*
+ * Si los rangos de llaves no se enciman (y el grado es el mismo) los arboles se unen sin copiar
+ * llaves, ver join. Si no, se recorren los dos en orden, se mezclan y el resultado se construye
+ * de abajo hacia arriba, en O(n + m).
+ */
+void BigTree::merge(BigTree& other) {
+    if (&other == this || other.root == NULL)
+        return;
+    purgeTombstones();
+    other.purgeTombstones();
+    if (other.filter != NULL)
+        other.filter->clear(); // 'other' queda vacio
+    flushAll();
+    other.flushAll();
+    right_leaf = NULL;
+    other.right_leaf = NULL;
+
+    if (other.tree_degree == tree_degree) {
+        if (root == NULL) {
+            if (filter != NULL)
+                other.snapshot().forEach([this](int k) {
+                    filter->add(k);
+                });
+            root = other.root;
+            other.root = NULL;
+            return;
+        }
+        BigTree *left = NULL, *right = NULL;
+        if (maxKey(root) < minKey(other.root)) {
+            left = this;
+            right = &other;
+        } else if (maxKey(other.root) < minKey(root)) {
+            left = &other;
+            right = this;
+        }
+        if (left != NULL) {
+            //Todas las llaves de 'other' son nuevas
+            if (filter != NULL)
+                other.snapshot().forEach([this](int k) {
+                    filter->add(k);
+                });
+            int sep = maxKey(left->root);
+            expanded_leaves = left->compress_leaves ? &left->expanded : NULL;
+            left->removeKey(sep);
+            left->compressExpanded();
+            expanded_leaves = compress_leaves ? &expanded : NULL;
+            BTreeNode *left_root = left->root, *right_root = right->root;
+            other.root = NULL;
+            root = NULL;
+            join(left_root, sep, right_root);
+            compressExpanded();
+            return;
+        }
+    }
+
+    //Las llaves de este arbol se copian a un arreglo y las de 'other' se mezclan con ellas al recorrerlo
+    std::vector<int> mine, merged;
+    snapshot().forEach([&mine](int k) {
+        mine.push_back(k);
+    });
+    size_t i = 0;
+    other.snapshot().forEach([&](int k) {
+        while (i < mine.size() && mine[i] < k)
+            merged.push_back(mine[i++]);
+        if (i < mine.size() && mine[i] == k)
+            i++;
+        merged.push_back(k);
+    });
+    merged.insert(merged.end(), mine.begin() + i, mine.end());
+
+    BTreeNode::release(root);
+    BTreeNode::release(other.root);
+    root = NULL;
+    other.root = NULL;
+    build(merged);
+    if (filter != NULL) {
+        filter->clear();
+        for (size_t j = 0; j < merged.size(); j++)
+            filter->add(merged[j]);
+    }
+}
+
+void BigTree::useFilter(size_t expected_keys, double false_positive_rate, size_t max_bytes) {
+    delete filter;
+    filter = new CountingBloomFilter(expected_keys, false_positive_rate, max_bytes);
+    snapshot().forEach([this](int k) {
+        filter->add(k);
+    });
+}
+
+/*
+ * Corrutina sin valor de retorno que empieza suspendida: la avanza searchBatch. Cada co_await
+ * devuelve el control justo despues de un prefetch.
+ */
+struct BigTreeLookup {
+
+    struct promise_type {
+
+        BigTreeLookup get_return_object() {
+            return BigTreeLookup(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return std::suspend_always();
+        }
+
+        std::suspend_always final_suspend() noexcept {
+            return std::suspend_always();
+        }
+
+        void return_void() {
+        }
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    BigTreeLookup(std::coroutine_handle<promise_type> h) : handle(h) {
+    }
+};
+
+/* Prefetch de 'bytes' bytes desde 'p', una linea de cache a la vez */
+static inline void prefetchBytes(const void *p, size_t bytes) {
+    const char *c = (const char*) p;
+    for (size_t off = 0; off < bytes; off += 64)
+        __builtin_prefetch(c + off);
+}
+
+/*
+ * Un nodo son tres bloques de memoria separados (el nodo, sus llaves y sus hijos), asi que cada
+ * nivel se espera dos veces: primero el nodo y despues, ya con los punteros, las llaves y los
+ * hijos. Un trabajador sigue con la siguiente llave de la cola al terminar una, asi solo hay
+ * 'group' corrutinas por lote y no una por llave.
+ */
+BigTreeLookup BigTree::lookupWorker(const int *keys, bool *found, size_t count, size_t *next) {
+    while (*next < count) {
+        size_t idx = (*next)++;
+        int k = keys[idx];
+        found[idx] = false;
+        if (filter != NULL) {
+            filter->prefetch(k);
+            co_await std::suspend_always();
+            if (!filter->mayContain(k))
+                continue;
+        }
+
+        const BTreeNode *node = root;
+        while (node != NULL) {
+            __builtin_prefetch(node);
+            co_await std::suspend_always();
+            if (node->packed != NULL)
+                prefetchBytes(node->packed, packedWords(node->number_keys, node->width) * sizeof (unsigned int));
+            else {
+                prefetchBytes(node->keys, node->number_keys * sizeof (int));
+                if (!node->leaf)
+                    prefetchBytes(node->children, (node->number_keys + 1) * sizeof (BTreeNode*));
+            }
+            co_await std::suspend_always();
+
+            if (!node->buffer.empty()) {
+                int m = node->findMessage(k);
+                if (m >= 0) {
+                    found[idx] = node->buffer[m].insert;
+                    break;
+                }
+            }
+            int lo = 0, hi = node->number_keys; // Primera llave >= k
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (node->keyAt(mid) < k)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo < node->number_keys && node->keyAt(lo) == k) {
+                found[idx] = !node->isDead(lo);
+                break;
+            }
+            node = node->leaf ? NULL : node->children[lo];
+        }
+    }
+}
+
+void BigTree::searchBatch(const int *keys, size_t count, bool *found, int group) {
+    if (group < 1)
+        group = 1;
+    size_t next = 0;
+    std::vector<BigTreeLookup> workers;
+    for (int i = 0; i < group && (size_t) i < count; i++)
+        workers.push_back(lookupWorker(keys, found, count, &next));
+
+    //Round-robin: cada vuelta avanza a cada trabajador hasta su siguiente prefetch
+    bool running = true;
+    while (running) {
+        running = false;
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (!workers[i].handle.done()) {
+                workers[i].handle.resume();
+                running = true;
+            }
+        }
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].handle.destroy();
+}
+
+BigTreeStats BigTree::stats() const {
+    BigTreeStats result;
+    for (int i = 0; i < 10; i++)
+        result.occupancy[i] = 0;
+    result.nodes = 0;
+    result.keys = 0;
+    result.max_keys = 2 * tree_degree - 1;
+    result.messages = 0;
+    result.tombstones = tombstones;
+    result.bytes = memoryBytes();
+    if (root != NULL)
+        collectStats(root, 0, true, result);
+    return result;
+}
+
+void BigTree::collectStats(const BTreeNode *node, size_t level, bool is_root, BigTreeStats& stats) {
+    if (stats.nodes_per_level.size() <= level) {
+        stats.nodes_per_level.push_back(0);
+        stats.keys_per_level.push_back(0);
+    }
+    stats.nodes_per_level[level]++;
+    stats.keys_per_level[level] += node->number_keys;
+    stats.nodes++;
+    stats.keys += node->number_keys;
+    stats.messages += node->buffer.size();
+    if (!is_root) {
+        size_t decile = node->number_keys * 10 / stats.max_keys;
+        stats.occupancy[decile < 10 ? decile : 9]++;
+    }
+    if (!node->leaf) {
+        for (int i = 0; i <= node->number_keys; i++)
+            collectStats(node->children[i], level + 1, false, stats);
+    }
+}
+
+/*
+ * Una pasada repaca los hijos de todos los nodos de altura 1 (los padres de las hojas), de
+ * izquierda a derecha, despues los de altura 2 y asi hasta la raiz. Lo que falta de la pasada se
+ * guarda como una altura y una llave ('compact_from'): el siguiente paso baja desde la raiz hasta
+ * el nodo de esa altura que contiene a la llave, asi no se guardan punteros a nodos que pudieron
+ * cambiar entre llamadas.
+ *
+ * Un nodo que se queda con pocos hijos se une (o reparte) con su hermano como al eliminar. Si se
+ * unio con el hermano de la derecha se vuelve a revisar, porque ahora tiene los hijos de los dos:
+ * asi una zona con muchos nodos casi vacios termina con pocos nodos llenos.
+ */
+bool BigTree::compact(size_t max_nodes) {
+    purgeTombstones();
+    right_leaf = NULL;
+    if (root == NULL || root->leaf) {
+        compact_height = 0;
+        return true;
+    }
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    ownRoot();
+    if (compact_height == 0) {
+        compact_height = 1;
+        compact_from = LLONG_MIN;
+    }
+
+    size_t visited = 0;
+    bool done = false;
+    std::vector<std::pair<BTreeNode*, int> > path; // Nodo y el hijo por el que se bajo
+    while (!done && (max_nodes == 0 || visited < max_nodes)) {
+        int h = height(root);
+        if (compact_height > h) {
+            compact_height = 0;
+            done = true;
+            break;
+        }
+
+        BTreeNode *node = root;
+        bool bounded = false;
+        long long bound = 0;
+        path.clear();
+        for (int level = h; level > compact_height; level--) {
+            int i = 0;
+            while (i < node->number_keys && node->keys[i] <= compact_from)
+                i++;
+            if (i < node->number_keys) {
+                bounded = true;
+                bound = node->keys[i];
+            }
+            path.push_back(std::make_pair(node, i));
+            node = node->ownChild(i);
+        }
+        visited++;
+
+        //La raiz se queda con al menos dos hijos (una llave), los demas nodos se arreglan en su padre
+        bool again = false;
+        if (node->repackChildren(node == root ? 2 : 1)) {
+            for (int j = (int) path.size() - 1; j >= 0; j--) {
+                BTreeNode *parent = path[j].first;
+                int idx = path[j].second;
+                if (parent->children[idx]->number_keys >= tree_degree - 1)
+                    break;
+                int before = parent->number_keys;
+                parent->rebalance(idx < parent->number_keys ? idx : idx - 1);
+                if (j == (int) path.size() - 1 && idx < before && parent->number_keys < before)
+                    again = true;
+            }
+            while (root->number_keys == 0 && !root->leaf)
+                lowerRoot();
+        }
+        if (again)
+            continue;
+        if (bounded)
+            compact_from = bound;
+        else {
+            compact_height++;
+            compact_from = LLONG_MIN;
+        }
+    }
+    compressExpanded();
+    return done;
+}
+
+void BigTree::collectRange(const BTreeNode *node, int lo, int hi, std::vector<int>& out) {
+    int i = 0;
+    while (i < node->number_keys && node->keyAt(i) < lo)
+        i++;
+    for (; i <= node->number_keys; i++) {
+        if (!node->leaf)
+            collectRange(node->children[i], lo, hi, out);
+        if (i == node->number_keys || node->keyAt(i) > hi)
+            return;
+        out.push_back(node->keyAt(i));
+    }
+}
+
+/*
+ * Une 'left' y 'right' (todas las llaves de 'left' son menores que 'sep' y todas las de 'right'
+ * mayores). El mas bajo se cuelga del borde derecho (o izquierdo) del mas alto, en el nivel donde
+ * queda a la misma altura que sus hermanos, con 'sep' como separadora. Al bajar por ese borde se
+ * separan los nodos llenos como en insertNonFull, asi siempre hay lugar para 'sep'. Cuesta
+ * O(altura): no se copia ninguna llave salvo las del nodo que se cuelga, si quedo con pocas.
+ */
+void BigTree::join(BTreeNode *left, int sep, BTreeNode *right) {
+    if (left == NULL || right == NULL) {
+        root = left != NULL ? left : right;
+        insertKey(sep);
+        return;
+    }
+
+    //El borde derecho de 'left' puede tener nodos con pocas llaves (ver splitChild) y va a quedar en medio
+    root = left;
+    ownRoot();
+    root->fixRightEdge();
+    shrinkRoot(std::vector<int>());
+    left = root;
+
+    int left_height = height(left), right_height = height(right);
+    if (left_height == right_height) {
+        root = new (arena) BTreeNode(tree_degree, false, arena);
+        root->keys[0] = sep;
+        root->children[0] = left;
+        root->children[1] = right;
+        root->number_keys = 1;
+        if (left->number_keys < tree_degree - 1 || right->number_keys < tree_degree - 1)
+            root->rebalance(0);
+        shrinkRoot(std::vector<int>());
+        return;
+    }
+
+    bool into_left = left_height > right_height; // El mas bajo se cuelga del borde derecho de 'left'
+    root = into_left ? left : right;
+    BTreeNode *shorter = into_left ? right : left;
+    int h = into_left ? left_height : right_height;
+    int target = (into_left ? right_height : left_height) + 1;
+    ownRoot();
+    if (root->number_keys == 2 * tree_degree - 1) {
+        BTreeNode *new_node = new (arena) BTreeNode(tree_degree, false, arena);
+        new_node->children[0] = root;
+        new_node->splitChild(0, root);
+        root = new_node;
+        h++;
+    }
+
+    BTreeNode *node = root;
+    for (; h > target; h--) {
+        int i = into_left ? node->number_keys : 0;
+        if (node->children[i]->number_keys == 2 * tree_degree - 1) {
+            node->splitChild(i, node->ownChild(i));
+            if (into_left)
+                i++;
+        }
+        node = node->ownChild(i);
+    }
+
+    int n = node->number_keys;
+    if (into_left) {
+        node->keys[n] = sep;
+        node->children[n + 1] = right;
+    } else {
+        for (int i = n; i > 0; i--)
+            node->keys[i] = node->keys[i - 1];
+        for (int i = n + 1; i > 0; i--)
+            node->children[i] = node->children[i - 1];
+        node->keys[0] = sep;
+        node->children[0] = left;
+    }
+    node->number_keys++;
+    if (shorter->number_keys < tree_degree - 1)
+        node->rebalance(into_left ? n : 0);
+}
+
+/* Construye el arbol de abajo hacia arriba: las hojas se reparten con spread y cada nivel se arma con las separadoras del nivel de abajo */
+void BigTree::build(const std::vector<int>& sorted) {
+    if (sorted.empty())
+        return;
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    root = new (arena) BTreeNode(tree_degree, true, arena);
+    if (compress_leaves)
+        expanded.push_back(root);
+    std::vector<std::pair<int, BTreeNode*> > extra;
+    root->spread(sorted, std::vector<BTreeNode*>(), extra);
+    growRoot(extra);
+    compressExpanded();
+}
+
+/*
+ * Mismo reparto que spread (nodos llenos, las llaves que sobran repartidas entre los primeros), pero
+ * la posicion de cada nodo en el nivel se calcula directo, asi cada hilo arma su parte del nivel sin
+ * esperar a los demas. Cada nivel deja las llaves separadoras y los nodos para armar el de arriba
+ */
+void BigTree::bulkLoad(const std::vector<int>& sorted, int threads) {
+    BTreeNode::release(root);
+    root = NULL;
+    right_leaf = NULL;
+    tombstones = 0;
+    compact_height = 0;
+    compact_from = 0;
+    if (filter != NULL) {
+        filter->clear();
+        for (size_t i = 0; i < sorted.size(); i++)
+            filter->add(sorted[i]);
+    }
+    if (sorted.empty())
+        return;
+
+    const int *level_keys = &sorted[0];
+    size_t total = sorted.size();
+    bool leaf = true;
+    std::vector<BTreeNode*> children, nodes;
+    std::vector<int> upper_keys, separators;
+    while (true) {
+        size_t pieces = (total + 2 * tree_degree) / (2 * tree_degree);
+        size_t payload = total - (pieces - 1), per = payload / pieces, rest = payload % pieces;
+        nodes.assign(pieces, NULL);
+        separators.resize(pieces - 1);
+        int parts = parallelParts(pieces, threads, PARALLEL_BUILD_NODES);
+        parallelFor(parts, pieces, [&](int, size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++) {
+                size_t first = p * (per + 1) + std::min(p, rest); // Despues de la separadora del nodo
+                int count = (int) (per + (p < rest ? 1 : 0));
+                if (p > 0)
+                    separators[p - 1] = level_keys[first - 1];
+                BTreeNode *node = new (arena) BTreeNode(tree_degree, leaf, arena);
+                std::copy(level_keys + first, level_keys + first + count, node->keys);
+                if (!leaf)
+                    std::copy(&children[first], &children[first] + count + 1, node->children);
+                node->number_keys = count;
+                if (leaf && compress_leaves)
+                    node->compress();
+                nodes[p] = node;
+            }
+        });
+        if (pieces == 1)
+            break;
+        upper_keys.swap(separators);
+        level_keys = &upper_keys[0];
+        total = upper_keys.size();
+        children.swap(nodes);
+        leaf = false;
+    }
+    root = nodes[0];
+}
+
+int BigTree::height(const BTreeNode *node) {
+    int h = 0;
+    for (; !node->leaf; h++)
+        node = node->children[0];
+    return h;
+}
+
+int BigTree::minKey(const BTreeNode *node) {
+    while (!node->leaf)
+        node = node->children[0];
+    return node->keyAt(0);
+}
+
+int BigTree::maxKey(const BTreeNode *node) {
+    while (!node->leaf)
+        node = node->children[node->number_keys];
+    return node->keyAt(node->number_keys - 1);
+}
+
+void BigTree::shrinkRoot(const std::vector<int>& internal) {
+    //La raiz se puede quedar sin llaves (incluso varias veces si se vacio todo el arbol)
+    while (root != NULL && root->number_keys == 0) {
+        BTreeNode *tmp = root;
+        root = root->leaf ? NULL : root->children[0];
+        forgetExpanded(tmp);
+        delete tmp;
+    }
+    for (size_t i = 0; i < internal.size(); i++)
+        removeKey(internal[i]);
+}
+
+/*
+ * Deja en el lote solo las llaves que cambian el arbol (las nuevas al insertar, las que estan al
+ * eliminar) y las cuenta en el filtro. Las que el filtro descarta no se buscan.
+ */
+void BigTree::keepForFilter(std::vector<int>& sorted, bool insert) {
+    size_t kept = 0;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        int k = sorted[i];
+        bool present = root != NULL && filter->mayContain(k) && root->search(k) != NULL;
+        if (present == insert)
+            continue;
+        if (insert)
+            filter->add(k);
+        else
+            filter->remove(k);
+        sorted[kept++] = k;
+    }
+    sorted.resize(kept);
+}
+
+void BigTree::addToRoot(const std::vector<int>& sorted, bool insert) {
+    std::vector<TreeMessage> messages(sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+        messages[i].key = sorted[i];
+        messages[i].insert = insert;
+    }
+    root->addMessages(&messages[0], messages.size());
+    if ((int) root->buffer.size() >= buffer_capacity)
+        flushRoot(false);
+}
+
+void BigTree::flushAll() {
+    if (buffer_capacity == 0 || root == NULL)
+        return;
+    expanded_leaves = compress_leaves ? &expanded : NULL;
+    ownRoot();
+
+    //Reemplazar una llave por su predecesor (applyLocal) puede subir un mensaje a un nodo que ya se
+    //vacio, asi que se repite hasta que no quede ninguno
+    do
+        flushRoot(true);
+    while (root != NULL && root->hasMessages());
+    compressExpanded();
+}
+
+void BigTree::compressExpanded() {
+    for (size_t i = 0; i < expanded.size(); i++)
+        expanded[i]->compress();
+    expanded.clear();
+    expanded_leaves = NULL;
+}
+
+/* Si la raiz la comparte un snapshot, el arbol pasa a usar una copia (los hijos siguen compartidos) */
+void BigTree::ownRoot() {
+    if (root != NULL && root->ref_count.load(std::memory_order_acquire) > 1) {
+        BTreeNode *copy = root->clone();
+        BTreeNode::release(root);
+        root = copy;
+    }
+    if (root != NULL && root->packed != NULL) {
+        root->expand();
+        expanded.push_back(root);
+    }
+}
+
+BigTreeSnapshot BigTree::snapshot() {
+    purgeTombstones(); //Los snapshots no ven marcas: un nodo compartido nunca tiene marcas
+    flushAll();
+    right_leaf = NULL; //La hoja ahora es compartida: el camino rapido no puede escribir en ella
+    if (root != NULL)
+        root->ref_count.fetch_add(1, std::memory_order_relaxed);
+    return BigTreeSnapshot(root);
+}
+
+/* El snapshot se queda con la referencia a la raiz que ya se sumo */
+BigTreeSnapshot::BigTreeSnapshot(BTreeNode *_root) {
+    root = _root;
+}
+
+BigTreeSnapshot::BigTreeSnapshot(const BigTreeSnapshot& other) {
+    root = other.root;
+    if (root != NULL)
+        root->ref_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+BigTreeSnapshot& BigTreeSnapshot::operator=(const BigTreeSnapshot& other) {
+    if (other.root != NULL)
+        other.root->ref_count.fetch_add(1, std::memory_order_relaxed);
+    BTreeNode::release(root);
+    root = other.root;
+    return *this;
+}
+
+BigTreeSnapshot::~BigTreeSnapshot() {
+    BTreeNode::release(root);
+}
+
+bool BigTreeSnapshot::search(int k) const {
+    const BTreeNode *node = root;
+    while (node != NULL) {
+        int i = 0;
+        while (i < node->number_keys && k > node->keyAt(i))
+            i++;
+        if (i < node->number_keys && node->keyAt(i) == k)
+            return true;
+        node = node->leaf ? NULL : node->children[i];
+    }
+    return false;
+}
+
 void BigTree::BigMenu() {
     using namespace std;
     BigTree bigT(3); //Creater B-Tree grado 3
@@ -7,6 +7,12 @@ Properties of Big-Tree
     1) All leaves are at same level.
     2) A Big-Tree is defined by the term minimum degree ‘t’..
     3) Every node except root must contain at least t-1 keys. Root may contain minimum 1 key.
+       Relaxed on the right edge: when keys are appended past the largest key, a full child on the
+       right edge is split leaving it almost full (2t-2 keys in a leaf, 2t-3 in an internal node) and
+       the new right sibling starts with a single key (see BTreeNode::splitChild). So the last child
+       of a node on the right edge may have anywhere from 1 to t-2 keys; every other node keeps the t-1
+       minimum. Removal does not depend on the minimum, since fill() brings a child up to t keys before
+       descending into it whatever its current count.
     4) All nodes (including root) may contain at MOST  2t – 1 keys.
     5) Number of children of a node is equal to the number of keys in it plus 1.
     6) All keys of a node are sorted in increasing order. The child between two keys k1 and k2 contains all keys in range from k1 and k2
@@ -16,8 +22,30 @@ Source [http://www.geeksforgeeks.org/b-tree-set-1-introduction-2/]
  * 
  */
 #include<iostream>
+#include<atomic>
+#include<vector>
+#include<utility>
+#include<new>
+#include "CountingBloomFilter.h"
+#include "NodeArena.h"
+#include "TreeCounters.h"
 using namespace std;
 
+struct BigTreeLookup; // Corrutina de busqueda (ver BigTree::searchBatch)
+
+/* Insercion o eliminacion pendiente en el buffer de un nodo interno (modo con buffers) */
+struct TreeMessage {
+    int key;
+    bool insert; // true: insertar 'key', false: eliminarla
+};
+
+/* Resultado de vaciar el buffer de un nodo */
+enum FlushStatus {
+    FLUSH_DONE, // Termino
+    FLUSH_FULL, // Se detuvo porque el nodo esta lleno y tiene que separar un hijo: el padre debe separarlo
+    FLUSH_THIN // Se detuvo porque el nodo tiene que unir dos hijos y quedaria con pocas llaves: el padre debe llenarlo
+};
+
 /* Clase que va a representar a un nodo del arbol */
 class BTreeNode {
     
@@ -27,9 +55,95 @@ private:
     BTreeNode ** children; // Un arreglo de punters hacia los nodos hijos
     int number_keys; //numero actual de numeros (keys)  que se encuentran en el nodo
     bool leaf; // Es un nodo hoja o no
-    
+    std::atomic<int> ref_count; // Cuantos padres (o raices de arbol/snapshot) apuntan a este nodo
+
+    /* Hoja comprimida (frame-of-reference): cada llave se guarda como (llave - base) en 'width'
+     bits. Mientras la hoja esta comprimida 'keys' y 'children' son NULL. Solo se comprimen
+     hojas de arboles creados con compress_leaves */
+    unsigned int * packed; // Llaves empacadas (NULL si la hoja no esta comprimida)
+    int base; // Llave menor de la hoja
+    int width; // Bits por llave
+
+    /* Mensajes pendientes para el subarbol de este nodo, ordenados por llave y con a lo sumo uno
+     por llave. Un mensaje en un nodo es siempre mas nuevo que uno para la misma llave mas abajo.
+     Solo los nodos internos de arboles con buffer_capacity > 0 tienen mensajes */
+    std::vector<TreeMessage> buffer;
+
+    /* Arena de donde salen el nodo y sus arreglos (NULL: heap normal). Los nodos nuevos que crea
+     este nodo (al separar, repartir, copiar) salen del mismo arena */
+    NodeArena *arena;
+
+    /* Llaves eliminadas en modo perezoso (ver BigTree::setLazyDelete): el bit i marca la llave i
+     como borrada aunque sigue en el nodo. NULL mientras el nodo no tenga marcas */
+    unsigned long long *dead;
+
+    // Pide y libera los arreglos 'keys' y 'children' (del arena del nodo)
+    void newArrays();
+    void freeArrays();
+
 public:
-    BTreeNode(int _t, bool _leaf); // Constructor
+    BTreeNode(int _t, bool _leaf, NodeArena *_arena = NULL); // Constructor
+    ~BTreeNode();
+
+    /* 'new (arena) BTreeNode(...)' crea el nodo en el arena. 'delete nodo' lo devuelve a donde
+     salio (el operador lee el arena del nodo antes de destruirlo) */
+    static void *operator new(size_t bytes) {
+        return ::operator new(bytes);
+    }
+    static void *operator new(size_t bytes, NodeArena *arena) {
+        return NodeArena::allocateIn(arena, bytes);
+    }
+    static void operator delete(void *p, NodeArena *arena) {
+        NodeArena::deallocateIn(arena, p, sizeof (BTreeNode));
+    }
+    static void operator delete(BTreeNode *node, std::destroying_delete_t) {
+        NodeArena *arena = node->arena;
+        node->~BTreeNode();
+        NodeArena::deallocateIn(arena, node, sizeof (BTreeNode));
+    }
+
+    //Copia del nodo que comparte los hijos con el original (los hijos ganan una referencia)
+    BTreeNode *clone();
+
+    //Quita una referencia al nodo. Si era la ultima se libera el nodo y se sueltan sus hijos
+    static void release(BTreeNode *node);
+
+    /* Retorna el hijo idx asegurando que solo este nodo lo usa: si un snapshot tambien lo
+     comparte se reemplaza por una copia. Este nodo ya tiene que ser exclusivo */
+    BTreeNode *ownChild(int idx);
+
+    //Empaca las llaves de la hoja y libera los arreglos 'keys' y 'children'
+    void compress();
+
+    //Vuelve a poner las llaves de una hoja comprimida en 'keys' para poder modificarla
+    void expand();
+
+    //Llave en la posicion i, este o no comprimida la hoja
+    int keyAt(int i) const;
+
+    //Posicion de la llave k en este nodo (busqueda binaria) o -1 si no esta
+    int keyIndex(int k) const;
+
+    bool isDead(int i) const {
+        return dead != NULL && ((dead[i >> 6] >> (i & 63)) & 1);
+    }
+
+    //Marca o desmarca la llave i como eliminada. Al quitar la ultima marca se libera el mapa de bits
+    void setDead(int i, bool value);
+
+    //Quita la marca de la llave i si la tenia (la llave se volvio a insertar). Retorna true si la tenia
+    bool revive(int i);
+
+    //La llave k esta en este nodo marcada como eliminada
+    bool deadKey(int k) const {
+        return dead != NULL && isDead(keyIndex(k));
+    }
+
+    //Copia 'count' llaves desde la posicion 'first' a 'out'
+    void decode(int first, int count, int *out) const;
+
+    //Memoria usada por el subarbol arraigado en este nodo
+    size_t memoryBytes() const;
 
     // funcion para recorrer todos los nodos en un subarbol (imprime el arbol a la pantalla)
     void traverse();
@@ -41,12 +155,14 @@ public:
     int findKey(int k);
 
     /* Una funcion para insertar una nueva llave en el subarbol arraigado con este nodo.
-     Se asume que el nodo no esta lleno cuando se llama la funcion*/
-    void insertNonFull(int k);
+     Se asume que el nodo no esta lleno cuando se llama la funcion. 'right_edge' indica que
+     el nodo esta en el borde derecho del arbol (el camino de la llave mayor)*/
+    void insertNonFull(int k, bool right_edge = false);
 
     //Funcion para separar el hijo y de este nodo. i es el indice de y en el
-    //array hijo C[]. El hijo c debe estar lleno cuando se llame esta funcion
-    void splitChild(int i, BTreeNode *y);
+    //array hijo C[]. El hijo c debe estar lleno cuando se llame esta funcion.
+    //Con 'append' (la llave nueva va despues de todas las de y) y se queda casi lleno
+    void splitChild(int i, BTreeNode *y, bool append = false);
 
     //Remueve la llave k en el subarbol arraigado en este nodo
     void remove(int k);
@@ -76,44 +192,394 @@ public:
     //Une el idx-hijo del nodo con el idx+1 hijo del nodo
     void merge(int idx);
 
+    //Indice del mensaje para la llave k en el buffer, o -1 si no hay
+    int findMessage(int k) const;
+
+    //Agrega un mensaje al buffer. Si ya hay uno para la misma llave, se queda con el mas nuevo
+    void putMessage(const TreeMessage& m, bool newer);
+
+    //Agrega mensajes ordenados, mas nuevos que los del buffer
+    void addMessages(const TreeMessage *batch, size_t count);
+
+    //True si este nodo o algun descendiente tiene mensajes pendientes
+    bool hasMessages() const;
+
+    /* Baja los mensajes del buffer a los hijos. Sin 'force' solo lo hace si el buffer tiene al
+     menos 'capacity' mensajes. Con 'force' vacia todos los buffers del subarbol */
+    FlushStatus flush(int capacity, bool force, bool is_root);
+
+    //Aplica los mensajes del buffer cuya llave esta en este nodo
+    FlushStatus applyLocal(bool is_root);
+
+    //Aplica mensajes a los hijos de este nodo, que son hojas
+    FlushStatus applyToLeaves(const TreeMessage *batch, size_t count, bool is_root);
+
+    //Separa o llena el hijo idx despues de que se detuvo con 'status'
+    FlushStatus fixChild(int idx, FlushStatus status, bool is_root);
+
+    //True si fill(idx) no deja a este nodo con menos llaves de las permitidas
+    bool canFill(int idx, bool is_root);
+
+    /* La llave k va a subir a este nodo desde el camino mas a la derecha (o mas a la izquierda)
+     del hijo idx. Los mensajes de ese camino para llaves >= k (o <= k) quedarian fuera del rango
+     del hijo, asi que suben a este nodo */
+    void liftMessages(int idx, int k, bool rightmost);
+
+    //Quita del buffer los mensajes de las llaves que tienen un mensaje mas nuevo en 'newer' (ordenado)
+    void dropOlder(const TreeMessage *newer, size_t count);
+
+    /* Inserta las llaves ordenadas [first, last) en el subarbol. Si el nodo no alcanza se reparte
+     en varios: los nodos nuevos, con la llave que los separa del anterior, quedan en 'extra' */
+    void insertSorted(const int *first, const int *last, std::vector<std::pair<int, BTreeNode*> >& extra);
+
+    /* Elimina las llaves ordenadas [first, last) del subarbol. El nodo puede quedar con menos de
+     grado-1 llaves (el padre lo arregla). Las llaves que estan en nodos internos quedan en 'internal' */
+    void removeSorted(const int *first, const int *last, std::vector<int>& internal);
+
+    //Reparte llaves e hijos entre este nodo y los nodos nuevos que hagan falta (al menos 'min_pieces' nodos)
+    void spread(const std::vector<int>& all_keys, const std::vector<BTreeNode*>& all_children,
+            std::vector<std::pair<int, BTreeNode*> >& extra, int min_pieces = 1);
+
+    /* Vuelve a repartir las llaves de los hijos en la menor cantidad de nodos posible, pero en al
+     menos 'min_children'. Este nodo puede quedar con menos llaves de las permitidas (el padre lo
+     arregla). Retorna false si los hijos ya estaban llenos y no se toco nada */
+    bool repackChildren(int min_children);
+
+    /* Elimina del subarbol las llaves en [lo, hi], soltando de una vez los hijos que estan completos
+     dentro del rango. Igual que removeSorted, las llaves que quedan como separadoras van a 'internal' */
+    void removeRange(int lo, int hi, std::vector<int>& internal);
+
+    //Une los hijos idx e idx+1 o, si no caben en un nodo, reparte sus llaves por la mitad
+    void rebalance(int idx);
+
+    //Llama a rebalance hasta que ningun hijo tenga menos de grado-1 llaves
+    void rebalanceChildren();
+
+    //Arregla los nodos con menos de grado-1 llaves del camino mas a la derecha del subarbol
+    void fixRightEdge();
+
     //Friendear el BTree para accesar las funciones privadas de esta clase
     friend class BigTree;
+    friend class BigTreeSnapshot;
+};
+
+/* Ocupacion de los nodos del arbol (ver BigTree::stats) */
+struct BigTreeStats {
+    std::vector<size_t> nodes_per_level; // El nivel 0 es la raiz
+    std::vector<size_t> keys_per_level;
+    size_t occupancy[10]; // Nodos (sin contar la raiz) por decil de llenado: llaves / (2*grado-1)
+    size_t nodes;
+    size_t keys;
+    size_t max_keys; // Llaves por nodo lleno (2*grado-1)
+    size_t messages; // Mensajes pendientes en los buffers
+    size_t tombstones; // Llaves marcadas como eliminadas (cuentan en 'keys')
+    size_t bytes;
+
+    // Fraccion de los lugares para llaves que estan usados
+    double fillFactor() const {
+        return nodes == 0 ? 0 : (double) keys / ((double) nodes * max_keys);
+    }
+
+    double bytesPerKey() const {
+        return keys == 0 ? 0 : (double) bytes / keys;
+    }
+};
+
+/*
+ * Vista de solo lectura del arbol en el momento en que se llamo BigTree::snapshot().
+ *
+ * Crear un snapshot es O(1): solo se suma una referencia a la raiz. Los nodos son copy-on-write,
+ * el arbol copia un nodo compartido antes de modificarlo (y solo ese camino de la raiz hacia
+ * abajo), asi el snapshot sigue viendo los nodos viejos sin que se detengan las escrituras.
+ * Cada nodo lleva la cuenta de quien lo usa y se libera cuando nadie mas lo necesita.
+ *
+ * snapshot() tiene que llamarse desde el hilo que escribe en el arbol (o con el mismo candado),
+ * pero el snapshot se puede leer y destruir desde cualquier otro hilo.
+ */
+class BigTreeSnapshot {
+private:
+    BTreeNode *root;
+
+    template<class Visitor>
+    static void visit(const BTreeNode *node, Visitor& visitor) {
+        //Hojas comprimidas: se desempacan por bloques. Las llaves marcadas como eliminadas (solo en
+        //el arbol, un snapshot no tiene marcas) se saltan
+        if (node->packed != NULL) {
+            int buffer[64];
+            for (int first = 0; first < node->number_keys; first += 64) {
+                int count = node->number_keys - first < 64 ? node->number_keys - first : 64;
+                node->decode(first, count, buffer);
+                for (int i = 0; i < count; i++) {
+                    if (!node->isDead(first + i))
+                        visitor(buffer[i]);
+                }
+            }
+            return;
+        }
+        int i;
+        for (i = 0; i < node->number_keys; i++) {
+            if (!node->leaf)
+                visit(node->children[i], visitor);
+            if (!node->isDead(i))
+                visitor(node->keys[i]);
+        }
+        if (!node->leaf)
+            visit(node->children[i], visitor);
+    }
+
+public:
+    BigTreeSnapshot(BTreeNode *_root);
+    BigTreeSnapshot(const BigTreeSnapshot& other);
+    BigTreeSnapshot& operator=(const BigTreeSnapshot& other);
+    ~BigTreeSnapshot();
+
+    // Retorna true si la llave estaba en el arbol cuando se tomo el snapshot
+    bool search(int k) const;
+
+    void traverse() const {
+        if (root != NULL) root->traverse();
+    }
+
+    // Llama a visitor(llave) para cada llave, de menor a mayor
+    template<class Visitor>
+    void forEach(Visitor visitor) const {
+        if (root != NULL) visit(root, visitor);
+    }
+
+    friend class BigTree;
 };
 
 class BigTree {
  private:
     BTreeNode *root; // Puntero a la raiz
     int tree_degree; // Grado minimo
+    bool compress_leaves; // Las hojas se guardan comprimidas
+    NodeArena *arena; // De donde salen los nodos (NULL: heap normal)
+    int buffer_capacity; // Mensajes por nodo interno antes de bajarlos (0: sin buffers)
+    std::vector<BTreeNode*> expanded; // Hojas descomprimidas durante la operacion actual
+
+    /* Hoja mas a la derecha, para agregar llaves crecientes sin bajar por el arbol (NULL si hay que
+     volver a buscarla). Las llaves menores o iguales a 'right_floor' no llegan a esa hoja. Solo se
+     usa sin buffers ni hojas comprimidas */
+    BTreeNode *right_leaf;
+    int right_floor;
+    bool has_floor;
+
+    //Busca la hoja mas a la derecha y la llave que la separa de su hermano izquierdo
+    void findRightLeaf();
+
+    // Filtro de las llaves del arbol para no bajar en las busquedas que fallan (NULL: sin filtro)
+    CountingBloomFilter *filter;
+
+    // Eliminacion perezosa (ver setLazyDelete): maximo de marcas (0: modo apagado) y marcas que hay en el arbol
+    size_t max_tombstones;
+    size_t tombstones;
+
+    // Marca la llave como eliminada sin cambiar la forma del arbol. Retorna false si no estaba
+    bool markDead(int k);
+
+    // Agrega a 'out' las llaves marcadas del subarbol, de menor a mayor, y les quita la marca
+    static void collectDead(BTreeNode *node, std::vector<int>& out);
+
+    // Compactacion en curso (ver compact): altura de los nodos cuyos hijos se repacan (0: ninguna) y desde que llave
+    int compact_height;
+    long long compact_from;
+
+    static void collectStats(const BTreeNode *node, size_t level, bool is_root, BigTreeStats& stats);
+
+    // Menor llave del subarbol >= k que no este marcada como eliminada
+    static bool firstAtLeast(const BTreeNode *node, int k, int& out);
+
+    // Agrega a 'out' las llaves del subarbol que estan en [lo, hi]
+    static void collectRange(const BTreeNode *node, int lo, int hi, std::vector<int>& out);
+
+    // Busca las llaves keys[*next], keys[*next+1], ... hasta 'count', deteniendose en cada acceso a memoria
+    BigTreeLookup lookupWorker(const int *keys, bool *found, size_t count, size_t *next);
+
+    //Vuelve a comprimir las hojas que se descomprimieron para modificarlas
+    void compressExpanded();
+
+    // Insercion y eliminacion directas, sin buffers
+    void insertKey(int k);
+    void removeKey(int k);
+
+    // Baja mensajes desde la raiz, cambiando la altura del arbol cuando hace falta
+    void flushRoot(bool force);
+    void lowerRoot();
+
+    //Asegura que la raiz no este compartida con un snapshot antes de modificar el arbol
+    void ownRoot();
+
+    // Quita del lote las llaves que no cambian el arbol y actualiza el filtro
+    void keepForFilter(std::vector<int>& sorted, bool insert);
+
+    // Agrega un lote ordenado como mensajes al buffer de la raiz
+    void addToRoot(const std::vector<int>& sorted, bool insert);
+
+    // Quita las raices sin llaves y despues elimina las llaves que quedaron en nodos internos
+    void shrinkRoot(const std::vector<int>& internal);
+
+    // Agrega niveles arriba de la raiz hasta que no queden nodos nuevos en 'extra' (ver spread)
+    void growRoot(std::vector<std::pair<int, BTreeNode*> >& extra);
+
+    // Arma el arbol (vacio) con llaves ordenadas y sin repetir, de las hojas hacia la raiz
+    void build(const std::vector<int>& sorted);
+
+    // Une dos subarboles cuyas llaves estan separadas por 'sep' y deja el resultado en la raiz
+    void join(BTreeNode *left, int sep, BTreeNode *right);
+
+    static const size_t PARALLEL_BUILD_NODES = 1024; // Nodos de un nivel por hilo en bulkLoad (como minimo)
+
+    static int height(const BTreeNode *node);
+    static int minKey(const BTreeNode *node);
+    static int maxKey(const BTreeNode *node);
+
+    BigTree(const BigTree&);
+    BigTree& operator=(const BigTree&);
 
 public:
    static void BigMenu();
 
     // Constructor
 
-    BigTree(int _degree) {
+    /* Si 'compress_leaves' es true las hojas guardan sus llaves comprimidas. Conviene con llaves
+     cercanas entre si y un grado grande: cada hoja ocupa varias veces menos memoria.
+
+     Si 'buffer_capacity' es mayor que 0 el arbol se optimiza para escrituras (B-epsilon): una
+     insercion o eliminacion solo deja un mensaje en el buffer de la raiz y los mensajes bajan por
+     grupos cuando un buffer se llena, asi cada camino hacia las hojas se recorre una vez por grupo
+     y no una vez por operacion. Las busquedas revisan los buffers mientras bajan.
+
+     Con 'arena' los nodos salen de ese arena (huge pages, memoria de un nodo NUMA, ver NodeArena)
+     en vez del heap normal. El arena tiene que vivir mas que el arbol y sus snapshots */
+    BigTree(int _degree, bool _compress_leaves = false, int _buffer_capacity = 0, NodeArena *_arena = NULL) {
         root = NULL;
         tree_degree = _degree;
+        compress_leaves = _compress_leaves;
+        buffer_capacity = _buffer_capacity;
+        right_leaf = NULL;
+        has_floor = false;
+        filter = NULL;
+        compact_height = 0;
+        compact_from = 0;
+        arena = _arena;
+        max_tombstones = 0;
+        tombstones = 0;
+    }
+
+    ~BigTree() {
+        BTreeNode::release(root);
+        delete filter;
     }
 
     void traverse() {
+        flushAll();
         if (root != NULL) root->traverse();
     }
 
     // Busca una llave en el arbol
 
     BTreeNode* search(int k) {
-        return (root == NULL) ? NULL : root->search(k);
+        TREE_LOOKUP_BEGIN();
+        BTreeNode *node = NULL;
+        if (root != NULL && (filter == NULL || filter->mayContain(k))) // El filtro responde sin visitar nodos
+            node = root->search(k);
+        TREE_LOOKUP_END();
+        if (node != NULL && tombstones > 0 && node->deadKey(k))
+            return NULL;
+        return node;
     }
 
+    /* Busca varias llaves a la vez: found[i] dice si keys[i] esta en el arbol. Cada busqueda es una
+     corrutina que antes de leer un nodo le pide el nodo a la cache (prefetch) y se suspende; mientras
+     tanto avanzan las otras 'group' busquedas, asi los fallos de cache se esperan en paralelo en vez
+     de uno tras otro. Conviene cuando el arbol es mucho mas grande que la cache */
+    void searchBatch(const int *keys, size_t count, bool *found, int group = 8);
+
     // Inserta una nueva llave en el arbol
     void insert(int k);
 
     // Elimina una llave del arbol
     void remove(int k);
 
+    // Igual que remove pero sin avisar si la llave no esta (ver OrderedSet.h)
+    void erase(int k);
 
+    // Busca la menor llave >= k. Retorna false si no hay
+    bool lowerBound(int k, int& out);
 
+    // Llama a visitor(llave) para cada llave, de menor a mayor
+    template<class Visitor>
+    void forEach(Visitor visitor) {
+        flushAll();
+        if (root != NULL) BigTreeSnapshot::visit(root, visitor);
+    }
+
+    /* Inserta o elimina un lote de llaves (en cualquier orden, con repetidas). El lote se ordena
+     y baja por el arbol en un solo recorrido: cada nodo se visita una vez por lote y se separa o
+     se une una vez, no una vez por llave */
+    void insertBatch(const std::vector<int>& batch);
+    void removeBatch(const std::vector<int>& batch);
+
+    /* Elimina todas las llaves en [lo, hi]. Los subarboles que quedan completos dentro del rango
+     se sueltan sin recorrerlos y solo se arreglan los dos caminos de los bordes, asi el costo es
+     O(log n) mas los nodos tocados, no una eliminacion por llave */
+    void removeRange(int lo, int hi);
+
+    /* Agrega un filtro de Bloom con contadores (ver CountingBloomFilter) que se revisa antes de
+     bajar por el arbol: casi todas las busquedas de llaves que no estan terminan sin tocar un nodo.
+     Se dimensiona para 'expected_keys' llaves con la tasa de falsos positivos pedida y a lo mas
+     'max_bytes' (0: sin limite). Con mas llaves de las esperadas los falsos positivos aumentan.
+     Con filtro, insertar una llave que puede estar obliga a buscarla antes (el filtro no debe
+     contarla dos veces) y eliminar una llave que seguro no esta no baja por el arbol */
+    void useFilter(size_t expected_keys, double false_positive_rate = 0.01, size_t max_bytes = 0);
+
+    /* Pasa todas las llaves de 'other' a este arbol y deja a 'other' vacio. Si todas las llaves de
+     un arbol son menores que las del otro se unen en O(log n); si no, se mezclan en O(n + m) */
+    void merge(BigTree& other);
+
+    // Vista de solo lectura del estado actual del arbol, en O(1) (con buffers primero se vacian)
+    BigTreeSnapshot snapshot();
+
+    // Aplica todos los mensajes pendientes en los buffers
+    void flushAll();
+
+    /* Eliminacion perezosa: remove() solo marca la llave como eliminada (las busquedas y los
+     recorridos la saltan) y no cambia la forma del arbol, asi que no hace fill/merge. Si la llave
+     se vuelve a insertar antes de purgar solo se le quita la marca. Cuando hay mas de
+     'max_tombstones' marcas se purgan todas juntas con removeBatch (un solo recorrido que rebalancea
+     cada nodo una vez). Las operaciones que cambian la forma del arbol de otra manera (lotes,
+     rangos, merge, compact, snapshot) purgan antes. 'max_tombstones' 0 apaga el modo y purga. No
+     tiene efecto con buffers (con buffers las eliminaciones ya son diferidas) */
+    void setLazyDelete(size_t max_tombstones);
+
+    /* Reemplaza el contenido del arbol por las llaves ordenadas y sin repetir 'sorted', armando los
+     nodos llenos nivel por nivel desde las hojas (sin separaciones). Los nodos de cada nivel se
+     reparten entre 'threads' hilos (ver ParallelBuild.h) */
+    void bulkLoad(const std::vector<int>& sorted, int threads = 1);
+
+    // Elimina de verdad las llaves marcadas (por ejemplo cuando el programa esta desocupado)
+    void purgeTombstones();
+
+    size_t tombstoneCount() const {
+        return tombstones;
+    }
 
+    // Nodos y llaves por nivel, histograma de llenado de los nodos y bytes por llave
+    BigTreeStats stats() const;
+
+    /* Junta las llaves de nodos poco llenos (por ejemplo despues de eliminar muchas llaves) en
+     menos nodos, de las hojas hacia la raiz: cada paso toma un nodo y vuelve a repartir las llaves
+     de sus hijos en la menor cantidad de nodos posible. Se puede hacer por partes: con 'max_nodes'
+     mayor que 0 se revisan a lo mas esa cantidad de nodos y la siguiente llamada sigue donde quedo
+     esta, aunque el arbol haya cambiado en medio. Retorna true cuando se termino de recorrer todo
+     el arbol (la siguiente llamada empieza otra vez) */
+    bool compact(size_t max_nodes = 0);
+
+    // Memoria usada por los nodos del arbol y el filtro (en bytes)
+    size_t memoryBytes() const {
+        return (root == NULL ? 0 : root->memoryBytes()) + (filter == NULL ? 0 : filter->memoryBytes());
+    }
 };
 
 #endif	/* BIGTREE_H */
@@ -0,0 +1,305 @@
+#include "BufferPool.h"
+#include "Checksum.h"
+#include <stdio.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DWB_MAGIC 0x42574444 // "DDWB"
+
+/* Encabezado del archivo de doble escritura. Le siguen los numeros de pagina y luego las paginas */
+struct DoubleWriteHeader {
+    unsigned int magic;
+    unsigned int count;
+    unsigned int page_size;
+    unsigned int crc; // CRC de los numeros de pagina y del contenido de las paginas
+};
+
+BufferPool::BufferPool(int _page_size, size_t cache_bytes) {
+    page_size = _page_size;
+    fd = -1;
+    page_count = 0;
+    clock_hand = 0;
+    dirty_frames = 0;
+    hits = misses = writes = 0;
+
+    size_t n = cache_bytes / page_size;
+    if (n < 16)
+        n = 16;
+
+    //Toda la memoria del pool se reserva de una vez, asi el consumo queda acotado por el presupuesto
+    memory = (char*) aligned_alloc(4096, n * page_size);
+    frames.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        frames[i].id = INVALID_PAGE;
+        frames[i].pins = 0;
+        frames[i].dirty = false;
+        frames[i].referenced = false;
+        frames[i].data = memory + i * page_size;
+    }
+}
+
+BufferPool::~BufferPool() {
+    close();
+    free(memory);
+}
+
+bool BufferPool::open(const char* path, bool atomic_flush) {
+    fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    dwb_path.clear();
+    if (atomic_flush) {
+        dwb_path = std::string(path) + ".dwb";
+        if (!recoverDoubleWrite()) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+    struct stat st;
+    fstat(fd, &st);
+    page_count = (page_id) (st.st_size / page_size);
+    return true;
+}
+
+void BufferPool::close(bool write_back) {
+    if (fd < 0)
+        return;
+    if (write_back)
+        flush();
+    ::close(fd);
+    fd = -1;
+    page_table.clear();
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].id = INVALID_PAGE;
+        frames[i].pins = 0;
+        frames[i].dirty = false;
+    }
+    dirty_frames = 0;
+}
+
+void BufferPool::setDirty(Frame& f) {
+    if (!f.dirty) {
+        f.dirty = true;
+        dirty_frames++;
+    }
+}
+
+/* Escribe el contenido del marco en su posicion del archivo */
+bool BufferPool::writeFrame(Frame& f) {
+    off_t offset = (off_t) f.id * page_size;
+    if (pwrite(fd, f.data, page_size, offset) != page_size) {
+        perror("pwrite");
+        return false;
+    }
+    f.dirty = false;
+    dirty_frames--;
+    writes++;
+    return true;
+}
+
+/*
+ * Algoritmo CLOCK: la manecilla avanza por los marcos. Un marco libre se usa de inmediato;
+ * a uno con el bit de referencia en 1 se le da una segunda oportunidad (se pone en 0) y uno
+ * con el bit en 0 que no este fijo es la victima. Se dan como maximo dos vueltas completas,
+ * si no se encontro nada es porque todos los marcos estan fijos (o sucios, con 'atomic_flush').
+ */
+int BufferPool::findVictim() {
+    size_t n = frames.size();
+    for (size_t step = 0; step < 2 * n; step++) {
+        Frame& f = frames[clock_hand];
+        int idx = (int) clock_hand;
+        clock_hand = (clock_hand + 1) % n;
+
+        if (f.id == INVALID_PAGE)
+            return idx;
+        if (f.pins > 0)
+            continue;
+        //no-steal: una pagina sucia solo se escribe en flush()
+        if (f.dirty && !dwb_path.empty())
+            continue;
+        if (f.referenced) {
+            f.referenced = false;
+            continue;
+        }
+
+        //Desalojamos la pagina, si esta sucia la escribimos antes (write-back)
+        if (f.dirty && !writeFrame(f))
+            return -1;
+        page_table.erase(f.id);
+        f.id = INVALID_PAGE;
+        return idx;
+    }
+    //Todas las paginas estan fijas: el presupuesto de cache es demasiado chico
+    std::cerr << "BufferPool: no hay marcos libres (" << n << " marcos, todos fijos o sucios)" << std::endl;
+    return -1;
+}
+
+/* Pone la pagina 'id' en un marco. Si 'read' es true el contenido se lee del archivo */
+int BufferPool::loadFrame(page_id id, bool read) {
+    int idx = findVictim();
+    if (idx < 0)
+        return -1;
+    Frame& f = frames[idx];
+    if (read) {
+        if (pread(fd, f.data, page_size, (off_t) id * page_size) != page_size) {
+            perror("pread");
+            return -1;
+        }
+    } else
+        memset(f.data, 0, page_size);
+
+    f.id = id;
+    f.pins = 0;
+    f.dirty = false;
+    page_table[id] = idx;
+    return idx;
+}
+
+char* BufferPool::fetch(page_id id) {
+    assert(id < page_count);
+    int idx;
+    std::unordered_map<page_id, int>::iterator it = page_table.find(id);
+    if (it != page_table.end()) {
+        idx = it->second;
+        hits++;
+    } else {
+        idx = loadFrame(id, true);
+        if (idx < 0)
+            return NULL;
+        misses++;
+    }
+    Frame& f = frames[idx];
+    f.pins++;
+    f.referenced = true;
+    return f.data;
+}
+
+char* BufferPool::append(page_id& id) {
+    id = page_count;
+    int idx = loadFrame(id, false);
+    if (idx < 0)
+        return NULL;
+    page_count++;
+
+    Frame& f = frames[idx];
+    f.pins = 1;
+    setDirty(f); //La pagina todavia no existe en el archivo
+    f.referenced = true;
+    return f.data;
+}
+
+void BufferPool::unpin(page_id id, bool dirty) {
+    std::unordered_map<page_id, int>::iterator it = page_table.find(id);
+    assert(it != page_table.end());
+    Frame& f = frames[it->second];
+    assert(f.pins > 0);
+    f.pins--;
+    if (dirty)
+        setDirty(f);
+}
+
+bool BufferPool::flush() {
+    if (fd < 0)
+        return false;
+    if (!dwb_path.empty() && !doubleWrite())
+        return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (frames[i].id != INVALID_PAGE && frames[i].dirty)
+            ok = writeFrame(frames[i]) && ok;
+    }
+    if (fsync(fd) != 0) {
+        perror("fsync");
+        ok = false;
+    }
+    //Las paginas ya estan en su lugar, la copia de doble escritura ya no hace falta
+    if (ok && !dwb_path.empty() && truncate(dwb_path.c_str(), 0) != 0)
+        perror(dwb_path.c_str());
+    return ok;
+}
+
+/*
+ * Copia todas las paginas sucias al archivo de doble escritura y hace fsync. Si hay una caida
+ * mientras se escriben las paginas en su lugar, al abrir se vuelven a copiar desde ahi. Si la caida
+ * ocurre antes de terminar este archivo, el CRC no coincide y simplemente se ignora (las paginas
+ * del archivo principal todavia no se tocaron).
+ */
+bool BufferPool::doubleWrite() {
+    std::vector<page_id> ids;
+    std::vector<int> idxs;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (frames[i].id != INVALID_PAGE && frames[i].dirty) {
+            ids.push_back(frames[i].id);
+            idxs.push_back((int) i);
+        }
+    }
+    if (ids.empty())
+        return true;
+
+    DoubleWriteHeader h;
+    h.magic = DWB_MAGIC;
+    h.count = (unsigned int) ids.size();
+    h.page_size = page_size;
+    h.crc = crc32(&ids[0], ids.size() * sizeof (page_id));
+    for (size_t i = 0; i < idxs.size(); i++)
+        h.crc = crc32_update(h.crc, frames[idxs[i]].data, page_size);
+
+    int dfd = ::open(dwb_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dfd < 0) {
+        perror(dwb_path.c_str());
+        return false;
+    }
+    bool ok = write(dfd, &h, sizeof (h)) == (ssize_t) sizeof (h);
+    ok = ok && write(dfd, &ids[0], ids.size() * sizeof (page_id)) == (ssize_t) (ids.size() * sizeof (page_id));
+    for (size_t i = 0; ok && i < idxs.size(); i++)
+        ok = write(dfd, frames[idxs[i]].data, page_size) == page_size;
+    ok = ok && fsync(dfd) == 0;
+    ::close(dfd);
+    if (!ok)
+        perror(dwb_path.c_str());
+    return ok;
+}
+
+/* Si el archivo de doble escritura esta completo, vuelve a escribir sus paginas en el archivo principal */
+bool BufferPool::recoverDoubleWrite() {
+    int dfd = ::open(dwb_path.c_str(), O_RDONLY);
+    if (dfd < 0)
+        return true; //No hubo ningun flush a medias
+
+    bool ok = true;
+    DoubleWriteHeader h;
+    struct stat st;
+    //La cantidad de paginas tiene que coincidir con el tamanno del archivo antes de reservar memoria
+    //para ellas; un archivo vacio o a medias (flush interrumpido antes del fsync) se ignora
+    if (fstat(dfd, &st) == 0 && read(dfd, &h, sizeof (h)) == (ssize_t) sizeof (h) && h.magic == DWB_MAGIC &&
+            h.page_size == (unsigned int) page_size && h.count > 0 &&
+            (unsigned long long) st.st_size == sizeof (h) + (unsigned long long) h.count * (sizeof (page_id) + page_size)) {
+        std::vector<page_id> ids(h.count);
+        std::vector<char> pages((size_t) h.count * page_size);
+        bool complete = read(dfd, &ids[0], h.count * sizeof (page_id)) == (ssize_t) (h.count * sizeof (page_id)) &&
+                read(dfd, &pages[0], pages.size()) == (ssize_t) pages.size();
+        if (complete) {
+            unsigned int crc = crc32(&ids[0], ids.size() * sizeof (page_id));
+            crc = crc32_update(crc, &pages[0], pages.size());
+            complete = crc == h.crc;
+        }
+        if (complete) {
+            for (unsigned int i = 0; ok && i < h.count; i++)
+                ok = pwrite(fd, &pages[(size_t) i * page_size], page_size, (off_t) ids[i] * page_size) == page_size;
+            ok = ok && fsync(fd) == 0;
+            if (!ok)
+                perror("pwrite");
+        }
+    }
+    ::close(dfd);
+    return ok;
+}
@@ -0,0 +1,124 @@
+#ifndef BUFFERPOOL_H
+#define	BUFFERPOOL_H
+
+/*
+ * Buffer pool para arboles almacenados en disco.
+ *
+ * El archivo se divide en paginas de tamanno fijo (page_size) que se identifican por
+ * su numero de pagina (page_id). Solo una cantidad acotada de paginas vive en memoria al
+ * mismo tiempo (el presupuesto de cache), de modo que el consumo de memoria no depende
+ * del tamanno del archivo.
+ *
+ *      1) fetch() trae una pagina a memoria y la 'fija' (pin). Una pagina fija no puede ser
+ *         desalojada hasta que se llame unpin().
+ *      2) Las paginas modificadas se marcan como sucias y se escriben al archivo solo cuando
+ *         son desalojadas o cuando se llama flush() (write-back).
+ *      3) Para elegir que pagina desalojar se usa el algoritmo CLOCK (aproximacion de LRU):
+ *         cada marco tiene un bit de referencia que se pone en 1 en cada acceso y una 'manecilla'
+ *         que recorre los marcos dandole una segunda oportunidad a los que tienen el bit en 1.
+ *
+ * Si el archivo se abre con 'atomic_flush' (ver DurableBigTree) el pool cambia a una politica
+ * 'no-steal': las paginas sucias nunca se desalojan, solo se escriben en flush(). Ademas flush()
+ * primero copia las paginas sucias a un archivo auxiliar (<archivo>.dwb) y solo despues las
+ * escribe en su lugar, asi una caida a mitad de la escritura se puede reparar al abrir.
+ */
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+typedef unsigned int page_id;
+#define INVALID_PAGE ((page_id) 0xFFFFFFFF)
+
+class BufferPool {
+private:
+
+    /* Un marco de memoria que puede contener una pagina */
+    struct Frame {
+        page_id id; // Pagina que contiene el marco (INVALID_PAGE si esta libre)
+        int pins; // Cuantos usuarios tienen la pagina fija
+        bool dirty; // La pagina fue modificada y no se ha escrito al archivo
+        bool referenced; // Bit de referencia para CLOCK
+        char* data;
+    };
+
+    int fd; // Descriptor del archivo
+    int page_size;
+    page_id page_count; // Cantidad de paginas que tiene el archivo
+    char* memory; // Bloque unico con la memoria de todos los marcos
+    std::vector<Frame> frames;
+    std::unordered_map<page_id, int> page_table; // pagina -> indice del marco
+    size_t clock_hand;
+    size_t dirty_frames; // Cantidad de marcos sucios
+    std::string dwb_path; // Archivo de doble escritura (vacio si no se usa 'atomic_flush')
+
+    // Estadisticas
+    unsigned long long hits, misses, writes;
+
+    int findVictim();
+    bool writeFrame(Frame& f);
+    int loadFrame(page_id id, bool read);
+    void setDirty(Frame& f);
+    bool doubleWrite();
+    bool recoverDoubleWrite();
+
+public:
+    /* 'cache_bytes' es el presupuesto de memoria del pool. Se reservan cache_bytes / page_size
+     * marcos (con un minimo de 16, suficiente para las paginas que un arbol fija a la vez) */
+    BufferPool(int _page_size, size_t cache_bytes);
+    ~BufferPool();
+
+    /* Abre (o crea) el archivo. Retorna false si no se pudo abrir. Con 'atomic_flush' las paginas
+     * sucias solo se escriben en flush() y cada flush() es atomico */
+    bool open(const char* path, bool atomic_flush = false);
+
+    // Escribe las paginas sucias y cierra el archivo. Con 'write_back' en false las paginas sucias se descartan
+    void close(bool write_back = true);
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+    /* Trae la pagina 'id' a memoria y la fija. Retorna NULL si hubo un error de E/S o si no hay
+     * ningun marco que se pueda desalojar (todos fijos, o sucios con 'atomic_flush') */
+    char* fetch(page_id id);
+
+    // Agrega una pagina nueva al final del archivo. Queda fija y sucia. Retorna NULL igual que fetch()
+    char* append(page_id& id);
+
+    // Libera la pagina. Si 'dirty' es true la pagina se escribira antes de ser desalojada
+    void unpin(page_id id, bool dirty);
+
+    // Escribe todas las paginas sucias al archivo y hace fsync. Retorna false si hubo un error
+    bool flush();
+
+    int pageSize() const {
+        return page_size;
+    }
+
+    page_id pageCount() const {
+        return page_count;
+    }
+
+    size_t frameCount() const {
+        return frames.size();
+    }
+
+    size_t dirtyCount() const {
+        return dirty_frames;
+    }
+
+    unsigned long long cacheHits() const {
+        return hits;
+    }
+
+    unsigned long long cacheMisses() const {
+        return misses;
+    }
+
+    unsigned long long pageWrites() const {
+        return writes;
+    }
+};
+
+#endif	/* BUFFERPOOL_H */
@@ -0,0 +1,39 @@
+#ifndef CHECKSUM_H
+#define	CHECKSUM_H
+
+/*
+ * CRC-32 (polinomio 0xEDB88320, el mismo de zlib) para detectar registros y paginas
+ * escritos a medias despues de una caida.
+ */
+#include <stddef.h>
+
+struct Crc32Table {
+    unsigned int entries[256];
+
+    Crc32Table() {
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int c = i;
+            for (int j = 0; j < 8; j++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+
+static inline unsigned int crc32_update(unsigned int crc, const void* data, size_t len) {
+    //La tabla se calcula una sola vez (la inicializacion de un static local es segura entre hilos)
+    static const Crc32Table crc_table;
+    const unsigned int* table = crc_table.entries;
+
+    const unsigned char* p = (const unsigned char*) data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline unsigned int crc32(const void* data, size_t len) {
+    return crc32_update(0, data, len);
+}
+
+#endif	/* CHECKSUM_H */
@@ -0,0 +1,618 @@
+#include "ConcurrentBigTree.h"
+#include <iostream>
+#include <assert.h>
+#include <stdlib.h>
+#include <thread>
+
+/* Cada hilo ocupa siempre el mismo marco de epoca mientras vive. Al terminar el hilo su marco vuelve
+ * a la lista de libres (ya esta en 0 en todos los arboles porque no hay EpochGuard vivo) */
+static std::mutex free_slots_lock;
+static std::vector<int> free_slots;
+static int next_thread_slot = 0;
+
+struct ThreadSlot {
+    int slot = -1;
+
+    ~ThreadSlot() {
+        if (slot >= 0) {
+            std::lock_guard<std::mutex> lock(free_slots_lock);
+            free_slots.push_back(slot);
+        }
+    }
+};
+
+static thread_local ThreadSlot thread_slot;
+
+// Si ya hay 'max' hilos usando el arbol no hay marco que darle: se termina en vez de escribir fuera del arreglo
+static int acquireThreadSlot(int max) {
+    std::lock_guard<std::mutex> lock(free_slots_lock);
+    if (!free_slots.empty()) {
+        int slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+    if (next_thread_slot == max) {
+        std::cerr << "ConcurrentBigTree: mas de " << max << " hilos al mismo tiempo" << std::endl;
+        abort();
+    }
+    return next_thread_slot++;
+}
+
+ConcurrentBigTree::EpochGuard::EpochGuard(ConcurrentBigTree* t) {
+    tree = t;
+    if (thread_slot.slot < 0)
+        thread_slot.slot = acquireThreadSlot(MAX_THREADS);
+    slot = thread_slot.slot;
+    tree->slots[slot].epoch.store(tree->global_epoch.load());
+}
+
+ConcurrentBigTree::EpochGuard::~EpochGuard() {
+    tree->slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+ConcurrentBigTree::ConcurrentBigTree(int _degree) {
+    degree = _degree;
+    root.store(NULL);
+    root_version.store(0);
+    global_epoch.store(1);
+    for (int i = 0; i < MAX_THREADS; i++)
+        slots[i].epoch.store(0);
+}
+
+ConcurrentBigTree::~ConcurrentBigTree() {
+    freeSubtree(root.load());
+    for (size_t i = 0; i < retired.size(); i++)
+        freeNode(retired[i].node);
+}
+
+CBTreeNode* ConcurrentBigTree::newNode(bool leaf) {
+    CBTreeNode* node = new CBTreeNode;
+    node->version.store(0);
+    node->number_keys = 0;
+    node->leaf = leaf;
+    node->keys = new int[2 * degree - 1];
+    node->children = new CBTreeNode*[2 * degree];
+    return node;
+}
+
+void ConcurrentBigTree::freeNode(CBTreeNode* node) {
+    delete[] node->keys;
+    delete[] node->children;
+    delete node;
+}
+
+void ConcurrentBigTree::freeSubtree(CBTreeNode* node) {
+    if (node == NULL)
+        return;
+    if (!node->leaf) {
+        for (int i = 0; i <= node->number_keys; i++)
+            freeSubtree(node->children[i]);
+    }
+    freeNode(node);
+}
+
+/* El nodo ya no se puede alcanzar desde la raiz. Se libera cuando ningun hilo pueda estar leyendolo */
+void ConcurrentBigTree::retire(CBTreeNode* node) {
+    Retired r;
+    r.node = node;
+    r.epoch = global_epoch.fetch_add(1);
+
+    std::lock_guard<std::mutex> lock(retired_mutex);
+    retired.push_back(r);
+    if (retired.size() >= 64)
+        reclaim();
+}
+
+/* Libera los nodos que salieron del arbol antes de que entrara el hilo mas antiguo que sigue adentro */
+void ConcurrentBigTree::reclaim() {
+    unsigned long long oldest = global_epoch.load();
+    for (int i = 0; i < MAX_THREADS; i++) {
+        unsigned long long e = slots[i].epoch.load();
+        if (e != 0 && e < oldest)
+            oldest = e;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); i++) {
+        if (retired[i].epoch < oldest)
+            freeNode(retired[i].node);
+        else
+            retired[kept++] = retired[i];
+    }
+    retired.resize(kept);
+}
+
+/* Lectura optimista: falla si el nodo esta bloqueado u obsoleto */
+bool ConcurrentBigTree::readLock(std::atomic<unsigned long long>& version, unsigned long long& v) {
+    v = version.load(std::memory_order_acquire);
+    return (v & 3) == 0;
+}
+
+/* La version no cambio desde la lectura optimista, o sea lo que se leyo es consistente */
+bool ConcurrentBigTree::validate(std::atomic<unsigned long long>& version, unsigned long long v) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version.load(std::memory_order_relaxed) == v;
+}
+
+/* Convierte una lectura optimista en candado, solo si nadie modifico el nodo desde entonces */
+bool ConcurrentBigTree::upgrade(std::atomic<unsigned long long>& version, unsigned long long v) {
+    return version.compare_exchange_strong(v, v + 2, std::memory_order_acquire);
+}
+
+/* Bloquea esperando. Solo se usa con el padre bloqueado, asi el nodo no puede volverse obsoleto */
+void ConcurrentBigTree::writeLock(std::atomic<unsigned long long>& version) {
+    while (true) {
+        unsigned long long v = version.load(std::memory_order_relaxed);
+        assert((v & 1) == 0);
+        if ((v & 2) == 0 && version.compare_exchange_weak(v, v + 2, std::memory_order_acquire))
+            return;
+        std::this_thread::yield();
+    }
+}
+
+void ConcurrentBigTree::writeUnlock(std::atomic<unsigned long long>& version) {
+    version.fetch_add(2, std::memory_order_release);
+}
+
+void ConcurrentBigTree::writeUnlockObsolete(std::atomic<unsigned long long>& version) {
+    version.fetch_add(3, std::memory_order_release);
+}
+
+int ConcurrentBigTree::findKey(CBTreeNode* node, int k) {
+    int lo = 0, hi = node->number_keys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->keys[mid] < k)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool ConcurrentBigTree::search(int k) {
+    EpochGuard guard(this);
+    while (true) {
+        unsigned long long rv, v, cv;
+        if (!readLock(root_version, rv))
+            continue;
+        CBTreeNode* node = root.load(std::memory_order_acquire);
+        if (node == NULL) {
+            if (validate(root_version, rv))
+                return false;
+            continue;
+        }
+        if (!readLock(node->version, v) || !validate(root_version, rv))
+            continue;
+
+        while (true) {
+            int i = findKey(node, k);
+            bool found = i < node->number_keys && node->keys[i] == k;
+            bool leaf = node->leaf;
+            CBTreeNode* child = leaf ? NULL : node->children[i];
+            if (!validate(node->version, v))
+                break;
+            if (found)
+                return true;
+            if (leaf)
+                return false;
+            if (!readLock(child->version, cv) || !validate(node->version, v))
+                break;
+            node = child;
+            v = cv;
+        }
+    }
+}
+
+bool ConcurrentBigTree::insert(int k) {
+    EpochGuard guard(this);
+    int result;
+    while ((result = tryInsert(k)) < 0)
+        std::this_thread::yield();
+    return result == 1;
+}
+
+bool ConcurrentBigTree::remove(int k) {
+    EpochGuard guard(this);
+    int result;
+    while ((result = tryRemove(k)) < 0)
+        std::this_thread::yield();
+    return result == 1;
+}
+
+/*
+ * Un intento de insercion. Retorna 1 si se inserto, 0 si ya existia y -1 si hay que volver a
+ * empezar porque alguien modifico un nodo que leimos.
+ */
+int ConcurrentBigTree::tryInsert(int k) {
+    unsigned long long rv, v, cv;
+    if (!readLock(root_version, rv))
+        return -1;
+    CBTreeNode* node = root.load(std::memory_order_acquire);
+
+    if (node == NULL) {
+        if (!upgrade(root_version, rv))
+            return -1;
+        node = newNode(true);
+        node->keys[0] = k;
+        node->number_keys = 1;
+        root.store(node, std::memory_order_release);
+        writeUnlock(root_version);
+        return 1;
+    }
+    if (!readLock(node->version, v) || !validate(root_version, rv))
+        return -1;
+
+    //Raiz llena: el arbol crece en altura
+    if (node->number_keys == 2 * degree - 1) {
+        if (!upgrade(root_version, rv))
+            return -1;
+        if (!upgrade(node->version, v)) {
+            writeUnlock(root_version);
+            return -1;
+        }
+        CBTreeNode* new_root = newNode(false);
+        new_root->children[0] = node;
+        splitChild(new_root, 0, node);
+        root.store(new_root, std::memory_order_release);
+        writeUnlock(node->version);
+        readLock(new_root->version, v);
+        writeUnlock(root_version);
+        node = new_root;
+    }
+
+    while (true) {
+        int n = node->number_keys;
+        int i = findKey(node, k);
+
+        //no queremos que haya valores repetidos
+        if (i < n && node->keys[i] == k)
+            return validate(node->version, v) ? 0 : -1;
+
+        if (node->leaf) {
+            if (!upgrade(node->version, v))
+                return -1;
+            for (int j = n; j > i; j--)
+                node->keys[j] = node->keys[j - 1];
+            node->keys[i] = k;
+            node->number_keys = n + 1;
+            writeUnlock(node->version);
+            return 1;
+        }
+
+        /* Como en search(): el puntero se revisa con el padre antes de leer el hijo (un indice leido a
+         * medias podria apuntar a un nodo ya liberado) y el padre se vuelve a revisar despues de leer
+         * la version del hijo, por si el hijo se separo o se unio en medio */
+        CBTreeNode* child = node->children[i];
+        if (!validate(node->version, v))
+            return -1;
+        if (!readLock(child->version, cv) || !validate(node->version, v))
+            return -1;
+
+        //Hijo lleno: se bloquean el padre y el hijo y se separa
+        if (child->number_keys == 2 * degree - 1) {
+            if (!upgrade(node->version, v))
+                return -1;
+            if (!upgrade(child->version, cv)) {
+                writeUnlock(node->version);
+                return -1;
+            }
+            splitChild(node, i, child);
+            writeUnlock(child->version);
+            if (node->keys[i] == k) {
+                writeUnlock(node->version);
+                return 0;
+            }
+            if (node->keys[i] < k)
+                child = node->children[i + 1];
+            /* Mientras el padre siga bloqueado nadie puede llegar al hijo, asi que su version
+             * es estable y se puede seguir bajando sin volver a empezar desde la raiz */
+            readLock(child->version, cv);
+            writeUnlock(node->version);
+        }
+        node = child;
+        v = cv;
+    }
+}
+
+/* Igual que BTreeNode::splitChild. 'node' e 'y' deben estar bloqueados */
+void ConcurrentBigTree::splitChild(CBTreeNode* node, int i, CBTreeNode* y) {
+    CBTreeNode* z = newNode(y->leaf);
+    z->number_keys = degree - 1;
+    for (int j = 0; j < degree - 1; j++)
+        z->keys[j] = y->keys[j + degree];
+    if (!y->leaf) {
+        for (int j = 0; j < degree; j++)
+            z->children[j] = y->children[j + degree];
+    }
+    y->number_keys = degree - 1;
+
+    for (int j = node->number_keys; j >= i + 1; j--)
+        node->children[j + 1] = node->children[j];
+    node->children[i + 1] = z;
+    for (int j = node->number_keys - 1; j >= i; j--)
+        node->keys[j + 1] = node->keys[j];
+    node->keys[i] = y->keys[degree - 1];
+    node->number_keys++;
+}
+
+/*
+ * Un intento de eliminacion. Retorna 1 si se elimino, 0 si no existia y -1 si hay que volver a empezar.
+ * Antes de bajar a un hijo con menos de 'grado' llaves se bloquean el padre y el hijo y se llena
+ * el hijo (fill).
+ */
+int ConcurrentBigTree::tryRemove(int k) {
+    unsigned long long rv, v, cv;
+    if (!readLock(root_version, rv))
+        return -1;
+    CBTreeNode* node = root.load(std::memory_order_acquire);
+    if (node == NULL)
+        return validate(root_version, rv) ? 0 : -1;
+    if (!readLock(node->version, v) || !validate(root_version, rv))
+        return -1;
+
+    //Si la raiz se quedo sin llaves (por un merge) su unico hijo pasa a ser la raiz
+    if (node->number_keys == 0 && !node->leaf) {
+        if (!upgrade(root_version, rv))
+            return -1;
+        if (!upgrade(node->version, v)) {
+            writeUnlock(root_version);
+            return -1;
+        }
+        root.store(node->children[0], std::memory_order_release);
+        writeUnlockObsolete(node->version);
+        writeUnlock(root_version);
+        retire(node);
+        return -1;
+    }
+
+    while (true) {
+        int n = node->number_keys;
+        int idx = findKey(node, k);
+
+        if (idx < n && node->keys[idx] == k) {
+            if (!upgrade(node->version, v))
+                return -1;
+
+            if (node->leaf) {
+                //removeFromLeaf
+                for (int i = idx + 1; i < n; i++)
+                    node->keys[i - 1] = node->keys[i];
+                node->number_keys--;
+                writeUnlock(node->version);
+                return 1;
+            }
+
+            /* removeFromNonLeaf: el nodo queda bloqueado hasta sacar el predecesor (o sucesor) de su
+             * hoja, asi nadie ve la llave repetida ni la elimina dos veces */
+            CBTreeNode* child = node->children[idx];
+            writeLock(child->version);
+            if (child->number_keys >= degree) {
+                removePredLocked(node, idx);
+                return 1;
+            }
+            CBTreeNode* sibling = node->children[idx + 1];
+            writeLock(sibling->version);
+            if (sibling->number_keys >= degree) {
+                writeUnlock(child->version);
+                removeSuccLocked(node, idx);
+                return 1;
+            }
+            //Ambos tienen grado-1 llaves: se unen y 'k' baja al hijo
+            merge(node, idx);
+            writeUnlock(child->version);
+            readLock(child->version, cv);
+            writeUnlock(node->version);
+            node = child;
+            v = cv;
+            continue;
+        }
+
+        //Si es hoja, la llave no esta en este arbol
+        if (node->leaf)
+            return validate(node->version, v) ? 0 : -1;
+
+        CBTreeNode* child = node->children[idx];
+        if (!validate(node->version, v))
+            return -1;
+        if (!readLock(child->version, cv) || !validate(node->version, v))
+            return -1;
+
+        if (child->number_keys < degree) {
+            if (!upgrade(node->version, v))
+                return -1;
+            if (!upgrade(child->version, cv)) {
+                writeUnlock(node->version);
+                return -1;
+            }
+            bool last = (idx == n);
+            fillLocked(node, idx);
+
+            //Si el ultimo hijo se unio con el anterior la llave esta ahora en el hijo idx-1
+            if (last && idx > node->number_keys)
+                child = node->children[idx - 1];
+            else
+                child = node->children[idx];
+            readLock(child->version, cv);
+            writeUnlock(node->version);
+        }
+        node = child;
+        v = cv;
+    }
+}
+
+/*
+ * Igual que BTreeNode::fill. 'node' y su hijo 'idx' estan bloqueados; se bloquean los hermanos
+ * que hagan falta. Al terminar se sueltan el hijo y los hermanos (el nodo queda bloqueado).
+ */
+void ConcurrentBigTree::fillLocked(CBTreeNode* node, int idx) {
+    int n = node->number_keys;
+    CBTreeNode* child = node->children[idx];
+    CBTreeNode* prev = idx != 0 ? node->children[idx - 1] : NULL;
+    CBTreeNode* next = idx != n ? node->children[idx + 1] : NULL;
+
+    if (prev != NULL) {
+        writeLock(prev->version);
+        if (prev->number_keys >= degree) {
+            borrowFromPrev(node, idx);
+            writeUnlock(prev->version);
+            writeUnlock(child->version);
+            return;
+        }
+    }
+    if (next != NULL) {
+        writeLock(next->version);
+        if (next->number_keys >= degree) {
+            borrowFromNext(node, idx);
+            writeUnlock(next->version);
+        } else
+            merge(node, idx);
+        if (prev != NULL)
+            writeUnlock(prev->version);
+        writeUnlock(child->version);
+        return;
+    }
+    //Es el ultimo hijo: se une con el hermano anterior
+    merge(node, idx - 1);
+    writeUnlock(prev->version);
+}
+
+/*
+ * Reemplaza la llave 'idx' de 'top' por su predecesor. Se baja por el borde derecho del hijo
+ * 'idx' (ya bloqueado) bloqueando cada nodo y llenando los que tengan menos de 'grado' llaves.
+ */
+void ConcurrentBigTree::removePredLocked(CBTreeNode* top, int idx) {
+    CBTreeNode* cur = top->children[idx];
+    while (!cur->leaf) {
+        int n = cur->number_keys;
+        CBTreeNode* next = cur->children[n];
+        writeLock(next->version);
+        if (next->number_keys < degree) {
+            CBTreeNode* prev = cur->children[n - 1];
+            writeLock(prev->version);
+            if (prev->number_keys >= degree) {
+                borrowFromPrev(cur, n);
+                writeUnlock(prev->version);
+            } else {
+                merge(cur, n - 1); //'next' queda dentro de 'prev'
+                next = prev;
+            }
+        }
+        writeUnlock(cur->version);
+        cur = next;
+    }
+    top->keys[idx] = cur->keys[cur->number_keys - 1];
+    cur->number_keys--;
+    writeUnlock(cur->version);
+    writeUnlock(top->version);
+}
+
+/* Igual que removePredLocked pero con el sucesor, bajando por el borde izquierdo del hijo 'idx+1' */
+void ConcurrentBigTree::removeSuccLocked(CBTreeNode* top, int idx) {
+    CBTreeNode* cur = top->children[idx + 1];
+    while (!cur->leaf) {
+        CBTreeNode* next = cur->children[0];
+        writeLock(next->version);
+        if (next->number_keys < degree) {
+            CBTreeNode* sibling = cur->children[1];
+            writeLock(sibling->version);
+            if (sibling->number_keys >= degree) {
+                borrowFromNext(cur, 0);
+                writeUnlock(sibling->version);
+            } else
+                merge(cur, 0);
+        }
+        writeUnlock(cur->version);
+        cur = next;
+    }
+    top->keys[idx] = cur->keys[0];
+    for (int i = 1; i < cur->number_keys; i++)
+        cur->keys[i - 1] = cur->keys[i];
+    cur->number_keys--;
+    writeUnlock(cur->version);
+    writeUnlock(top->version);
+}
+
+/* Igual que BTreeNode::borrowFromPrev. El nodo y los dos hijos deben estar bloqueados */
+void ConcurrentBigTree::borrowFromPrev(CBTreeNode* node, int idx) {
+    CBTreeNode* child = node->children[idx];
+    CBTreeNode* sibling = node->children[idx - 1];
+
+    for (int i = child->number_keys - 1; i >= 0; --i)
+        child->keys[i + 1] = child->keys[i];
+    if (!child->leaf) {
+        for (int i = child->number_keys; i >= 0; --i)
+            child->children[i + 1] = child->children[i];
+        child->children[0] = sibling->children[sibling->number_keys];
+    }
+    child->keys[0] = node->keys[idx - 1];
+    node->keys[idx - 1] = sibling->keys[sibling->number_keys - 1];
+
+    child->number_keys += 1;
+    sibling->number_keys -= 1;
+}
+
+/* Igual que BTreeNode::borrowFromNext. El nodo y los dos hijos deben estar bloqueados */
+void ConcurrentBigTree::borrowFromNext(CBTreeNode* node, int idx) {
+    CBTreeNode* child = node->children[idx];
+    CBTreeNode* sibling = node->children[idx + 1];
+
+    child->keys[child->number_keys] = node->keys[idx];
+    if (!child->leaf)
+        child->children[child->number_keys + 1] = sibling->children[0];
+    node->keys[idx] = sibling->keys[0];
+
+    for (int i = 1; i < sibling->number_keys; ++i)
+        sibling->keys[i - 1] = sibling->keys[i];
+    if (!sibling->leaf) {
+        for (int i = 1; i <= sibling->number_keys; ++i)
+            sibling->children[i - 1] = sibling->children[i];
+    }
+    child->number_keys += 1;
+    sibling->number_keys -= 1;
+}
+
+/*
+ * Igual que BTreeNode::merge. El nodo y los dos hijos deben estar bloqueados; el hijo idx+1
+ * queda obsoleto (se suelta marcado como tal) y se libera cuando nadie pueda estar leyendolo.
+ */
+void ConcurrentBigTree::merge(CBTreeNode* node, int idx) {
+    CBTreeNode* child = node->children[idx];
+    CBTreeNode* sibling = node->children[idx + 1];
+    int cn = child->number_keys;
+
+    child->keys[cn] = node->keys[idx];
+    for (int i = 0; i < sibling->number_keys; ++i)
+        child->keys[cn + 1 + i] = sibling->keys[i];
+    if (!child->leaf) {
+        for (int i = 0; i <= sibling->number_keys; ++i)
+            child->children[cn + 1 + i] = sibling->children[i];
+    }
+    for (int i = idx + 1; i < node->number_keys; ++i)
+        node->keys[i - 1] = node->keys[i];
+    for (int i = idx + 2; i <= node->number_keys; ++i)
+        node->children[i - 1] = node->children[i];
+
+    child->number_keys += sibling->number_keys + 1;
+    node->number_keys--;
+
+    writeUnlockObsolete(sibling->version);
+    retire(sibling);
+}
+
+void ConcurrentBigTree::traverse() {
+    traverse(root.load());
+    std::cout << std::endl;
+}
+
+void ConcurrentBigTree::traverse(CBTreeNode* node) {
+    if (node == NULL)
+        return;
+    int i;
+    for (i = 0; i < node->number_keys; i++) {
+        if (!node->leaf)
+            traverse(node->children[i]);
+        std::cout << " " << node->keys[i];
+    }
+    if (!node->leaf)
+        traverse(node->children[i]);
+}
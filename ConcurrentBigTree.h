@@ -0,0 +1,116 @@
+#ifndef CONCURRENTBIGTREE_H
+#define	CONCURRENTBIGTREE_H
+
+/*
+ * Big-Tree que se puede usar desde varios hilos a la vez, con 'optimistic lock coupling'.
+ *
+ * Cada nodo tiene un numero de version que sirve tambien de candado:
+ *      - bit 0: el nodo ya no esta en el arbol (obsoleto)
+ *      - bit 1: el nodo esta bloqueado por un escritor
+ *      - resto: contador que aumenta cada vez que un escritor suelta el nodo
+ *
+ * Los lectores no bloquean nada: leen la version, leen el nodo y vuelven a leer la version. Si
+ * cambio (o el nodo estaba bloqueado) empiezan de nuevo desde la raiz. Al bajar, la version del
+ * padre se revisa despues de leer el puntero al hijo, asi nunca se sigue un puntero invalido.
+ *
+ * Los escritores bajan igual que los lectores y solo bloquean los nodos que van a modificar,
+ * convirtiendo su lectura optimista en candado (si la version no cambio). Se mantiene la
+ * estrategia de BigTree: un hijo lleno se separa antes de bajar a el y un hijo con menos de
+ * 'grado' llaves se llena (fill) antes de bajar a el al eliminar. Despues de separar o llenar
+ * se sigue bajando desde ese nodo; volver a empezar desde la raiz permitiria que una insercion
+ * y una eliminacion se deshagan mutuamente la separacion y el merge para siempre.
+ *
+ * Un nodo que sale del arbol (merge, cambio de raiz) no se libera de inmediato porque un
+ * lector optimista puede estar leyendolo: se libera cuando ningun hilo que pudo haberlo visto
+ * sigue dentro del arbol (reclamacion por epocas).
+ */
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/* Nodo del arbol concurrente */
+struct CBTreeNode {
+    std::atomic<unsigned long long> version;
+    int number_keys;
+    bool leaf;
+    int* keys;
+    CBTreeNode** children;
+};
+
+class ConcurrentBigTree {
+private:
+    static const int MAX_THREADS = 256; // Hilos vivos que pueden usar arboles a la vez (ver EpochGuard)
+
+    /* Epoca en la que entro cada hilo (0 = no esta dentro del arbol). Un marco por linea de cache */
+    struct alignas(64) EpochSlot {
+        std::atomic<unsigned long long> epoch;
+    };
+
+    /* Nodo que salio del arbol y la epoca en la que salio */
+    struct Retired {
+        unsigned long long epoch;
+        CBTreeNode* node;
+    };
+
+    std::atomic<CBTreeNode*> root;
+    std::atomic<unsigned long long> root_version; // Candado del puntero a la raiz
+    int degree;
+
+    std::atomic<unsigned long long> global_epoch;
+    EpochSlot slots[MAX_THREADS];
+    std::mutex retired_mutex;
+    std::vector<Retired> retired;
+
+    /* Marca al hilo como dentro del arbol mientras exista */
+    struct EpochGuard {
+        ConcurrentBigTree* tree;
+        int slot;
+        EpochGuard(ConcurrentBigTree* t);
+        ~EpochGuard();
+    };
+
+    CBTreeNode* newNode(bool leaf);
+    void freeNode(CBTreeNode* node);
+    void freeSubtree(CBTreeNode* node);
+    void retire(CBTreeNode* node);
+    void reclaim();
+
+    // Candado optimista
+    static bool readLock(std::atomic<unsigned long long>& version, unsigned long long& v);
+    static bool validate(std::atomic<unsigned long long>& version, unsigned long long v);
+    static bool upgrade(std::atomic<unsigned long long>& version, unsigned long long v);
+    static void writeLock(std::atomic<unsigned long long>& version);
+    static void writeUnlock(std::atomic<unsigned long long>& version);
+    static void writeUnlockObsolete(std::atomic<unsigned long long>& version);
+
+    int findKey(CBTreeNode* node, int k);
+    void splitChild(CBTreeNode* node, int i, CBTreeNode* y);
+    void borrowFromPrev(CBTreeNode* node, int idx);
+    void borrowFromNext(CBTreeNode* node, int idx);
+    void merge(CBTreeNode* node, int idx);
+    void fillLocked(CBTreeNode* node, int idx);
+    void removePredLocked(CBTreeNode* top, int idx);
+    void removeSuccLocked(CBTreeNode* top, int idx);
+
+    int tryInsert(int k);
+    int tryRemove(int k);
+    void traverse(CBTreeNode* node);
+
+public:
+    ConcurrentBigTree(int _degree);
+    ~ConcurrentBigTree();
+
+    // Retorna true si la llave esta en el arbol
+    bool search(int k);
+
+    // Inserta una llave. Retorna false si ya existia
+    bool insert(int k);
+
+    // Elimina una llave. Retorna false si no existia
+    bool remove(int k);
+
+    // Muestra las llaves de menor a mayor (no debe haber escritores al mismo tiempo)
+    void traverse();
+};
+
+#endif	/* CONCURRENTBIGTREE_H */
@@ -0,0 +1,151 @@
+/*
+ * Prueba de estres de ConcurrentBigTree con varios hilos (make stress).
+ *
+ *      1) Cada hilo escritor es duenno de las llaves k con k % hilos == su numero: inserta, elimina y
+ *         busca llaves al azar de las suyas y revisa cada resultado contra su propia copia (nadie mas
+ *         toca esas llaves, asi que el resultado tiene que coincidir siempre). Al mismo tiempo otros
+ *         hilos buscan llaves de todos, que obliga a los lectores optimistas a reintentar.
+ *      2) Al terminar se revisa que el arbol tenga exactamente las llaves de las copias.
+ *      3) Se crean y terminan mas hilos que marcos de epoca tiene el arbol, para revisar que los marcos
+ *         de los hilos que terminaron se vuelven a usar.
+ *
+ * Con grado chico y pocas llaves casi cada operacion separa, une o presta entre nodos.
+ *
+ * Uso: stress [--threads N] [--readers N] [--ops N] [--keys N] [--degree N] [--seed N]
+ * Termina con codigo 1 si encontro algun error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ConcurrentBigTree.h"
+
+struct StressOptions {
+    int threads; // Hilos escritores
+    int readers; // Hilos que solo buscan
+    long long ops; // Operaciones por escritor
+    int keys; // Llaves en [0, keys)
+    int degree;
+    unsigned long long seed;
+};
+
+static std::atomic<long long> errors(0);
+
+static void report(const char *what, int thread, int k) {
+    if (errors.fetch_add(1) < 20)
+        printf("error: %s (hilo %d, llave %d)\n", what, thread, k);
+}
+
+/* Escritor 't': solo toca sus llaves y revisa cada resultado contra 'present' */
+static void writer(ConcurrentBigTree *tree, const StressOptions& options, int t, std::vector<char>& present) {
+    std::mt19937_64 random(options.seed + t);
+    int owned = (options.keys - t + options.threads - 1) / options.threads;
+    for (long long i = 0; i < options.ops && owned > 0; i++) {
+        int k = (int) (random() % owned) * options.threads + t;
+        int op = (int) (random() % 10);
+        if (op < 4) {
+            if (tree->insert(k) == (bool) present[k])
+                report("insert", t, k);
+            present[k] = 1;
+        } else if (op < 8) {
+            if (tree->remove(k) != (bool) present[k])
+                report("remove", t, k);
+            present[k] = 0;
+        } else if (tree->search(k) != (bool) present[k])
+            report("search", t, k);
+    }
+}
+
+static void reader(ConcurrentBigTree *tree, const StressOptions& options, int r, std::atomic<bool>& done) {
+    std::mt19937_64 random(options.seed * 31 + r);
+    while (!done.load(std::memory_order_relaxed))
+        tree->search((int) (random() % options.keys));
+}
+
+static bool parseOptions(int argc, char **argv, StressOptions& options) {
+    options.threads = 8;
+    options.readers = 2;
+    options.ops = 200000;
+    options.keys = 4096;
+    options.degree = 2;
+    options.seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) {
+            printf("falta el valor de %s\n", argv[i]);
+            return false;
+        }
+        if (strcmp(argv[i], "--threads") == 0)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--readers") == 0)
+            options.readers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ops") == 0)
+            options.ops = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--keys") == 0)
+            options.keys = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--degree") == 0)
+            options.degree = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0)
+            options.seed = strtoull(argv[++i], NULL, 10);
+        else {
+            printf("opcion desconocida: %s\n", argv[i]);
+            return false;
+        }
+    }
+    if (options.threads < 1 || options.readers < 0 || options.keys < 1 || options.degree < 2) {
+        printf("se necesita --threads >= 1, --readers >= 0, --keys >= 1 y --degree >= 2\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    StressOptions options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    printf("%d escritores, %d lectores, %lld operaciones por escritor, %d llaves, grado %d\n",
+            options.threads, options.readers, options.ops, options.keys, options.degree);
+
+    ConcurrentBigTree tree(options.degree);
+    std::vector<std::vector<char> > present(options.threads, std::vector<char>(options.keys, 0));
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers, writers;
+    for (int r = 0; r < options.readers; r++)
+        readers.push_back(std::thread(reader, &tree, std::cref(options), r, std::ref(done)));
+    for (int t = 0; t < options.threads; t++)
+        writers.push_back(std::thread(writer, &tree, std::cref(options), t, std::ref(present[t])));
+    for (size_t i = 0; i < writers.size(); i++)
+        writers[i].join();
+    done.store(true);
+    for (size_t i = 0; i < readers.size(); i++)
+        readers[i].join();
+
+    long long expected = 0;
+    for (int k = 0; k < options.keys; k++) {
+        bool should = present[k % options.threads][k];
+        expected += should;
+        if (tree.search(k) != should)
+            report("contenido final", k % options.threads, k);
+    }
+    printf("fase 1: %lld llaves al final\n", expected);
+
+    // Mas hilos en total que marcos de epoca (256); cada uno usa el arbol y termina
+    int rounds = 300 / options.threads + 1;
+    for (int round = 0; round < rounds; round++) {
+        std::vector<std::thread> wave;
+        for (int t = 0; t < options.threads; t++)
+            wave.push_back(std::thread([&tree, &options, round, t] {
+                int k = options.keys + round * options.threads + t;
+                if (!tree.insert(k) || !tree.search(k) || !tree.remove(k))
+                    report("hilo de corta vida", t, k);
+            }));
+        for (size_t i = 0; i < wave.size(); i++)
+            wave[i].join();
+    }
+    printf("fase 2: %d hilos de corta vida\n", rounds * options.threads);
+
+    printf("%lld errores\n", errors.load());
+    return errors.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include "CountingBloomFilter.h"
+#include <math.h>
+#include <string.h>
+
+CountingBloomFilter::CountingBloomFilter(size_t expected_keys, double false_positive_rate, size_t max_bytes) {
+    if (expected_keys == 0)
+        expected_keys = 1;
+    if (false_positive_rate <= 0 || false_positive_rate >= 1)
+        false_positive_rate = 0.01;
+
+    /* Se empieza con el tamano de un filtro de Bloom normal, m = -n ln(p) / ln(2)^2 contadores,
+     y se agranda hasta que la tasa con bloques (ver blockedRate) llegue a la pedida */
+    double ln2 = log(2.0);
+    int max_hashes = (int) ceil(-log(false_positive_rate) / ln2);
+    double m = -(double) expected_keys * log(false_positive_rate) / (ln2 * ln2);
+    blocks = (size_t) ceil(m / BLOCK_COUNTERS);
+    if (blocks == 0)
+        blocks = 1;
+    hashes = hashesFor(expected_keys, blocks, max_hashes);
+    while (blockedRate((double) expected_keys / blocks, hashes) > false_positive_rate) {
+        blocks += blocks / 20 + 1;
+        hashes = hashesFor(expected_keys, blocks, max_hashes);
+    }
+    if (max_bytes > 0 && blocks * BLOCK_BYTES > max_bytes) {
+        blocks = max_bytes / BLOCK_BYTES;
+        if (blocks == 0)
+            blocks = 1;
+        hashes = hashesFor(expected_keys, blocks, 16);
+    }
+
+    counters = new unsigned char[blocks * BLOCK_BYTES];
+    keys = 0;
+    clear();
+}
+
+CountingBloomFilter::~CountingBloomFilter() {
+    delete[] counters;
+}
+
+/* (m/n) ln(2) contadores por llave es lo optimo, pero mas de log2(1/p) casi no baja la tasa y cada uno cuesta */
+int CountingBloomFilter::hashesFor(size_t expected_keys, size_t blocks, int max_hashes) {
+    int k = (int) (blocks * BLOCK_COUNTERS / (double) expected_keys * log(2.0) + 0.5);
+    if (k > max_hashes)
+        k = max_hashes;
+    if (k > 16)
+        k = 16;
+    return k < 1 ? 1 : k;
+}
+
+/*
+ * En un filtro normal la tasa es (1 - e^(-kn/m))^k. Con bloques cada bloque es un filtro chico con
+ * su propia cantidad de llaves, que sigue una distribucion de Poisson: los bloques con mas llaves
+ * que el promedio dan mas falsos positivos. Se promedia la tasa de cada bloque.
+ */
+double CountingBloomFilter::blockedRate(double keys_per_block, int hashes) {
+    if (keys_per_block <= 0)
+        return 0;
+    double spread = 10 * sqrt(keys_per_block) + 10;
+    int first = keys_per_block > spread ? (int) (keys_per_block - spread) : 0;
+    int last = (int) (keys_per_block + spread);
+    double rate = 0;
+    for (int j = first; j <= last; j++) {
+        double prob = exp(-keys_per_block + j * log(keys_per_block) - lgamma(j + 1.0));
+        rate += prob * pow(1 - exp(-hashes * (double) j / BLOCK_COUNTERS), hashes);
+    }
+    return rate;
+}
+
+void CountingBloomFilter::add(int k) {
+    size_t block;
+    unsigned long long bits;
+    locate(k, block, bits);
+    unsigned char *b = counters + block * BLOCK_BYTES;
+    for (int i = 0; i < hashes; i++) {
+        unsigned int pos = nextCounter(bits, i);
+        int shift = (pos & 1) * 4;
+        if (((b[pos >> 1] >> shift) & 15) != 15)
+            b[pos >> 1] += 1 << shift;
+    }
+    keys++;
+}
+
+void CountingBloomFilter::remove(int k) {
+    size_t block;
+    unsigned long long bits;
+    locate(k, block, bits);
+    unsigned char *b = counters + block * BLOCK_BYTES;
+    for (int i = 0; i < hashes; i++) {
+        unsigned int pos = nextCounter(bits, i);
+        int shift = (pos & 1) * 4;
+        int c = (b[pos >> 1] >> shift) & 15;
+        if (c != 15 && c != 0)
+            b[pos >> 1] -= 1 << shift;
+    }
+    if (keys > 0)
+        keys--;
+}
+
+void CountingBloomFilter::clear() {
+    memset(counters, 0, blocks * BLOCK_BYTES);
+    keys = 0;
+}
+
+double CountingBloomFilter::expectedFalsePositiveRate() const {
+    return blockedRate((double) keys / blocks, hashes);
+}
@@ -0,0 +1,107 @@
+#ifndef COUNTINGBLOOMFILTER_H
+#define	COUNTINGBLOOMFILTER_H
+
+/*
+ * Filtro de Bloom con contadores: dice si una llave NO esta en el conjunto sin buscarla.
+ *
+ * Cada llave suma 1 a 'hashes' contadores y eliminarla les resta 1, asi se pueden borrar llaves
+ * (un filtro de Bloom normal solo tiene bits y no puede). Si algun contador de la llave esta en
+ * 0 la llave seguro no esta; si todos son mayores que 0 puede estar (falso positivo).
+ *
+ * Los contadores son de 4 bits y estan agrupados en bloques de 64 bytes (una linea de cache):
+ * todos los contadores de una llave caen en el mismo bloque, asi una consulta es un solo fallo
+ * de cache. Un contador que llega a 15 se queda en 15 para siempre: restarle podria dejar en 0
+ * un contador que todavia usa otra llave y el filtro daria un falso negativo.
+ *
+ * Solo se debe eliminar una llave que se agrego antes (el que lo usa tiene que saberlo).
+ */
+#include <stddef.h>
+
+class CountingBloomFilter {
+private:
+    static const int BLOCK_BYTES = 64;
+    static const int BLOCK_COUNTERS = BLOCK_BYTES * 2;
+
+    unsigned char *counters; // Dos contadores por byte
+    size_t blocks;
+    int hashes; // Contadores por llave
+    size_t keys; // Llaves en el filtro
+
+    /* Finalizador de MurmurHash3: mezcla todos los bits de la llave */
+    static unsigned long long mix(unsigned long long x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+    static int hashesFor(size_t expected_keys, size_t blocks, int max_hashes);
+
+    // Tasa de falsos positivos con bloques de BLOCK_COUNTERS contadores
+    static double blockedRate(double keys_per_block, int hashes);
+
+    /* Bloque de la llave y los bits de donde salen sus contadores: 7 bits por contador, 9 por cada
+     64 bits (despues se vuelven a mezclar). Con hashing doble (first + i*step) dentro de un bloque
+     tan chico las llaves con el mismo paso chocan mucho mas y la tasa sube casi al doble */
+    void locate(int k, size_t& block, unsigned long long& bits) const {
+        unsigned long long h = mix((unsigned int) k);
+        block = (size_t) ((h >> 32) % blocks);
+        bits = mix(h);
+    }
+
+    static unsigned int nextCounter(unsigned long long& bits, int i) {
+        if (i > 0 && i % 9 == 0)
+            bits = mix(bits);
+        unsigned int pos = (unsigned int) (bits & (BLOCK_COUNTERS - 1));
+        bits >>= 7;
+        return pos;
+    }
+
+public:
+    /* Dimensiona el filtro para 'expected_keys' llaves con la tasa de falsos positivos pedida. Si
+     'max_bytes' es mayor que 0 el filtro no usa mas memoria que eso (con mas falsos positivos) */
+    CountingBloomFilter(size_t expected_keys, double false_positive_rate, size_t max_bytes = 0);
+    ~CountingBloomFilter();
+
+    void add(int k);
+    void remove(int k);
+
+    // false: la llave seguro no esta. true: puede estar
+    bool mayContain(int k) const {
+        size_t block;
+        unsigned long long bits;
+        locate(k, block, bits);
+        const unsigned char *b = counters + block * BLOCK_BYTES;
+        for (int i = 0; i < hashes; i++) {
+            unsigned int pos = nextCounter(bits, i);
+            if (((b[pos >> 1] >> ((pos & 1) * 4)) & 15) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    // Pide a la cache el bloque de la llave antes de llamar a mayContain
+    void prefetch(int k) const {
+        size_t block;
+        unsigned long long bits;
+        locate(k, block, bits);
+        __builtin_prefetch(counters + block * BLOCK_BYTES);
+    }
+
+    // Deja todos los contadores en 0
+    void clear();
+
+    size_t size() const {
+        return keys;
+    }
+
+    size_t memoryBytes() const {
+        return sizeof (CountingBloomFilter) + blocks * BLOCK_BYTES;
+    }
+
+    // Tasa de falsos positivos esperada con las llaves que tiene ahora
+    double expectedFalsePositiveRate() const;
+};
+
+#endif	/* COUNTINGBLOOMFILTER_H */
@@ -0,0 +1,127 @@
+#include "DurableBigTree.h"
+
+DurableBigTree::DurableBigTree(int page_size, size_t cache_bytes, int commit_delay_us, unsigned long long _checkpoint_every)
+: tree(page_size, cache_bytes), log(commit_delay_us) {
+    checkpoint_every = _checkpoint_every;
+    ops_since_checkpoint = 0;
+    checkpoints = 0;
+}
+
+DurableBigTree::~DurableBigTree() {
+    close();
+}
+
+bool DurableBigTree::open(const char* path) {
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    if (!tree.open(path, true))
+        return false;
+
+    std::vector<LogRecord> records;
+    std::string wal_path = std::string(path) + ".wal";
+    if (!log.open(wal_path.c_str(), records)) {
+        tree.close();
+        return false;
+    }
+
+    //Recuperacion: volvemos a aplicar lo que quedo despues del ultimo checkpoint
+    unsigned long long last = tree.checkpointLSN();
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].lsn <= tree.checkpointLSN())
+            continue;
+        if (records[i].op == LOG_INSERT)
+            tree.insert(records[i].key);
+        else
+            tree.remove(records[i].key);
+        if (tree.ioFailed()) {
+            log.close();
+            tree.close();
+            return false;
+        }
+        last = records[i].lsn;
+
+        //Si el log es muy largo las paginas sucias no caben en el pool. El log no se puede vaciar
+        //todavia, pero el checkpoint guarda hasta donde se aplico
+        if (needsCheckpoint()) {
+            tree.setCheckpointLSN(last);
+            tree.flush();
+        }
+    }
+    log.startAfter(last);
+    return true;
+}
+
+void DurableBigTree::close() {
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    if (!tree.bufferPool().isOpen())
+        return;
+    //Si el checkpoint fallo el arbol se cierra sin escribir: lo que falta sigue en el log
+    bool ok = checkpointLocked(true);
+    log.close();
+    tree.close(ok);
+}
+
+bool DurableBigTree::search(int k) {
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    return tree.search(k);
+}
+
+/* Hay que hacer un checkpoint si paso el intervalo o si las paginas sucias ocupan la mitad del pool */
+bool DurableBigTree::needsCheckpoint() {
+    BufferPool& pool = tree.bufferPool();
+    return ops_since_checkpoint >= checkpoint_every || pool.dirtyCount() * 2 >= pool.frameCount();
+}
+
+/*
+ * El orden importa: primero el log tiene que estar en disco hasta el ultimo registro aplicado,
+ * luego se escribe el arbol (de forma atomica) con ese LSN y recien ahi se puede vaciar el log.
+ */
+bool DurableBigTree::checkpointLocked(bool truncate_log) {
+    unsigned long long lsn = log.sync();
+    //Si el log fallo hay operaciones en el arbol que no se confirmaron: no se deben escribir
+    if (log.hasFailed())
+        return false;
+    tree.setCheckpointLSN(lsn);
+    if (!tree.flush())
+        return false;
+    ops_since_checkpoint = 0;
+    checkpoints++;
+    return truncate_log ? log.reset() : true;
+}
+
+bool DurableBigTree::checkpoint() {
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    return checkpointLocked(true);
+}
+
+/*
+ * El registro se agrega al log con el candado del arbol tomado, asi el orden del log es el mismo
+ * en el que se aplicaron las operaciones. La espera a que sea durable se hace sin el candado para
+ * que otros hilos puedan sumar sus registros al mismo grupo.
+ */
+bool DurableBigTree::insert(int k, bool wait_durable) {
+    unsigned long long lsn;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        if (!tree.insert(k))
+            return false;
+        lsn = log.append(LOG_INSERT, k);
+        ops_since_checkpoint++;
+        if (needsCheckpoint())
+            checkpointLocked(true);
+    }
+    return wait_durable ? log.waitDurable(lsn) : true;
+}
+
+bool DurableBigTree::remove(int k, bool wait_durable) {
+    unsigned long long lsn;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        if (!tree.remove(k))
+            return false;
+        lsn = log.append(LOG_REMOVE, k);
+        ops_since_checkpoint++;
+        if (needsCheckpoint())
+            checkpointLocked(true);
+    }
+    return wait_durable ? log.waitDurable(lsn) : true;
+}
@@ -0,0 +1,74 @@
+#ifndef DURABLEBIGTREE_H
+#define	DURABLEBIGTREE_H
+
+/*
+ * PagedBigTree que sobrevive a una caida.
+ *
+ *      1) Cada insercion o eliminacion se aplica al arbol y se registra en el log (<archivo>.wal).
+ *         La operacion se confirma cuando su registro es durable (confirmacion en grupo, ver WriteAheadLog).
+ *      2) Las paginas del arbol solo se escriben en un checkpoint (el buffer pool no desaloja paginas
+ *         sucias). Un checkpoint escribe todas las paginas sucias de forma atomica junto con el LSN del
+ *         ultimo registro incluido y luego vacia el log.
+ *      3) Al abrir se aplican los registros del log con LSN mayor al del ultimo checkpoint. Insertar
+ *         o eliminar una llave dos veces da el mismo resultado, asi que repetir un registro no es un problema.
+ *
+ * Los checkpoints se hacen solos cada 'checkpoint_every' operaciones o cuando la mitad del buffer
+ * pool tiene paginas sucias. Los metodos se pueden llamar desde varios hilos.
+ */
+#include "PagedBigTree.h"
+#include "WriteAheadLog.h"
+#include <string>
+#include <mutex>
+
+class DurableBigTree {
+private:
+    PagedBigTree tree;
+    WriteAheadLog log;
+    std::mutex tree_mutex; // Protege al arbol y el orden de los registros en el log
+    unsigned long long checkpoint_every;
+    unsigned long long ops_since_checkpoint;
+    unsigned long long checkpoints;
+
+    bool needsCheckpoint();
+    bool checkpointLocked(bool truncate_log);
+
+public:
+    DurableBigTree(int page_size = 4096, size_t cache_bytes = 64 << 20,
+            int commit_delay_us = 0, unsigned long long _checkpoint_every = 1000000);
+    ~DurableBigTree();
+
+    // Abre el arbol (<path>) y su log (<path>.wal) y recupera las operaciones que no llegaron al checkpoint
+    bool open(const char* path);
+
+    // Hace un checkpoint y cierra los archivos
+    void close();
+
+    bool search(int k);
+
+    /* Inserta una llave. Si 'wait_durable' es false retorna sin esperar a que el registro
+     * llegue a disco (se puede perder si hay una caida antes del siguiente grupo). Retorna false si
+     * ya existia o si hubo un error (ver ioFailed) */
+    bool insert(int k, bool wait_durable = true);
+
+    bool remove(int k, bool wait_durable = true);
+
+    // Escribe el arbol al archivo y vacia el log
+    bool checkpoint();
+
+    /* El arbol tuvo un error de E/S (ver PagedBigTree::ioFailed). Lo que no llego a un checkpoint
+     * sigue en el log y se recupera al volver a abrir */
+    bool ioFailed() {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        return tree.ioFailed();
+    }
+
+    unsigned long long checkpointCount() const {
+        return checkpoints;
+    }
+
+    unsigned long long logSyncCount() {
+        return log.syncCount();
+    }
+};
+
+#endif	/* DURABLEBIGTREE_H */
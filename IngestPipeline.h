@@ -0,0 +1,360 @@
+#ifndef INGESTPIPELINE_H
+#define	INGESTPIPELINE_H
+
+/*
+ * Etapa de ingreso delante de un arbol: muchos hilos mandan llaves de una en una y un solo hilo
+ * las aplica al arbol por lotes ordenados.
+ *
+ *      1) Cada productor tiene su propio buffer circular (IngestRing) del que solo el escribe y solo
+ *         el consumidor lee, asi push() no usa candados ni instrucciones atomicas de lectura-escritura:
+ *         solo escribe el mensaje y publica la nueva cola.
+ *      2) El hilo consumidor vacia todos los buffers en un lote. Cuando el lote llega a 'max_batch'
+ *         mensajes o el mas viejo lleva 'max_delay_us' microsegundos esperando, lo ordena por llave,
+ *         se queda con el ultimo mensaje de cada llave y lo aplica: con insertBatch/removeBatch si el
+ *         arbol los tiene (BigTree: cada nodo se visita una vez por lote) o si no llave por llave en
+ *         orden, que recorre el arbol casi por el mismo camino.
+ *      3) "Ultimo" es por numero de secuencia: cada mensaje toma un numero de un contador global al
+ *         entrar al buffer. Si un envio ocurre antes que otro (del mismo hilo, o de otro hilo que se
+ *         sincronizo despues del primer envio) tiene un numero menor y el segundo gana aunque esten
+ *         en buffers distintos. Para que los dos caigan en el mismo lote, antes de aplicar se vacian
+ *         los buffers otra vez: lo que ocurrio antes de un mensaje ya visto ya esta publicado en esa
+ *         segunda pasada, y lo que aparece ahi con un numero mayor a todos los ya vistos se deja para
+ *         el siguiente lote. Dos envios a la misma llave que ocurren a la vez quedan en cualquier orden.
+ *      4) Si el buffer de un productor esta lleno push() espera a que el consumidor lo vacie
+ *         (contrapresion): los productores no pueden adelantarse mas que la capacidad del buffer.
+ *
+ * Mientras un mensaje esta en un buffer o en el lote no se ve en el arbol; flush() espera a que todo
+ * lo que se mando antes de llamarlo este aplicado. Para leer el arbol desde otros hilos se usa
+ * withSet(), que bloquea al consumidor mientras tanto.
+ */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "OrderedSet.h"
+
+/* Mensaje en un buffer: la operacion y su numero de secuencia global */
+struct IngestMessage {
+    int key;
+    bool insert;
+    unsigned long long seq;
+};
+
+/* Buffer circular de un productor y un consumidor */
+class IngestRing {
+private:
+    std::vector<IngestMessage> slots;
+    size_t mask; // Capacidad - 1 (la capacidad es potencia de 2)
+    std::atomic<unsigned long long>* sequence; // Contador compartido por todos los buffers
+
+    alignas(64) std::atomic<size_t> tail; // Siguiente lugar a escribir (solo el productor lo cambia)
+    size_t cached_head; // Ultimo 'head' que vio el productor
+    alignas(64) std::atomic<size_t> head; // Siguiente lugar a leer (solo el consumidor lo cambia)
+    alignas(64) std::atomic<unsigned long long> stalls; // Veces que push() encontro el buffer lleno
+
+public:
+    IngestRing(size_t capacity, std::atomic<unsigned long long>* _sequence) {
+        sequence = _sequence;
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+        tail.store(0);
+        head.store(0);
+        cached_head = 0;
+        stalls.store(0);
+    }
+
+    /* Retorna false si el buffer esta lleno. El numero de secuencia se toma cuando hay lugar (basta un
+     fetch_add relajado: si un envio ocurre antes que otro su numero es menor) */
+    bool tryPush(const TreeMessage& message) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head > mask)
+                return false;
+        }
+        IngestMessage& slot = slots[t & mask];
+        slot.key = message.key;
+        slot.insert = message.insert;
+        slot.seq = sequence->fetch_add(1, std::memory_order_relaxed);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Espera (cediendo el cpu) hasta que haya lugar
+    void push(const TreeMessage& message) {
+        if (tryPush(message))
+            return;
+        stalls.fetch_add(1, std::memory_order_relaxed);
+        while (!tryPush(message))
+            std::this_thread::yield();
+    }
+
+    // Pasa a 'out' lo que hay en el buffer. Retorna cuantos mensajes saco
+    size_t drain(std::vector<IngestMessage>& out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        for (size_t i = h; i != t; i++)
+            out.push_back(slots[i & mask]);
+        head.store(t, std::memory_order_release);
+        return t - h;
+    }
+
+    unsigned long long stallCount() const {
+        return stalls.load(std::memory_order_relaxed);
+    }
+};
+
+/* Lo que hizo el consumidor (ver IngestPipeline::stats) */
+struct IngestStats {
+    unsigned long long received; // Mensajes que saco de los buffers
+    unsigned long long applied; // Llaves aplicadas al arbol (sin repetidas dentro de un lote)
+    unsigned long long batches;
+    unsigned long long stalls; // Veces que un productor espero por un buffer lleno
+};
+
+template<OrderedSet Set>
+class IngestPipeline {
+public:
+    static const int MAX_PRODUCERS = 256;
+
+    /* Productor: lo usa un solo hilo. Vive hasta que se destruye el pipeline */
+    class Producer {
+    private:
+        IngestRing ring;
+
+        Producer(size_t capacity, std::atomic<unsigned long long>* sequence) : ring(capacity, sequence) {
+        }
+
+        friend class IngestPipeline;
+
+    public:
+        void insert(int k) {
+            ring.push(TreeMessage{k, true});
+        }
+
+        void erase(int k) {
+            ring.push(TreeMessage{k, false});
+        }
+
+        // Sin esperar: retorna false si el buffer esta lleno
+        bool tryInsert(int k) {
+            return ring.tryPush(TreeMessage{k, true});
+        }
+
+        bool tryErase(int k) {
+            return ring.tryPush(TreeMessage{k, false});
+        }
+    };
+
+private:
+    Set set;
+    std::mutex set_lock; // El consumidor lo tiene mientras aplica un lote
+
+    Producer *producers[MAX_PRODUCERS];
+    std::atomic<int> producer_count;
+    std::atomic<unsigned long long> sequence; // Siguiente numero de secuencia (ver IngestRing::tryPush)
+    std::mutex producers_lock; // Solo para agregar productores
+    size_t ring_capacity;
+
+    size_t max_batch;
+    std::chrono::microseconds max_delay;
+
+    // flush(): cada pedido tiene un numero; el consumidor avisa hasta cual numero ya vacio todo
+    std::mutex flush_lock;
+    std::condition_variable flush_changed;
+    unsigned long long flush_requested;
+    unsigned long long flush_done;
+    bool stop;
+
+    std::atomic<unsigned long long> received, applied, batches;
+    std::thread consumer;
+
+    // Saca los mensajes de todos los buffers. Retorna cuantos saco
+    size_t drainAll(std::vector<IngestMessage>& batch) {
+        size_t count = 0;
+        int producers_now = producer_count.load(std::memory_order_acquire);
+        for (int i = 0; i < producers_now; i++)
+            count += producers[i]->ring.drain(batch);
+        received.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    /* Vacia los buffers otra vez, ordena el lote por llave y numero de secuencia y aplica el mensaje
+     de mayor numero de cada llave. Los mensajes de la segunda pasada con numero mayor a todos los
+     que ya se tenian quedan en 'batch' para el siguiente lote (ver 3 arriba) */
+    void apply(std::vector<IngestMessage>& batch, std::vector<IngestMessage>& later,
+            std::vector<int>& inserts, std::vector<int>& erases) {
+        unsigned long long limit = 0;
+        for (size_t i = 0; i < batch.size(); i++)
+            limit = std::max(limit, batch[i].seq);
+        drainAll(batch);
+        std::sort(batch.begin(), batch.end(), [](const IngestMessage& a, const IngestMessage & b) {
+            return a.key != b.key ? a.key < b.key : a.seq < b.seq;
+        });
+        inserts.clear();
+        erases.clear();
+        later.clear();
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (batch[i].seq > limit) {
+                later.push_back(batch[i]);
+                continue;
+            }
+            if (i + 1 < batch.size() && batch[i + 1].key == batch[i].key && batch[i + 1].seq <= limit)
+                continue;
+            if (batch[i].insert)
+                inserts.push_back(batch[i].key);
+            else
+                erases.push_back(batch[i].key);
+        }
+        {
+            std::lock_guard<std::mutex> guard(set_lock);
+            if constexpr (requires(Set & s, std::vector<int>& keys) {
+                    s.engine().insertBatch(keys);
+                    s.engine().removeBatch(keys);
+                }) {
+                if (!erases.empty())
+                    set.engine().removeBatch(erases);
+                if (!inserts.empty())
+                    set.engine().insertBatch(inserts);
+            } else {
+                for (size_t i = 0; i < erases.size(); i++)
+                    set.erase(erases[i]);
+                for (size_t i = 0; i < inserts.size(); i++)
+                    set.insert(inserts[i]);
+            }
+        }
+        applied.fetch_add(inserts.size() + erases.size(), std::memory_order_relaxed);
+        batches.fetch_add(1, std::memory_order_relaxed);
+        batch.swap(later);
+    }
+
+    void consume() {
+        std::vector<IngestMessage> batch, later;
+        std::vector<int> inserts, erases;
+        std::chrono::steady_clock::time_point oldest; // Cuando llego el primer mensaje del lote
+        // Sin mensajes el consumidor duerme; los productores no lo despiertan, asi que revisa cada tanto
+        std::chrono::microseconds idle = std::max(std::chrono::microseconds(10),
+                std::min(max_delay / 4, std::chrono::microseconds(1000)));
+        while (true) {
+            unsigned long long request;
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> guard(flush_lock);
+                request = flush_requested;
+                stopping = stop;
+            }
+            bool was_empty = batch.empty();
+            size_t got = drainAll(batch);
+            if (was_empty && got > 0)
+                oldest = std::chrono::steady_clock::now();
+
+            bool flushing = request > flush_done || stopping;
+            if (!batch.empty() && (flushing || batch.size() >= max_batch
+                    || std::chrono::steady_clock::now() - oldest >= max_delay)) {
+                apply(batch, later, inserts, erases);
+                if (!batch.empty())
+                    oldest = std::chrono::steady_clock::now(); // Lo que quedo para el siguiente lote
+            }
+
+            if (flushing) {
+                // Todo lo que se mando antes del pedido ya estaba en los buffers en la primera pasada,
+                // asi que nada de eso quedo para el siguiente lote
+                std::lock_guard<std::mutex> guard(flush_lock);
+                flush_done = request;
+                flush_changed.notify_all();
+                if (stopping && batch.empty())
+                    return;
+                continue;
+            }
+            if (got == 0) {
+                std::unique_lock<std::mutex> guard(flush_lock);
+                flush_changed.wait_for(guard, idle, [this] {
+                    return flush_requested > flush_done || stop;
+                });
+            }
+        }
+    }
+
+public:
+    /* 'ring_capacity' mensajes por productor, lotes de hasta 'max_batch' mensajes y un mensaje no
+     espera mas de 'max_delay_us' microseconds en el lote (mas lo que tarde el consumidor en verlo).
+     Los demas argumentos son los del constructor de Set */
+    template<class... Args>
+    IngestPipeline(size_t _ring_capacity, size_t _max_batch, long long max_delay_us, Args... args) : set(args...) {
+        ring_capacity = _ring_capacity;
+        max_batch = _max_batch > 0 ? _max_batch : 1;
+        max_delay = std::chrono::microseconds(max_delay_us > 0 ? max_delay_us : 0);
+        producer_count.store(0);
+        sequence.store(0);
+        flush_requested = 0;
+        flush_done = 0;
+        stop = false;
+        received.store(0);
+        applied.store(0);
+        batches.store(0);
+        consumer = std::thread(&IngestPipeline::consume, this);
+    }
+
+    // Aplica lo que falta y detiene al consumidor. Los productores tienen que haber terminado
+    ~IngestPipeline() {
+        {
+            std::lock_guard<std::mutex> guard(flush_lock);
+            stop = true;
+        }
+        flush_changed.notify_all();
+        consumer.join();
+        for (int i = 0; i < producer_count.load(); i++)
+            delete producers[i];
+    }
+
+    IngestPipeline(const IngestPipeline&) = delete;
+    IngestPipeline& operator=(const IngestPipeline&) = delete;
+
+    /* Productor nuevo (uno por hilo que manda llaves). NULL si ya hay MAX_PRODUCERS */
+    Producer *addProducer() {
+        std::lock_guard<std::mutex> guard(producers_lock);
+        int count = producer_count.load(std::memory_order_relaxed);
+        if (count == MAX_PRODUCERS)
+            return NULL;
+        producers[count] = new Producer(ring_capacity, &sequence);
+        producer_count.store(count + 1, std::memory_order_release);
+        return producers[count];
+    }
+
+    // Espera a que todo lo que se mando antes de llamarla este en el arbol
+    void flush() {
+        std::unique_lock<std::mutex> guard(flush_lock);
+        unsigned long long ticket = ++flush_requested;
+        flush_changed.notify_all();
+        flush_changed.wait(guard, [this, ticket] {
+            return flush_done >= ticket;
+        });
+    }
+
+    /* Llama a operation(set) sin que el consumidor modifique el arbol mientras tanto. Solo ve lo que
+     ya se aplico (ver flush) */
+    template<class Operation>
+    void withSet(Operation operation) {
+        std::lock_guard<std::mutex> guard(set_lock);
+        operation(set);
+    }
+
+    IngestStats stats() {
+        IngestStats result;
+        result.received = received.load();
+        result.applied = applied.load();
+        result.batches = batches.load();
+        result.stalls = 0;
+        for (int i = 0; i < producer_count.load(); i++)
+            result.stalls += producers[i]->ring.stallCount();
+        return result;
+    }
+};
+
+#endif	/* INGESTPIPELINE_H */
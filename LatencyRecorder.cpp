@@ -0,0 +1,106 @@
+#include "LatencyRecorder.h"
+#include <string.h>
+
+/* Ciclos del TSC contra el reloj del sistema durante unos 20ms */
+static double measureNsPerTick() {
+#ifdef LATENCY_HAS_TSC
+    unsigned long long ns0 = TscClock::nowNs(), ticks0 = TscClock::start();
+    unsigned long long ns1;
+    do {
+        ns1 = TscClock::nowNs();
+    } while (ns1 - ns0 < 20000000ULL);
+    unsigned long long ticks1 = TscClock::stop();
+    return ticks1 > ticks0 ? (double) (ns1 - ns0) / (ticks1 - ticks0) : 1;
+#else
+    return 1;
+#endif
+}
+
+double TscClock::nsPerTick() {
+    static const double ns_per_tick = measureNsPerTick();
+    return ns_per_tick;
+}
+
+unsigned long long LatencyHistogram::bucketHigh(int index) {
+    if (index < SUB_BUCKETS)
+        return index;
+    int shift = (index - SUB_BUCKETS) / HALF + 1;
+    unsigned long long mantissa = (index - SUB_BUCKETS) % HALF + HALF;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+unsigned long long LatencyHistogram::percentile(double p) const {
+    if (total == 0)
+        return 0;
+    unsigned long long rank = (unsigned long long) (p * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            unsigned long long high = bucketHigh(i);
+            return high < max_value ? high : max_value;
+        }
+    }
+    return max_value;
+}
+
+/* Con el punto medio de cada cubeta */
+double LatencyHistogram::mean() const {
+    if (total == 0)
+        return 0;
+    double sum = 0;
+    for (int i = 0; i < BUCKETS; i++)
+        if (counts[i] != 0) {
+            unsigned long long low = i == 0 ? 0 : bucketHigh(i - 1) + 1;
+            sum += counts[i] * ((low + bucketHigh(i)) / 2.0);
+        }
+    return sum / total;
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other) {
+    for (int i = 0; i < BUCKETS; i++)
+        counts[i] += other.counts[i];
+    total += other.total;
+    if (other.max_value > max_value)
+        max_value = other.max_value;
+}
+
+void LatencyHistogram::clear() {
+    memset(counts, 0, sizeof (counts));
+    total = 0;
+    max_value = 0;
+}
+
+LatencyRecorder::LatencyRecorder(unsigned int _sample_every) {
+    sample_every = _sample_every > 0 ? _sample_every : 1;
+    random = 0x9e3779b9U;
+    clear();
+}
+
+void LatencyRecorder::clear() {
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        histograms[op].clear();
+        operations[op] = 0;
+    }
+    nextSample();
+}
+
+void LatencyRecorder::writeJson(FILE *out) const {
+    static const char *names[LATENCY_OPS] = {"insert", "erase", "lookup"};
+    static const double percentiles[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+    static const char *percentile_names[] = {"p50", "p90", "p99", "p999", "p9999"};
+    double ns = TscClock::nsPerTick();
+
+    fprintf(out, "{");
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        const LatencyHistogram& h = histograms[op];
+        fprintf(out, "%s\"%s\": {\"ops\": %llu, \"sampled\": %llu, \"mean_ns\": %.1f", op > 0 ? ", " : "",
+                names[op], operations[op], h.count(), h.mean() * ns);
+        for (int p = 0; p < 5; p++)
+            fprintf(out, ", \"%s_ns\": %.0f", percentile_names[p], h.percentile(percentiles[p]) * ns);
+        fprintf(out, ", \"max_ns\": %.0f}", h.max() * ns);
+    }
+    fprintf(out, "}\n");
+}
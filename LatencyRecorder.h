@@ -0,0 +1,176 @@
+#ifndef LATENCYRECORDER_H
+#define	LATENCYRECORDER_H
+
+/*
+ * Histogramas de latencia por tipo de operacion (insert, erase, lookup).
+ *
+ * LatencyHistogram es un histograma al estilo HDR: los valores menores que 128 tienen cada uno su
+ * cubeta y de ahi para arriba cada potencia de 2 se divide en 64 cubetas, asi el error relativo de
+ * un percentil es menor que 1/64 (1.6%) desde unos pocos ciclos hasta horas, con memoria fija
+ * (unos 21KB) y registrar un valor es solo calcular un indice y sumar 1.
+ *
+ * El tiempo se mide con el contador de ciclos del procesador (TSC, rdtsc), que cuesta unos pocos
+ * nanosegundos en vez de una llamada a clock_gettime. TscClock lo convierte a nanosegundos
+ * midiendo una vez cuantos ciclos hay por nanosegundo.
+ *
+ * LatencyRecorder mide solo 1 de cada N operaciones (en promedio, con una distancia al azar entre una
+ * y otra para no sincronizarse con patrones de la carga): las demas solo pagan un decremento. Con
+ * N = 1 se mide todo. Un recorder se usa desde un solo hilo (uno por arbol, ver TimedSet).
+ */
+#include <stdio.h>
+#include <time.h>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LATENCY_HAS_TSC 1
+#endif
+
+class TscClock {
+public:
+    // Lectura al empezar: las instrucciones anteriores terminan antes de leer el contador
+    static unsigned long long start() {
+#ifdef LATENCY_HAS_TSC
+        _mm_lfence();
+        return __rdtsc();
+#else
+        return nowNs();
+#endif
+    }
+
+    // Lectura al terminar: rdtscp espera a que termine la operacion medida
+    static unsigned long long stop() {
+#ifdef LATENCY_HAS_TSC
+        unsigned int cpu;
+        unsigned long long ticks = __rdtscp(&cpu);
+        _mm_lfence();
+        return ticks;
+#else
+        return nowNs();
+#endif
+    }
+
+    // Nanosegundos por ciclo (se mide la primera vez que se llama, tarda unos 20ms)
+    static double nsPerTick();
+
+    static unsigned long long nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+};
+
+class LatencyHistogram {
+private:
+    static const int SUB_BITS = 7;
+    static const int SUB_BUCKETS = 1 << SUB_BITS; // Valores exactos: 0..127
+    static const int HALF = SUB_BUCKETS / 2; // Cubetas por potencia de 2 arriba de eso
+    static const int MAX_SHIFT = 40; // Hasta 2^47 ciclos (horas); lo mas grande cae en la ultima cubeta
+    static const int BUCKETS = SUB_BUCKETS + MAX_SHIFT * HALF;
+
+    unsigned long long counts[BUCKETS];
+    unsigned long long total;
+    unsigned long long max_value;
+
+    static int bucketOf(unsigned long long value) {
+        if (value < (unsigned long long) SUB_BUCKETS)
+            return (int) value;
+        int shift = 63 - __builtin_clzll(value) - (SUB_BITS - 1); // Quedan 7 bits: 64..127
+        if (shift > MAX_SHIFT)
+            return BUCKETS - 1;
+        return SUB_BUCKETS + (shift - 1) * HALF + (int) (value >> shift) - HALF;
+    }
+
+    // Mayor valor que cae en la cubeta
+    static unsigned long long bucketHigh(int index);
+
+public:
+    LatencyHistogram() {
+        clear();
+    }
+
+    void record(unsigned long long value) {
+        counts[bucketOf(value)]++;
+        total++;
+        if (value > max_value)
+            max_value = value;
+    }
+
+    unsigned long long count() const {
+        return total;
+    }
+
+    unsigned long long max() const {
+        return max_value;
+    }
+
+    // Valor debajo del cual (o igual) queda la fraccion 'p' de los valores, p entre 0 y 1
+    unsigned long long percentile(double p) const;
+
+    double mean() const;
+
+    void add(const LatencyHistogram& other);
+    void clear();
+};
+
+enum LatencyOp {
+    LATENCY_INSERT, LATENCY_ERASE, LATENCY_LOOKUP, LATENCY_OPS
+};
+
+class LatencyRecorder {
+private:
+    LatencyHistogram histograms[LATENCY_OPS]; // En ciclos del TSC
+    unsigned long long operations[LATENCY_OPS]; // Todas las operaciones, medidas o no
+    unsigned int sample_every;
+    unsigned int countdown; // Operaciones que faltan para la siguiente medicion
+    unsigned int random; // xorshift32
+
+    void nextSample() {
+        if (sample_every <= 1) {
+            countdown = 1;
+            return;
+        }
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        countdown = 1 + random % (2 * sample_every - 1); // Promedio: sample_every
+    }
+
+public:
+    // Mide 1 de cada 'sample_every' operaciones
+    LatencyRecorder(unsigned int _sample_every = 1);
+
+    /* Corre operation() y, si le toca, registra cuanto tardo. Retorna lo que retorna operation() */
+    template<class Operation>
+    auto measure(LatencyOp op, Operation operation) -> decltype(operation()) {
+        operations[op]++;
+        if (--countdown != 0)
+            return operation();
+        nextSample();
+        unsigned long long t0 = TscClock::start();
+        if constexpr (std::is_void_v<decltype(operation())>) {
+            operation();
+            histograms[op].record(TscClock::stop() - t0);
+        } else {
+            auto result = operation();
+            histograms[op].record(TscClock::stop() - t0);
+            return result;
+        }
+    }
+
+    const LatencyHistogram& histogram(LatencyOp op) const {
+        return histograms[op];
+    }
+
+    unsigned long long operationCount(LatencyOp op) const {
+        return operations[op];
+    }
+
+    void clear();
+
+    /* Escribe un objeto JSON con los percentiles en nanosegundos de cada tipo de operacion:
+     {"insert": {"ops": .., "sampled": .., "mean_ns": .., "p50_ns": .., "p90_ns": .., "p99_ns": ..,
+     "p999_ns": .., "p9999_ns": .., "max_ns": ..}, "erase": {..}, "lookup": {..}} */
+    void writeJson(FILE *out) const;
+};
+
+#endif	/* LATENCYRECORDER_H */
@@ -0,0 +1,164 @@
+#include "NodeArena.h"
+#include <new>
+#include <stdio.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Politica de mbind (de <numaif.h>, que no siempre esta instalado)
+#define ARENA_MPOL_PREFERRED 1
+
+NodeArena::NodeArena(int _numa_node, bool huge_pages) {
+    numa_node = _numa_node;
+    try_huge_pages = huge_pages;
+    huge_chunks = 0;
+    next = NULL;
+    end = NULL;
+    used = 0;
+}
+
+NodeArena::~NodeArena() {
+    for (size_t i = 0; i < chunks.size(); i++)
+        munmap(chunks[i], CHUNK_BYTES);
+}
+
+/*
+ * Un bloque de 2MB alineado a 2MB. Sin huge pages reservadas se pide el doble de memoria y se
+ * recorta lo que sobra a los lados, porque el kernel solo junta en una huge page un rango alineado.
+ */
+char *NodeArena::newChunk() {
+    void *memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (try_huge_pages) {
+        memory = mmap(NULL, CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory == MAP_FAILED)
+            try_huge_pages = false; // No hay huge pages libres: no se vuelve a intentar en cada bloque
+        else
+            huge_chunks++;
+    }
+#endif
+    if (memory == MAP_FAILED) {
+        char *raw = (char*) mmap(NULL, 2 * CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            throw std::bad_alloc();
+        char *aligned = (char*) (((size_t) raw + CHUNK_BYTES - 1) & ~(CHUNK_BYTES - 1));
+        if (aligned > raw)
+            munmap(raw, aligned - raw);
+        munmap(aligned + CHUNK_BYTES, raw + 2 * CHUNK_BYTES - (aligned + CHUNK_BYTES));
+        memory = aligned;
+#ifdef MADV_HUGEPAGE
+        madvise(memory, CHUNK_BYTES, MADV_HUGEPAGE);
+#endif
+    }
+
+    //La politica se pone antes de tocar la memoria: las paginas se asignan al primer acceso
+#ifdef SYS_mbind
+    if (numa_node >= 0 && numa_node < 64) {
+        unsigned long mask = 1UL << numa_node;
+        syscall(SYS_mbind, memory, CHUNK_BYTES, ARENA_MPOL_PREFERRED, &mask, 64 + 1, 0);
+    }
+#endif
+    chunks.push_back((char*) memory);
+    return (char*) memory;
+}
+
+void *NodeArena::allocate(size_t bytes) {
+    if (bytes > MAX_PIECE)
+        return ::operator new(bytes);
+    size_t size_class = (bytes + 15) / 16;
+    bytes = size_class * 16;
+
+    std::lock_guard<std::mutex> guard(lock);
+    used += bytes;
+    if (size_class < free_lists.size() && free_lists[size_class] != NULL) {
+        void *piece = free_lists[size_class];
+        free_lists[size_class] = *(void**) piece;
+        return piece;
+    }
+    if (next == NULL || (size_t) (end - next) < bytes) {
+        next = newChunk();
+        end = next + CHUNK_BYTES;
+    }
+    void *piece = next;
+    next += bytes;
+    return piece;
+}
+
+void NodeArena::deallocate(void *p, size_t bytes) {
+    if (p == NULL)
+        return;
+    if (bytes > MAX_PIECE) {
+        ::operator delete(p);
+        return;
+    }
+    size_t size_class = (bytes + 15) / 16;
+
+    std::lock_guard<std::mutex> guard(lock);
+    used -= size_class * 16;
+    if (size_class >= free_lists.size())
+        free_lists.resize(size_class + 1, NULL);
+    *(void**) p = free_lists[size_class];
+    free_lists[size_class] = p;
+}
+
+NodeArena *NodeArena::forNumaNode(int node) {
+    static std::mutex arenas_lock;
+    static std::vector<NodeArena*> arenas;
+
+    if (node < 0)
+        node = currentNumaNode();
+    std::lock_guard<std::mutex> guard(arenas_lock);
+    if (arenas.empty())
+        arenas.resize(numaNodes(), NULL);
+    if (node >= (int) arenas.size())
+        node = 0;
+    if (arenas[node] == NULL)
+        arenas[node] = new NodeArena(arenas.size() > 1 ? node : -1);
+    return arenas[node];
+}
+
+/* Los nodos aparecen como /sys/devices/system/node/node0, node1, ... */
+int NodeArena::numaNodes() {
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir == NULL)
+        return 1;
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int id;
+        if (sscanf(entry->d_name, "node%d", &id) == 1 && id + 1 > count)
+            count = id + 1;
+    }
+    closedir(dir);
+    return count > 0 ? count : 1;
+}
+
+int NodeArena::currentNumaNode() {
+#ifdef SYS_getcpu
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return (int) node;
+#endif
+    return 0;
+}
+
+size_t NodeArena::chunkCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    return chunks.size();
+}
+
+size_t NodeArena::hugePageChunks() {
+    std::lock_guard<std::mutex> guard(lock);
+    return huge_chunks;
+}
+
+size_t NodeArena::usedBytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return used;
+}
+
+size_t NodeArena::reservedBytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return chunks.size() * CHUNK_BYTES;
+}
@@ -0,0 +1,91 @@
+#ifndef NODEARENA_H
+#define	NODEARENA_H
+
+/*
+ * Arena de memoria para los nodos de los arboles (AVL, Rojo-Negro y Big-Tree).
+ *
+ * Con el heap normal cada nodo queda en cualquier pagina de 4K: un arbol grande usa muchas mas
+ * paginas que entradas tiene la TLB y casi cada nodo que se visita es un fallo de TLB. El arena
+ * pide la memoria en bloques de 2MB y corta los nodos de ahi:
+ *      1) Primero intenta con huge pages de 2MB (MAP_HUGETLB): un bloque es una sola entrada de TLB.
+ *      2) Si el sistema no tiene huge pages reservadas usa paginas normales y le pide al kernel
+ *         que las junte en huge pages cuando pueda (transparent huge pages, MADV_HUGEPAGE).
+ *      3) Si se pide un nodo NUMA, los bloques se asignan en la memoria de ese nodo (mbind), asi
+ *         un arbol que se usa desde un socket no tiene que ir a la memoria del otro.
+ *
+ * Los pedazos liberados se guardan en una lista por tamanno (de 16 en 16 bytes) y se reusan; los
+ * bloques solo se devuelven al sistema cuando se destruye el arena. El arena tiene que vivir mas
+ * que todos los nodos que salieron de el (arboles y snapshots que lo usan).
+ *
+ * Se puede usar desde varios hilos (un candado protege las listas).
+ */
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+class NodeArena {
+private:
+    static const size_t CHUNK_BYTES = 2 * 1024 * 1024;
+    static const size_t MAX_PIECE = CHUNK_BYTES / 8; // Los pedidos mas grandes van al heap normal
+
+    int numa_node; // Nodo NUMA de la memoria (-1: donde diga el sistema)
+    bool try_huge_pages;
+    std::vector<char*> chunks;
+    size_t huge_chunks; // Bloques que si son huge pages de 2MB
+    char *next; // Lo que falta del bloque actual
+    char *end;
+    std::vector<void*> free_lists; // Pedazos libres por tamanno/16 (lista ligada dentro de los pedazos)
+    size_t used; // Bytes entregados y no liberados
+    std::mutex lock;
+
+    char *newChunk();
+
+public:
+    /* 'numa_node' -1 deja la memoria donde la ponga el sistema. Sin 'huge_pages' los bloques
+     son de paginas normales (igual se cortan en bloques de 2MB) */
+    NodeArena(int _numa_node = -1, bool huge_pages = true);
+    ~NodeArena();
+
+    void *allocate(size_t bytes);
+
+    // 'bytes' tiene que ser el mismo que se pidio en allocate
+    void deallocate(void *p, size_t bytes);
+
+    // Con 'arena' NULL se usa el heap normal
+    static void *allocateIn(NodeArena *arena, size_t bytes) {
+        return arena == NULL ? ::operator new(bytes) : arena->allocate(bytes);
+    }
+
+    static void deallocateIn(NodeArena *arena, void *p, size_t bytes) {
+        if (arena == NULL)
+            ::operator delete(p);
+        else
+            arena->deallocate(p, bytes);
+    }
+
+    /* Arena compartido del nodo NUMA 'node' (-1: el nodo del cpu que llama). Se crea la primera
+     vez que se pide y vive hasta que termina el programa */
+    static NodeArena *forNumaNode(int node = -1);
+
+    // Cantidad de nodos NUMA de la maquina (1 si no se puede saber)
+    static int numaNodes();
+
+    // Nodo NUMA del cpu en el que corre el hilo (0 si no se puede saber)
+    static int currentNumaNode();
+
+    int numaNode() const {
+        return numa_node;
+    }
+
+    // Bloques de 2MB pedidos al sistema y cuantos de ellos son huge pages
+    size_t chunkCount();
+    size_t hugePageChunks();
+
+    // Bytes entregados que no se han liberado
+    size_t usedBytes();
+
+    // Bytes pedidos al sistema
+    size_t reservedBytes();
+};
+
+#endif	/* NODEARENA_H */
@@ -0,0 +1,283 @@
+#include "OpLogReplay.h"
+#include "SnapshotFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char BINARY_MAGIC[8] = {'O', 'P', 'L', 'O', 'G', 'B', 'I', 'N'};
+
+static bool validKind(char kind) {
+    return kind == 'i' || kind == 'd' || kind == 'l';
+}
+
+OpLogReader::OpLogReader() {
+    fd = -1;
+    mapped = NULL;
+    mapped_bytes = 0;
+    binary = false;
+    ready[0] = ready[1] = false;
+    fill = 0;
+    take = 0;
+    done = false;
+    stop = false;
+    bad_records = 0;
+}
+
+OpLogReader::~OpLogReader() {
+    if (parser.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        changed.notify_all();
+        parser.join();
+    }
+    if (mapped != NULL)
+        munmap((void*) mapped, mapped_bytes);
+    if (fd > 0)
+        close(fd);
+}
+
+bool OpLogReader::open(const char *path) {
+    fd = strcmp(path, "-") == 0 ? 0 : ::open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *memory = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED) {
+            mapped = (const char*) memory;
+            mapped_bytes = info.st_size;
+            madvise(memory, mapped_bytes, MADV_SEQUENTIAL);
+        }
+    }
+    batches[0].reserve(BATCH_OPS);
+    batches[1].reserve(BATCH_OPS);
+    parser = std::thread(&OpLogReader::parse, this);
+    return true;
+}
+
+void OpLogReader::parse() {
+    if (mapped != NULL) {
+        const char *p = mapped, *end = mapped + mapped_bytes;
+        binary = mapped_bytes >= sizeof (BINARY_MAGIC) && memcmp(p, BINARY_MAGIC, sizeof (BINARY_MAGIC)) == 0;
+        if (binary)
+            p = parseBinary(p + sizeof (BINARY_MAGIC), end);
+        else
+            p = parseText(p, end, true);
+        if (p != end)
+            bad_records++; // Registro binario incompleto al final
+    } else {
+        // Por bloques: lo que queda sin decodificar al final de un bloque se pasa al inicio del siguiente
+        std::vector<char> buffer(READ_BYTES);
+        size_t have = 0;
+        bool eof = false, first = true;
+        while (!eof) {
+            ssize_t n = read(fd, buffer.data() + have, buffer.size() - have);
+            if (n <= 0)
+                eof = true;
+            else
+                have += n;
+            if (first && have < sizeof (BINARY_MAGIC) && !eof)
+                continue;
+            const char *p = buffer.data();
+            if (first) {
+                binary = have >= sizeof (BINARY_MAGIC) && memcmp(p, BINARY_MAGIC, sizeof (BINARY_MAGIC)) == 0;
+                if (binary)
+                    p += sizeof (BINARY_MAGIC);
+                first = false;
+            }
+            const char *end = buffer.data() + have;
+            p = binary ? parseBinary(p, end) : parseText(p, end, eof);
+            have = end - p;
+            if (have == buffer.size()) {
+                bad_records++; // Una linea mas larga que todo el bloque
+                have = 0;
+            }
+            memmove(buffer.data(), p, have);
+            if (stop)
+                return;
+        }
+        if (have > 0)
+            bad_records++;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (!batches[fill].empty() && !stop)
+        ready[fill] = true;
+    done = true;
+    changed.notify_all();
+}
+
+/* Decodifica las lineas completas que hay entre 'p' y 'end'. Devuelve donde empieza la primera linea
+ incompleta (si 'last' la ultima linea no necesita '\n') */
+const char *OpLogReader::parseText(const char *p, const char *end, bool last) {
+    while (p < end && !stop) {
+        const char *line_end = (const char*) memchr(p, '\n', end - p);
+        if (line_end == NULL) {
+            if (!last)
+                return p;
+            line_end = end;
+        }
+        const char *c = p;
+        p = line_end < end ? line_end + 1 : end;
+
+        while (c < line_end && (*c == ' ' || *c == '\t'))
+            c++;
+        if (c == line_end || *c == '#' || *c == '\r')
+            continue;
+        char kind = *c | 0x20; // Minuscula
+        while (c < line_end && *c != ' ' && *c != '\t')
+            c++;
+        while (c < line_end && (*c == ' ' || *c == '\t'))
+            c++;
+        bool negative = c < line_end && *c == '-';
+        if (negative)
+            c++;
+        const char *digits = c;
+        long long key = 0;
+        while (c < line_end && *c >= '0' && *c <= '9' && key <= 0x80000000LL)
+            key = key * 10 + (*c++ - '0');
+        while (c < line_end && (*c == ' ' || *c == '\t' || *c == '\r'))
+            c++;
+        if (negative)
+            key = -key;
+        if (!validKind(kind) || c == digits || c != line_end || key > 0x7fffffffLL || key < -0x80000000LL)
+            bad_records++;
+        else
+            emit((int) key, kind);
+    }
+    return p;
+}
+
+const char *OpLogReader::parseBinary(const char *p, const char *end) {
+    const unsigned char *r = (const unsigned char*) p;
+    while (end - (const char*) r >= 5 && !stop) {
+        char kind = (char) r[0];
+        unsigned int key = r[1] | (r[2] << 8) | (r[3] << 16) | ((unsigned int) r[4] << 24);
+        if (validKind(kind))
+            emit((int) key, kind);
+        else
+            bad_records++;
+        r += 5;
+    }
+    return (const char*) r;
+}
+
+/* Entrega el lote lleno y espera a que el otro buffer este libre para seguir llenandolo */
+void OpLogReader::publish() {
+    std::unique_lock<std::mutex> guard(lock);
+    ready[fill] = true;
+    changed.notify_all();
+    fill ^= 1;
+    changed.wait(guard, [this] {
+        return !ready[fill] || stop;
+    });
+    batches[fill].clear();
+}
+
+const std::vector<ReplayOp> *OpLogReader::next() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] {
+        return ready[take] || done;
+    });
+    return ready[take] ? &batches[take] : NULL;
+}
+
+void OpLogReader::release() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ready[take] = false;
+        take ^= 1;
+    }
+    changed.notify_all();
+}
+
+static void printStats(const ReplayStats& stats) {
+    long long total = stats.inserts + stats.deletes + stats.lookups;
+    printf("Operaciones: %lld (insert %lld, delete %lld, lookup %lld, encontradas %lld)\n", total,
+            stats.inserts, stats.deletes, stats.lookups, stats.found);
+    printf("Tiempo: %.3f s, %.0f ops/s\n", stats.seconds, stats.seconds > 0 ? total / stats.seconds : 0);
+    if (stats.bad_records > 0)
+        printf("Registros invalidos: %lld\n", stats.bad_records);
+}
+
+/* Abre el snapshot 'load' en 'snapshot' (si hay), reproduce el log en 'set' (que es 'snapshot' o lo
+ envuelve) y guarda las llaves que quedan en el snapshot 'save' (si hay) */
+template<OrderedSet Set, OrderedSet Inner>
+static bool replayInto(OpLogReader& reader, Set& set, SnapshotSet<Inner>& snapshot, const char *load, const char *save) {
+    if (load != NULL && !snapshot.open(load))
+        return false;
+    printStats(replayLog(reader, set));
+    return save == NULL || writeSnapshot(save, snapshot);
+}
+
+/* Reproduce el log en un Set creado con 'args'. Con 'sample_every' > 0 tambien mide la latencia de
+ 1 de cada 'sample_every' operaciones y la escribe en JSON (ver LatencyRecorder) */
+template<OrderedSet Set, class... Args>
+static bool replayWith(OpLogReader& reader, unsigned int sample_every, const char *load, const char *save, Args... args) {
+    if (sample_every == 0) {
+        SnapshotSet<Set> set(args...);
+        return replayInto(reader, set, set, load, save);
+    }
+    TimedSet<SnapshotSet<Set> > set(sample_every, args...);
+    if (!replayInto(reader, set, set.inner(), load, save))
+        return false;
+    printf("Latencia: ");
+    set.latencies().writeJson(stdout);
+    return true;
+}
+
+int replayCommand(int argc, char* argv[]) {
+    const char *path = NULL;
+    const char *engine = "bigtree";
+    int degree = 16;
+    int sample_every = 0;
+    const char *load = NULL;
+    const char *save = NULL;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--replay") == 0)
+            path = argv[i + 1];
+        else if (strcmp(argv[i], "--engine") == 0)
+            engine = argv[i + 1];
+        else if (strcmp(argv[i], "--degree") == 0)
+            degree = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--latency") == 0)
+            sample_every = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--snapshot") == 0)
+            load = argv[i + 1];
+        else if (strcmp(argv[i], "--save-snapshot") == 0)
+            save = argv[i + 1];
+    }
+    if (path == NULL || degree < 2 || sample_every < 0) {
+        printf("Uso: %s --replay <log> [--engine avl|rb|bigtree] [--degree N] [--latency N]\n"
+                "    [--snapshot <archivo>] [--save-snapshot <archivo>]\n", argv[0]);
+        return 1;
+    }
+
+    OpLogReader reader;
+    if (!reader.open(path))
+        return 1;
+    bool ok;
+    if (strcmp(engine, "avl") == 0)
+        ok = replayWith<AVLSet>(reader, sample_every, load, save);
+    else if (strcmp(engine, "rb") == 0)
+        ok = replayWith<RedBlackSet>(reader, sample_every, load, save);
+    else if (strcmp(engine, "bigtree") == 0)
+        ok = replayWith<BigTreeSet>(reader, sample_every, load, save, degree);
+    else {
+        printf("Arbol desconocido: %s (avl, rb o bigtree)\n", engine);
+        return 1;
+    }
+    if (!ok)
+        return 1;
+    if (TreeCounters::enabled())
+        TreeCounters::snapshot().print(stdout);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef OPLOGREPLAY_H
+#define	OPLOGREPLAY_H
+
+/*
+ * Reproduce un log de operaciones (inserciones, eliminaciones y busquedas) sobre uno de los arboles.
+ *
+ * El log puede ser de texto o binario:
+ *      - Texto: una operacion por linea, "i 42", "d 42" o "l 42" (insert, delete, lookup; basta la
+ *        primera letra, "insert 42" tambien sirve). Las lineas vacias o que empiezan con '#' se ignoran.
+ *      - Binario: empieza con los 8 bytes "OPLOGBIN" y sigue con registros de 5 bytes: la operacion
+ *        ('i', 'd' o 'l') y la llave como entero de 32 bits little-endian.
+ *
+ * Un archivo normal se mapea a memoria (mmap) y se lee directo de ahi; si no se puede (una tuberia,
+ * "-" para la entrada estandar) se lee por bloques con read(). No se usa iostream.
+ *
+ * Un hilo decodifica el log y el hilo que llama a replayLog() aplica las operaciones al arbol. Se pasan
+ * de uno a otro en lotes con dos buffers: mientras el arbol aplica un lote el otro hilo llena el
+ * siguiente, asi la lectura del log queda escondida detras del trabajo del arbol.
+ */
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "OrderedSet.h"
+
+struct ReplayOp {
+    int key;
+    char kind; // 'i', 'd' o 'l'
+};
+
+struct ReplayStats {
+    long long inserts;
+    long long deletes;
+    long long lookups;
+    long long found; // Busquedas que encontraron la llave
+    long long bad_records; // Lineas o registros que no se entendieron (no se aplican)
+    double seconds;
+};
+
+class OpLogReader {
+private:
+    static const size_t BATCH_OPS = 65536;
+    static const size_t READ_BYTES = 1 << 20;
+
+    int fd;
+    const char *mapped; // Archivo completo en memoria (NULL si se lee con read)
+    size_t mapped_bytes;
+    bool binary;
+
+    // Doble buffer: el hilo lector llena batches[fill], el que aplica usa batches[take]
+    std::vector<ReplayOp> batches[2];
+    bool ready[2]; // El lote esta lleno y le toca al que aplica
+    int fill;
+    int take;
+    bool done; // El lector ya no va a entregar mas lotes
+    std::atomic<bool> stop; // Se destruye el lector antes de terminar el log
+    long long bad_records;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread parser;
+
+    void parse();
+    const char *parseText(const char *p, const char *end, bool last);
+    const char *parseBinary(const char *p, const char *end);
+
+    void emit(int key, char kind) {
+        std::vector<ReplayOp>& batch = batches[fill];
+        batch.push_back({key, kind});
+        if (batch.size() == BATCH_OPS)
+            publish();
+    }
+    void publish();
+
+public:
+    OpLogReader();
+    ~OpLogReader();
+
+    // Abre el log ("-" es la entrada estandar) y empieza a decodificarlo en otro hilo
+    bool open(const char *path);
+
+    /* Siguiente lote de operaciones, NULL cuando se acaba el log. Hay que devolverlo con release()
+     antes de pedir el siguiente */
+    const std::vector<ReplayOp> *next();
+    void release();
+
+    // Registros que no se entendieron (completo cuando next() ya devolvio NULL)
+    long long badRecords() const {
+        return bad_records;
+    }
+};
+
+/* Aplica todo el log al arbol */
+template<OrderedSet Set>
+ReplayStats replayLog(OpLogReader& reader, Set& set) {
+    ReplayStats stats = {0, 0, 0, 0, 0, 0};
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<ReplayOp> *batch;
+    while ((batch = reader.next()) != NULL) {
+        for (size_t i = 0; i < batch->size(); i++) {
+            const ReplayOp& op = (*batch)[i];
+            if (op.kind == 'i') {
+                set.insert(op.key);
+                stats.inserts++;
+            } else if (op.kind == 'd') {
+                set.erase(op.key);
+                stats.deletes++;
+            } else {
+                stats.found += set.contains(op.key);
+                stats.lookups++;
+            }
+        }
+        reader.release();
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.bad_records = reader.badRecords();
+    return stats;
+}
+
+/* Modo de linea de comandos: avl --replay <log> [--engine avl|rb|bigtree] [--degree N] [--latency N]
+ [--snapshot <archivo>] [--save-snapshot <archivo>]
+ Con --latency se mide la latencia de 1 de cada N operaciones. Con --snapshot el arbol empieza con las
+ llaves de ese snapshot y con --save-snapshot las llaves que quedan se guardan al final (ver SnapshotFile) */
+int replayCommand(int argc, char* argv[]);
+
+#endif	/* OPLOGREPLAY_H */
@@ -0,0 +1,259 @@
+#ifndef ORDEREDSET_H
+#define	ORDEREDSET_H
+
+/*
+ * Interfaz comun de conjunto ordenado de enteros para los tres arboles.
+ *
+ * Cada arbol tiene su propia interfaz (AVLTree son funciones static sobre un AVL*, RedBlack es un
+ * objeto con Insert/Delete y BigTree tiene insert/remove/search), asi que el codigo que los usa
+ * tiene que escribirse para uno en particular. Las clases AVLSet, RedBlackSet y BigTreeSet envuelven
+ * a cada arbol con las mismas operaciones:
+ *      - insert(k): agrega k (si ya estaba no hace nada)
+ *      - erase(k): quita k (si no estaba no hace nada)
+ *      - contains(k): true si k esta
+ *      - lowerBound(k, out): pone en 'out' la menor llave >= k; false si no hay
+ *      - forEach(visitor): llama a visitor(llave) para cada llave, de menor a mayor
+ *
+ * El concepto OrderedSet revisa en tiempo de compilacion que una clase tenga esas operaciones. El
+ * codigo se escribe una vez como template<OrderedSet Set> y se instancia para cada arbol: no hay
+ * funciones virtuales y cada llamada se resuelve (y se puede hacer inline) al compilar.
+ *
+ * Las funciones propias de cada arbol (filtro, snapshots, compact, ...) siguen disponibles con engine().
+ * Los tres tienen ademas bulkLoad(sorted, threads) para armar el arbol de una vez (ver ParallelBuild.h).
+ *
+ * TimedSet<Set> envuelve cualquiera de ellos y mide la latencia de insert, erase y las busquedas
+ * (ver LatencyRecorder), solo en los arboles donde se usa.
+ */
+#include <concepts>
+#include "AVL.h"
+#include "RedBlack.h"
+#include "BigTree.h"
+#include "LatencyRecorder.h"
+
+template<class Set>
+concept OrderedSet = requires(Set& set, int k, int& out, void (*visitor)(int)) {
+    set.insert(k);
+    set.erase(k);
+    { set.contains(k) } -> std::convertible_to<bool>;
+    { set.lowerBound(k, out) } -> std::convertible_to<bool>;
+    set.forEach(visitor);
+};
+
+/* Arbol AVL como conjunto (sin llaves repetidas) */
+class AVLSet {
+private:
+    AVL* root;
+    NodeArena* arena;
+
+    template<class Visitor>
+    static void visit(const AVL* node, Visitor& visitor) {
+        if (node == NULL)
+            return;
+        visit(node->lchild, visitor);
+        visitor(node->key);
+        visit(node->rchild, visitor);
+    }
+
+public:
+    AVLSet(NodeArena* _arena = NULL) {
+        root = NULL;
+        arena = _arena;
+    }
+
+    ~AVLSet() {
+        AVLTree::Destroy(root, arena);
+    }
+
+    AVLSet(const AVLSet&) = delete;
+    AVLSet& operator=(const AVLSet&) = delete;
+
+    void insert(int k) {
+        root = AVLTree::Insert(root, k, arena, true);
+    }
+
+    void erase(int k) {
+        root = AVLTree::Delete(root, k, arena);
+    }
+
+    bool contains(int k) const {
+        return AVLTree::Search(root, k) != NULL;
+    }
+
+    bool lowerBound(int k, int& out) const {
+        const AVL* node = root;
+        const AVL* best = NULL;
+        while (node != NULL) {
+            if (node->key == k) {
+                out = k;
+                return true;
+            }
+            if (k < node->key) {
+                best = node;
+                node = node->lchild;
+            } else
+                node = node->rchild;
+        }
+        if (best == NULL)
+            return false;
+        out = best->key;
+        return true;
+    }
+
+    template<class Visitor>
+    void forEach(Visitor visitor) const {
+        visit(root, visitor);
+    }
+
+    // Reemplaza las llaves por 'sorted' (ordenadas y sin repetir, ver ParallelBuild.h)
+    void bulkLoad(const std::vector<int>& sorted, int threads = 1) {
+        AVLTree::Destroy(root, arena);
+        root = AVLTree::BuildSorted(sorted.data(), sorted.size(), arena, threads);
+    }
+
+    AVL* engine() {
+        return root;
+    }
+};
+
+/* Arbol Rojo-Negro como conjunto */
+class RedBlackSet {
+private:
+    RedBlack tree;
+
+public:
+    RedBlackSet(NodeArena* arena = NULL) : tree(arena) {
+    }
+
+    RedBlackSet(const RedBlackSet&) = delete;
+    RedBlackSet& operator=(const RedBlackSet&) = delete;
+
+    void insert(int k) {
+        tree.Insert(k);
+    }
+
+    void erase(int k) {
+        tree.Delete(k);
+    }
+
+    bool contains(int k) {
+        return tree.Contains(k);
+    }
+
+    bool lowerBound(int k, int& out) {
+        return tree.LowerBound(k, out);
+    }
+
+    template<class Visitor>
+    void forEach(Visitor visitor) {
+        tree.ForEach(visitor);
+    }
+
+    void bulkLoad(const std::vector<int>& sorted, int threads = 1) {
+        tree.BuildSorted(sorted.data(), sorted.size(), threads);
+    }
+
+    RedBlack& engine() {
+        return tree;
+    }
+};
+
+/* Big-Tree como conjunto. Los parametros son los del constructor de BigTree */
+class BigTreeSet {
+private:
+    BigTree tree;
+
+public:
+    BigTreeSet(int degree, bool compress_leaves = false, int buffer_capacity = 0, NodeArena* arena = NULL)
+    : tree(degree, compress_leaves, buffer_capacity, arena) {
+    }
+
+    BigTreeSet(const BigTreeSet&) = delete;
+    BigTreeSet& operator=(const BigTreeSet&) = delete;
+
+    void insert(int k) {
+        tree.insert(k);
+    }
+
+    void erase(int k) {
+        tree.erase(k);
+    }
+
+    bool contains(int k) {
+        return tree.search(k) != NULL;
+    }
+
+    bool lowerBound(int k, int& out) {
+        return tree.lowerBound(k, out);
+    }
+
+    template<class Visitor>
+    void forEach(Visitor visitor) {
+        tree.forEach(visitor);
+    }
+
+    void bulkLoad(const std::vector<int>& sorted, int threads = 1) {
+        tree.bulkLoad(sorted, threads);
+    }
+
+    BigTree& engine() {
+        return tree;
+    }
+};
+
+/* Cualquier conjunto de arriba midiendo la latencia de 1 de cada 'sample_every' operaciones. Los
+ demas argumentos del constructor son los del conjunto envuelto */
+template<OrderedSet Set>
+class TimedSet {
+private:
+    Set set;
+    LatencyRecorder recorder;
+
+public:
+    template<class... Args>
+    TimedSet(unsigned int sample_every, Args... args) : set(args...), recorder(sample_every) {
+    }
+
+    void insert(int k) {
+        recorder.measure(LATENCY_INSERT, [&] {
+            set.insert(k);
+        });
+    }
+
+    void erase(int k) {
+        recorder.measure(LATENCY_ERASE, [&] {
+            set.erase(k);
+        });
+    }
+
+    bool contains(int k) {
+        return recorder.measure(LATENCY_LOOKUP, [&] {
+            return set.contains(k);
+        });
+    }
+
+    bool lowerBound(int k, int& out) {
+        return recorder.measure(LATENCY_LOOKUP, [&] {
+            return set.lowerBound(k, out);
+        });
+    }
+
+    template<class Visitor>
+    void forEach(Visitor visitor) {
+        set.forEach(visitor);
+    }
+
+    LatencyRecorder& latencies() {
+        return recorder;
+    }
+
+    Set& inner() {
+        return set;
+    }
+};
+
+static_assert(OrderedSet<AVLSet>);
+static_assert(OrderedSet<RedBlackSet>);
+static_assert(OrderedSet<BigTreeSet>);
+static_assert(OrderedSet<TimedSet<BigTreeSet>>);
+
+#endif	/* ORDEREDSET_H */
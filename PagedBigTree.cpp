@@ -0,0 +1,598 @@
+#include "PagedBigTree.h"
+#include <string.h>
+#include <assert.h>
+
+#define PAGED_MAGIC 0x45525442 // "BTRE"
+#define PAGED_VERSION 1
+
+/* Encabezado de una pagina de nodo. Despues vienen las llaves y los hijos */
+struct PageHeader {
+    int leaf;
+    int number_keys;
+};
+
+static inline PageHeader* header(char* page) {
+    return (PageHeader*) page;
+}
+
+/* Constructor. El grado es el mayor 't' para el que  encabezado + (2t-1) llaves + 2t hijos  caben en una pagina */
+PagedBigTree::PagedBigTree(int page_size, size_t cache_bytes) : pool(page_size, cache_bytes) {
+    degree = (page_size - sizeof (PageHeader) + sizeof (int)) / (2 * (sizeof (int) + sizeof (page_id)));
+    assert(degree >= 2);
+    memset(&meta, 0, sizeof (meta));
+    meta.root = INVALID_PAGE;
+    meta.free_head = INVALID_PAGE;
+    failed = false;
+}
+
+PagedBigTree::~PagedBigTree() {
+    close();
+}
+
+int* PagedBigTree::keysOf(char* page) {
+    return (int*) (page + sizeof (PageHeader));
+}
+
+page_id* PagedBigTree::childrenOf(char* page) {
+    return (page_id*) (page + sizeof (PageHeader) + (2 * degree - 1) * sizeof (int));
+}
+
+char* PagedBigTree::fetchPage(page_id id) {
+    char* page = pool.fetch(id);
+    if (page == NULL)
+        failed = true;
+    return page;
+}
+
+char* PagedBigTree::appendPage(page_id& id) {
+    char* page = pool.append(id);
+    if (page == NULL)
+        failed = true;
+    return page;
+}
+
+bool PagedBigTree::open(const char* path, bool atomic_flush) {
+    if (!pool.open(path, atomic_flush))
+        return false;
+    failed = false;
+
+    if (pool.pageCount() == 0) {
+        //Archivo nuevo: creamos la pagina de metadatos
+        page_id id;
+        char* page = pool.append(id);
+        if (page == NULL) {
+            pool.close(false);
+            return false;
+        }
+        assert(id == 0);
+        meta.magic = PAGED_MAGIC;
+        meta.version = PAGED_VERSION;
+        meta.page_size = pool.pageSize();
+        meta.degree = degree;
+        meta.root = INVALID_PAGE;
+        meta.free_head = INVALID_PAGE;
+        meta.checkpoint_lsn = 0;
+        memcpy(page, &meta, sizeof (meta));
+        pool.unpin(0, true);
+        return true;
+    }
+
+    char* page = pool.fetch(0);
+    if (page == NULL) {
+        pool.close();
+        return false;
+    }
+    memcpy(&meta, page, sizeof (meta));
+    pool.unpin(0, false);
+
+    if (meta.magic != PAGED_MAGIC || meta.version != PAGED_VERSION ||
+            meta.page_size != pool.pageSize() || meta.degree != degree) {
+        std::cerr << path << ": no es un arbol con este tamanno de pagina" << std::endl;
+        pool.close();
+        return false;
+    }
+    return true;
+}
+
+bool PagedBigTree::writeMeta() {
+    char* page = pool.fetch(0);
+    if (page == NULL)
+        return false;
+    memcpy(page, &meta, sizeof (meta));
+    pool.unpin(0, true);
+    return true;
+}
+
+/* Los metadatos solo se escriben aqui, no en cada cambio de raiz. Si una operacion quedo a medias
+ * no se escribe nada, asi el archivo se queda como en el flush anterior */
+bool PagedBigTree::flush() {
+    if (!pool.isOpen() || failed)
+        return false;
+    return writeMeta() && pool.flush();
+}
+
+void PagedBigTree::close(bool write_back) {
+    if (!pool.isOpen())
+        return;
+    if (write_back)
+        flush();
+    pool.close(write_back && !failed);
+}
+
+/* Reserva una pagina para un nodo nuevo, reutilizando las paginas libres si hay. La pagina queda fija */
+page_id PagedBigTree::allocatePage(char*& page, bool leaf) {
+    page_id id;
+    if (meta.free_head != INVALID_PAGE) {
+        id = meta.free_head;
+        page = fetchPage(id);
+        if (page == NULL)
+            return INVALID_PAGE;
+        meta.free_head = *(page_id*) page;
+    } else {
+        page = appendPage(id);
+        if (page == NULL)
+            return INVALID_PAGE;
+    }
+
+    header(page)->leaf = leaf;
+    header(page)->number_keys = 0;
+    return id;
+}
+
+/* Agrega la pagina a la lista de paginas libres */
+bool PagedBigTree::freePage(page_id id) {
+    char* page = fetchPage(id);
+    if (page == NULL)
+        return false;
+    *(page_id*) page = meta.free_head;
+    meta.free_head = id;
+    pool.unpin(id, true);
+    return true;
+}
+
+int PagedBigTree::keyCount(page_id id) {
+    char* page = fetchPage(id);
+    if (page == NULL)
+        return -1;
+    int n = header(page)->number_keys;
+    pool.unpin(id, false);
+    return n;
+}
+
+/* Indice de la primera llave >= k. Con nodos del tamanno de una pagina conviene la busqueda binaria */
+int PagedBigTree::findKey(char* node, int k) {
+    int* keys = keysOf(node);
+    int lo = 0, hi = header(node)->number_keys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (keys[mid] < k)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool PagedBigTree::search(int k) {
+    if (failed)
+        return false;
+    page_id id = meta.root;
+    while (id != INVALID_PAGE) {
+        char* node = fetchPage(id);
+        if (node == NULL)
+            return false;
+        int i = findKey(node, k);
+        bool found = i < header(node)->number_keys && keysOf(node)[i] == k;
+        page_id next = (found || header(node)->leaf) ? INVALID_PAGE : childrenOf(node)[i];
+        pool.unpin(id, false);
+        if (found)
+            return true;
+        id = next;
+    }
+    return false;
+}
+
+/*
+ * Igual que BigTree::insert: si la raiz esta llena el arbol crece en altura, y en el camino
+ * hacia la hoja se separa todo hijo lleno antes de bajar a el. Solo se mantienen fijas la
+ * pagina actual y la del hijo.
+ */
+bool PagedBigTree::insert(int k) {
+    if (failed)
+        return false;
+    if (meta.root == INVALID_PAGE) {
+        char* page;
+        page_id id = allocatePage(page, true);
+        if (id == INVALID_PAGE)
+            return false;
+        keysOf(page)[0] = k;
+        header(page)->number_keys = 1;
+        pool.unpin(id, true);
+        meta.root = id;
+        return true;
+    }
+
+    page_id id = meta.root;
+    char* node = fetchPage(id);
+    if (node == NULL)
+        return false;
+    bool dirty = false;
+
+    if (header(node)->number_keys == 2 * degree - 1) {
+        char* new_root;
+        page_id new_id = allocatePage(new_root, false);
+        if (new_id == INVALID_PAGE) {
+            pool.unpin(id, false);
+            return false;
+        }
+        childrenOf(new_root)[0] = id;
+        if (!splitChild(new_root, 0, node)) {
+            pool.unpin(new_id, false);
+            pool.unpin(id, false);
+            return false;
+        }
+        pool.unpin(id, true);
+        meta.root = new_id;
+        id = new_id;
+        node = new_root;
+        dirty = true;
+    }
+
+    while (true) {
+        int* keys = keysOf(node);
+        int n = header(node)->number_keys;
+        int i = findKey(node, k);
+
+        //no queremos que haya valores repetidos
+        if (i < n && keys[i] == k) {
+            pool.unpin(id, dirty);
+            return false;
+        }
+
+        if (header(node)->leaf) {
+            memmove(keys + i + 1, keys + i, (n - i) * sizeof (int));
+            keys[i] = k;
+            header(node)->number_keys = n + 1;
+            pool.unpin(id, true);
+            return true;
+        }
+
+        page_id child_id = childrenOf(node)[i];
+        char* child = fetchPage(child_id);
+        if (child == NULL) {
+            pool.unpin(id, dirty);
+            return false;
+        }
+        bool child_dirty = false;
+
+        //Si el hijo esta lleno lo separamos antes de bajar
+        if (header(child)->number_keys == 2 * degree - 1) {
+            if (!splitChild(node, i, child)) {
+                pool.unpin(child_id, false);
+                pool.unpin(id, dirty);
+                return false;
+            }
+            dirty = true;
+            child_dirty = true;
+            if (keys[i] == k) {
+                pool.unpin(child_id, true);
+                pool.unpin(id, true);
+                return false;
+            }
+            if (keys[i] < k) {
+                pool.unpin(child_id, true);
+                child_id = childrenOf(node)[i + 1];
+                child = fetchPage(child_id);
+                if (child == NULL) {
+                    pool.unpin(id, true);
+                    return false;
+                }
+                child_dirty = false;
+            }
+        }
+        pool.unpin(id, dirty);
+        id = child_id;
+        node = child;
+        dirty = child_dirty;
+    }
+}
+
+/* Separa el hijo 'y' (lleno) que esta en la posicion 'i' de 'node'. Ver BTreeNode::splitChild */
+bool PagedBigTree::splitChild(char* node, int i, char* y) {
+    char* z;
+    page_id z_id = allocatePage(z, header(y)->leaf);
+    if (z_id == INVALID_PAGE)
+        return false;
+
+    header(z)->number_keys = degree - 1;
+    memcpy(keysOf(z), keysOf(y) + degree, (degree - 1) * sizeof (int));
+    if (!header(y)->leaf)
+        memcpy(childrenOf(z), childrenOf(y) + degree, degree * sizeof (page_id));
+    header(y)->number_keys = degree - 1;
+
+    int n = header(node)->number_keys;
+    int* keys = keysOf(node);
+    page_id* children = childrenOf(node);
+    memmove(children + i + 2, children + i + 1, (n - i) * sizeof (page_id));
+    children[i + 1] = z_id;
+    memmove(keys + i + 1, keys + i, (n - i) * sizeof (int));
+    keys[i] = keysOf(y)[degree - 1];
+    header(node)->number_keys = n + 1;
+
+    pool.unpin(z_id, true);
+    return true;
+}
+
+/*
+ * Igual que BTreeNode::remove pero iterativo: antes de bajar a un hijo nos aseguramos que
+ * tenga por lo menos 'grado' llaves (fill), asi nunca hay que volver a subir.
+ */
+bool PagedBigTree::remove(int k) {
+    if (failed || meta.root == INVALID_PAGE)
+        return false;
+
+    bool removed = false;
+    page_id id = meta.root;
+    char* node = fetchPage(id);
+    if (node == NULL)
+        return false;
+    bool dirty = false;
+
+    while (true) {
+        int* keys = keysOf(node);
+        page_id* children = childrenOf(node);
+        int idx = findKey(node, k);
+        page_id next;
+
+        if (idx < header(node)->number_keys && keys[idx] == k) {
+            if (header(node)->leaf) {
+                //removeFromLeaf
+                memmove(keys + idx, keys + idx + 1, (header(node)->number_keys - idx - 1) * sizeof (int));
+                header(node)->number_keys--;
+                dirty = true;
+                removed = true;
+                break;
+            }
+
+            //removeFromNonLeaf: se reemplaza por el predecesor o el sucesor, o se unen los hijos
+            int left = keyCount(children[idx]);
+            int right = left >= degree ? 0 : keyCount(children[idx + 1]);
+            if (left < 0 || right < 0)
+                break;
+            if (left >= degree) {
+                if (!getPred(children[idx], k))
+                    break;
+                keys[idx] = k;
+                next = children[idx];
+            } else if (right >= degree) {
+                if (!getSucc(children[idx + 1], k))
+                    break;
+                keys[idx] = k;
+                next = children[idx + 1];
+            } else {
+                dirty = true;
+                if (!merge(node, idx))
+                    break;
+                next = children[idx];
+            }
+            dirty = true;
+        } else {
+            //Si es hoja, la llave no esta en este arbol
+            if (header(node)->leaf)
+                break;
+
+            bool flag = (idx == header(node)->number_keys);
+            int count = keyCount(children[idx]);
+            if (count < 0)
+                break;
+            if (count < degree) {
+                dirty = true;
+                if (!fill(node, idx))
+                    break;
+            }
+            if (flag && idx > header(node)->number_keys)
+                next = children[idx - 1];
+            else
+                next = children[idx];
+        }
+        pool.unpin(id, dirty);
+        id = next;
+        node = fetchPage(id);
+        if (node == NULL)
+            return false;
+        dirty = false;
+    }
+    pool.unpin(id, dirty);
+    if (failed)
+        return false;
+
+    //Si la raiz se quedo sin llaves su primer hijo pasa a ser la raiz
+    char* root = fetchPage(meta.root);
+    if (root == NULL)
+        return false;
+    if (header(root)->number_keys == 0) {
+        page_id old = meta.root;
+        meta.root = header(root)->leaf ? INVALID_PAGE : childrenOf(root)[0];
+        pool.unpin(old, false);
+        if (!freePage(old))
+            return false;
+    } else
+        pool.unpin(meta.root, false);
+
+    return removed;
+}
+
+/* Ultima llave de la hoja mas a la derecha del subarbol */
+bool PagedBigTree::getPred(page_id id, int& k) {
+    while (true) {
+        char* node = fetchPage(id);
+        if (node == NULL)
+            return false;
+        if (header(node)->leaf) {
+            k = keysOf(node)[header(node)->number_keys - 1];
+            pool.unpin(id, false);
+            return true;
+        }
+        page_id next = childrenOf(node)[header(node)->number_keys];
+        pool.unpin(id, false);
+        id = next;
+    }
+}
+
+/* Primera llave de la hoja mas a la izquierda del subarbol */
+bool PagedBigTree::getSucc(page_id id, int& k) {
+    while (true) {
+        char* node = fetchPage(id);
+        if (node == NULL)
+            return false;
+        if (header(node)->leaf) {
+            k = keysOf(node)[0];
+            pool.unpin(id, false);
+            return true;
+        }
+        page_id next = childrenOf(node)[0];
+        pool.unpin(id, false);
+        id = next;
+    }
+}
+
+bool PagedBigTree::fill(char* node, int idx) {
+    page_id* children = childrenOf(node);
+    int n = header(node)->number_keys;
+    int prev = idx != 0 ? keyCount(children[idx - 1]) : 0;
+    int next = idx != n && prev < degree ? keyCount(children[idx + 1]) : 0;
+    if (prev < 0 || next < 0)
+        return false;
+
+    if (idx != 0 && prev >= degree)
+        return borrowFromPrev(node, idx);
+    else if (idx != n && next >= degree)
+        return borrowFromNext(node, idx);
+    else if (idx != n)
+        return merge(node, idx);
+    else
+        return merge(node, idx - 1);
+}
+
+bool PagedBigTree::borrowFromPrev(char* node, int idx) {
+    page_id child_id = childrenOf(node)[idx];
+    page_id sibling_id = childrenOf(node)[idx - 1];
+    char* child = fetchPage(child_id);
+    if (child == NULL)
+        return false;
+    char* sibling = fetchPage(sibling_id);
+    if (sibling == NULL) {
+        pool.unpin(child_id, false);
+        return false;
+    }
+    int cn = header(child)->number_keys;
+    int sn = header(sibling)->number_keys;
+
+    memmove(keysOf(child) + 1, keysOf(child), cn * sizeof (int));
+    if (!header(child)->leaf)
+        memmove(childrenOf(child) + 1, childrenOf(child), (cn + 1) * sizeof (page_id));
+
+    keysOf(child)[0] = keysOf(node)[idx - 1];
+    if (!header(child)->leaf)
+        childrenOf(child)[0] = childrenOf(sibling)[sn];
+    keysOf(node)[idx - 1] = keysOf(sibling)[sn - 1];
+
+    header(child)->number_keys = cn + 1;
+    header(sibling)->number_keys = sn - 1;
+    pool.unpin(child_id, true);
+    pool.unpin(sibling_id, true);
+    return true;
+}
+
+bool PagedBigTree::borrowFromNext(char* node, int idx) {
+    page_id child_id = childrenOf(node)[idx];
+    page_id sibling_id = childrenOf(node)[idx + 1];
+    char* child = fetchPage(child_id);
+    if (child == NULL)
+        return false;
+    char* sibling = fetchPage(sibling_id);
+    if (sibling == NULL) {
+        pool.unpin(child_id, false);
+        return false;
+    }
+    int cn = header(child)->number_keys;
+    int sn = header(sibling)->number_keys;
+
+    keysOf(child)[cn] = keysOf(node)[idx];
+    if (!header(child)->leaf)
+        childrenOf(child)[cn + 1] = childrenOf(sibling)[0];
+    keysOf(node)[idx] = keysOf(sibling)[0];
+
+    memmove(keysOf(sibling), keysOf(sibling) + 1, (sn - 1) * sizeof (int));
+    if (!header(sibling)->leaf)
+        memmove(childrenOf(sibling), childrenOf(sibling) + 1, sn * sizeof (page_id));
+
+    header(child)->number_keys = cn + 1;
+    header(sibling)->number_keys = sn - 1;
+    pool.unpin(child_id, true);
+    pool.unpin(sibling_id, true);
+    return true;
+}
+
+/* Une el hijo idx con el idx+1 y libera la pagina del segundo */
+bool PagedBigTree::merge(char* node, int idx) {
+    page_id child_id = childrenOf(node)[idx];
+    page_id sibling_id = childrenOf(node)[idx + 1];
+    char* child = fetchPage(child_id);
+    if (child == NULL)
+        return false;
+    char* sibling = fetchPage(sibling_id);
+    if (sibling == NULL) {
+        pool.unpin(child_id, false);
+        return false;
+    }
+    int cn = header(child)->number_keys;
+    int sn = header(sibling)->number_keys;
+    int n = header(node)->number_keys;
+
+    keysOf(child)[cn] = keysOf(node)[idx];
+    memcpy(keysOf(child) + cn + 1, keysOf(sibling), sn * sizeof (int));
+    if (!header(child)->leaf)
+        memcpy(childrenOf(child) + cn + 1, childrenOf(sibling), (sn + 1) * sizeof (page_id));
+
+    memmove(keysOf(node) + idx, keysOf(node) + idx + 1, (n - idx - 1) * sizeof (int));
+    memmove(childrenOf(node) + idx + 1, childrenOf(node) + idx + 2, (n - idx - 1) * sizeof (page_id));
+
+    header(child)->number_keys = cn + sn + 1;
+    header(node)->number_keys = n - 1;
+    pool.unpin(child_id, true);
+    pool.unpin(sibling_id, false);
+    return freePage(sibling_id);
+}
+
+void PagedBigTree::traverse() {
+    if (!failed && meta.root != INVALID_PAGE)
+        traverse(meta.root);
+    std::cout << std::endl;
+}
+
+/* Recorrido en orden. Se copia el nodo antes de bajar para no mantener fijo todo el camino */
+void PagedBigTree::traverse(page_id id) {
+    char* node = fetchPage(id);
+    if (node == NULL)
+        return;
+    int n = header(node)->number_keys;
+    bool leaf = header(node)->leaf;
+    int* keys = new int[n];
+    page_id* children = new page_id[n + 1];
+    memcpy(keys, keysOf(node), n * sizeof (int));
+    if (!leaf)
+        memcpy(children, childrenOf(node), (n + 1) * sizeof (page_id));
+    pool.unpin(id, false);
+
+    for (int i = 0; i < n; i++) {
+        if (!leaf)
+            traverse(children[i]);
+        std::cout << " " << keys[i];
+    }
+    if (!leaf)
+        traverse(children[n]);
+
+    delete[] keys;
+    delete[] children;
+}
@@ -0,0 +1,117 @@
+#ifndef PAGEDBIGTREE_H
+#define	PAGEDBIGTREE_H
+
+/*
+ * Big-Tree almacenado en un archivo.
+ *
+ * Es el mismo algoritmo que BigTree (separacion preventiva al insertar y llenado preventivo
+ * al eliminar), pero cada nodo es una pagina de tamanno fijo del archivo y los hijos se
+ * referencian por numero de pagina en vez de por puntero. Las paginas pasan por un
+ * BufferPool, por lo que el arbol puede ser varias veces mas grande que la memoria
+ * disponible y el consumo de memoria queda acotado por el presupuesto de cache.
+ *
+ * Estructura del archivo:
+ *      pagina 0: metadatos (numero magico, tamanno de pagina, grado, raiz, lista de paginas libres)
+ *      resto   : nodos o paginas libres
+ * Una pagina de nodo tiene: { hoja, numero de llaves, llaves[2t-1], hijos[2t] }. El grado se
+ * calcula como el mayor 't' para el que un nodo cabe en una pagina.
+ */
+#include "BufferPool.h"
+#include <iostream>
+
+class PagedBigTree {
+private:
+
+    /* Pagina 0 del archivo */
+    struct Meta {
+        unsigned int magic;
+        unsigned int version;
+        int page_size;
+        int degree;
+        page_id root;
+        page_id free_head; // Primera pagina libre (cada pagina libre guarda la siguiente)
+        unsigned long long checkpoint_lsn; // Ultimo registro del log incluido en el archivo (ver DurableBigTree)
+    };
+
+    BufferPool pool;
+    Meta meta;
+    int degree;
+    bool failed; // Una operacion se quedo a medias por un error del buffer pool (ver ioFailed)
+
+    int* keysOf(char* page);
+    page_id* childrenOf(char* page);
+
+    // Como BufferPool::fetch y append, pero si fallan marcan el arbol como fallido
+    char* fetchPage(page_id id);
+    char* appendPage(page_id& id);
+
+    // Las funciones internas retornan false (o INVALID_PAGE, o -1) si fallo el buffer pool
+    page_id allocatePage(char*& page, bool leaf);
+    bool freePage(page_id id);
+    int keyCount(page_id id);
+    bool writeMeta();
+
+    int findKey(char* node, int k);
+    bool splitChild(char* node, int i, char* y);
+    bool getPred(page_id id, int& k);
+    bool getSucc(page_id id, int& k);
+    bool fill(char* node, int idx);
+    bool borrowFromPrev(char* node, int idx);
+    bool borrowFromNext(char* node, int idx);
+    bool merge(char* node, int idx);
+    void traverse(page_id id);
+
+public:
+    /* 'page_size' es el tamanno de cada nodo en bytes y 'cache_bytes' el presupuesto de memoria del buffer pool */
+    PagedBigTree(int page_size = 4096, size_t cache_bytes = 64 << 20);
+    ~PagedBigTree();
+
+    /* Abre el arbol guardado en 'path', o crea uno vacio si el archivo no existe.
+     * Con 'atomic_flush' cada flush() deja el archivo en un estado consistente (ver BufferPool) */
+    bool open(const char* path, bool atomic_flush = false);
+
+    // Escribe las paginas sucias y los metadatos al archivo. Retorna false si hubo un error o ioFailed()
+    bool flush();
+
+    /* Escribe y cierra el archivo. Con 'write_back' en false, o despues de un error (ioFailed), cierra
+     * sin escribir nada y el archivo queda como en el ultimo flush() */
+    void close(bool write_back = true);
+
+    // Retorna true si la llave esta en el arbol. False si no esta o si hubo un error (ver ioFailed)
+    bool search(int k);
+
+    // Inserta una llave. Retorna false si ya existia o si hubo un error
+    bool insert(int k);
+
+    // Elimina una llave. Retorna false si no existia o si hubo un error
+    bool remove(int k);
+
+    /* True si una operacion fallo porque el buffer pool no pudo traer o agregar una pagina (error de
+     * E/S o todos los marcos fijos). La operacion pudo quedar a medias, asi que desde ahi search,
+     * insert y remove retornan false y flush() no escribe nada: hay que cerrar y volver a abrir */
+    bool ioFailed() const {
+        return failed;
+    }
+
+    // Muestra las llaves de menor a mayor
+    void traverse();
+
+    int getDegree() const {
+        return degree;
+    }
+
+    unsigned long long checkpointLSN() const {
+        return meta.checkpoint_lsn;
+    }
+
+    // Se guarda en los metadatos en el siguiente flush()
+    void setCheckpointLSN(unsigned long long lsn) {
+        meta.checkpoint_lsn = lsn;
+    }
+
+    BufferPool& bufferPool() {
+        return pool;
+    }
+};
+
+#endif	/* PAGEDBIGTREE_H */
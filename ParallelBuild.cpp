@@ -0,0 +1,74 @@
+#include "ParallelBuild.h"
+#include <string.h>
+#include <algorithm>
+
+static const size_t MIN_PART = 1 << 16; // Con menos llaves por hilo no conviene repartir
+
+void parallelSortUnique(std::vector<int>& keys, int threads) {
+    size_t n = keys.size();
+    if (n < MIN_PART) {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        return;
+    }
+    int parts = parallelParts(n, threads, MIN_PART);
+    std::vector<int> other(n);
+    std::vector<size_t> counts((size_t) parts * 256);
+    int *from = keys.data(), *to = other.data();
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        // El bit de signo se invierte para que los negativos queden antes
+        unsigned int flip = shift == 24 ? 0x80U : 0;
+        std::fill(counts.begin(), counts.end(), 0);
+        parallelFor(parts, n, [&](int p, size_t begin, size_t end) {
+            size_t *count = &counts[(size_t) p * 256];
+            for (size_t i = begin; i < end; i++)
+                count[(((unsigned int) from[i] >> shift) & 0xff) ^ flip]++;
+        });
+
+        // Las llaves del digito d del pedazo p van despues de las de digitos menores y de las del
+        // digito d de los pedazos anteriores
+        size_t position = 0;
+        bool one_digit = false;
+        for (int d = 0; d < 256; d++) {
+            size_t digit_total = 0;
+            for (int p = 0; p < parts; p++) {
+                size_t count = counts[(size_t) p * 256 + d];
+                counts[(size_t) p * 256 + d] = position;
+                position += count;
+                digit_total += count;
+            }
+            one_digit |= digit_total == n;
+        }
+        if (one_digit)
+            continue; // Todas tienen el mismo digito: la pasada no cambiaria nada
+
+        parallelFor(parts, n, [&](int p, size_t begin, size_t end) {
+            size_t *next = &counts[(size_t) p * 256];
+            for (size_t i = begin; i < end; i++)
+                to[next[(((unsigned int) from[i] >> shift) & 0xff) ^ flip]++] = from[i];
+        });
+        std::swap(from, to);
+    }
+
+    // Una llave se queda si es distinta a la anterior (aunque la anterior sea del pedazo de otro hilo)
+    std::vector<size_t> kept(parts + 1, 0);
+    parallelFor(parts, n, [&](int p, size_t begin, size_t end) {
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++)
+            count += i == 0 || from[i] != from[i - 1];
+        kept[p + 1] = count;
+    });
+    for (int p = 0; p < parts; p++)
+        kept[p + 1] += kept[p];
+    parallelFor(parts, n, [&](int p, size_t begin, size_t end) {
+        size_t out = kept[p];
+        for (size_t i = begin; i < end; i++) {
+            if (i == 0 || from[i] != from[i - 1])
+                to[out++] = from[i];
+        }
+    });
+    if (to != keys.data())
+        keys.swap(other);
+    keys.resize(kept[parts]);
+}
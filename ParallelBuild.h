@@ -0,0 +1,69 @@
+#ifndef PARALLELBUILD_H
+#define	PARALLELBUILD_H
+
+/*
+ * Construccion de los arboles con varios hilos a partir de llaves desordenadas.
+ *
+ *      1) Ordenar: radix sort LSD de 4 pasadas de 8 bits. En cada pasada cada hilo cuenta los
+ *         digitos de su pedazo del arreglo y despues copia sus llaves a su lugar en el arreglo
+ *         destino (los lugares de cada hilo se calculan con las cuentas de todos). Las pasadas en
+ *         las que todas las llaves tienen el mismo digito se saltan.
+ *      2) Quitar repetidas: cada hilo cuenta las llaves distintas de su pedazo y las copia a partir
+ *         de donde terminan las de los pedazos anteriores.
+ *      3) Armar el arbol ya balanceado, sin rotaciones ni separaciones:
+ *         - AVLTree::BuildSorted: la llave del medio es la raiz y cada mitad se arma en otro hilo
+ *         - RedBlack::BuildSorted: igual, y el color sale de la profundidad (rojos solo los nodos
+ *           del ultimo nivel cuando el arbol no esta completo)
+ *         - BigTree::bulkLoad: nivel por nivel desde las hojas, los nodos de cada nivel en paralelo
+ *
+ * 'threads' 0 usa todos los cpus de la maquina.
+ */
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+// Cantidad de hilos a usar si se piden 'threads' (0: los cpus de la maquina)
+static inline int buildThreads(int threads) {
+    if (threads > 0)
+        return threads;
+    int cpus = (int) std::thread::hardware_concurrency();
+    return cpus > 0 ? cpus : 1;
+}
+
+/* Parte [0, count) en 'parts' pedazos seguidos y llama body(part, begin, end) para cada uno, cada
+ pedazo en su hilo (el ultimo en el hilo que llama) */
+template<class Body>
+void parallelFor(int parts, size_t count, Body body) {
+    std::vector<std::thread> workers;
+    for (int p = 0; p < parts; p++) {
+        size_t begin = count * p / parts, end = count * (p + 1) / parts;
+        if (p + 1 < parts)
+            workers.push_back(std::thread(body, p, begin, end));
+        else
+            body(p, begin, end);
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+/* Pedazos para repartir 'count' elementos entre 'threads' hilos sin dejar pedazos de menos de
+ 'min_part' elementos (crear un hilo cuesta unos microsegundos) */
+static inline int parallelParts(size_t count, int threads, size_t min_part) {
+    size_t parts = count / (min_part > 0 ? min_part : 1);
+    if (parts > (size_t) buildThreads(threads))
+        parts = buildThreads(threads);
+    return parts > 0 ? (int) parts : 1;
+}
+
+/* Ordena las llaves y quita las repetidas */
+void parallelSortUnique(std::vector<int>& keys, int threads = 0);
+
+/* Vacia 'set' y lo llena con 'keys' (en cualquier orden, con repetidas). Sirve con AVLSet,
+ RedBlackSet y BigTreeSet (ver OrderedSet.h) */
+template<class Set>
+void parallelBuild(Set& set, std::vector<int> keys, int threads = 0) {
+    parallelSortUnique(keys, threads);
+    set.bulkLoad(keys, threads);
+}
+
+#endif	/* PARALLELBUILD_H */
@@ -1,8 +1,11 @@
 #include "RedBlack.h"
+#include "TreeCounters.h"
+#include "ParallelBuild.h"
 #include <stdio.h>
 #include <iostream>
 #include <assert.h>
 #include <stdlib.h>
+#include <thread>
 
 /* Retorna un puntero al nodo que es abuelo de n */
 node* RedBlack::Grandparent(node* n){
@@ -72,6 +75,7 @@ void RedBlack::replace_node(node* oldno, node* newno){
  Cambia la estructura
  */
 void RedBlack::Right_Rotate(node* k2){
+    TREE_COUNT(RB_ROTATIONS, 1);
     node* k1 = k2->left;
     replace_node(k2, k1);
     k2->left = k1->right;
@@ -93,6 +97,7 @@ void RedBlack::Right_Rotate(node* k2){
  Cambia la estructura
  */
 void RedBlack::Left_Rotate(node* k2){
+    TREE_COUNT(RB_ROTATIONS, 1);
     node* k1 = k2->right;
     replace_node(k2, k1);
     k2->right = k1->left;
@@ -113,11 +118,14 @@ color RedBlack::node_color(node* n){
  * Verifica las propiedades[reglas], ver .h para ver todas
  */
 void RedBlack::verify_properties(){
+    //Recorre todo el arbol: solo se hace cuando los assert estan activos (sin NDEBUG)
+#ifndef NDEBUG
     verify_property_1(this->root);
     verify_property_2();
     //property 3 no se verifica ya que declara que todas las hojas son negras
     verify_property_4(this->root);
     verify_property_5(this->root);
+#endif
 }
 
 /*
@@ -211,7 +219,8 @@ void RedBlack::verify_property_5_rec(node* n, int black_count, int* path_black_c
  */
 void RedBlack::Insert(int _key){
     
-    rbtree_node* node_insert = new rbtree_node();
+    rbtree_node* node_insert = (rbtree_node*) NodeArena::allocateIn(arena, sizeof (rbtree_node));
+    node_insert->left = node_insert->right = node_insert->parent = NULL;
     //nuevos nodos siempre son insertados como rojos
     node_insert->color = RED;
     node_insert->key = _key;
@@ -229,6 +238,7 @@ void RedBlack::Insert(int _key){
             /* si el nodo ya existe entonces lo retornamos, ya que no pueden haber valores repetidos en el arbol*/
             if (n->key == node_insert->key)
             {
+                NodeArena::deallocateIn(arena, node_insert, sizeof (rbtree_node));
                 return;
             }
             else if (node_insert->key < n->key)
@@ -294,6 +304,7 @@ void RedBlack::insert_case2(node* n){
 void RedBlack::insert_case3(node* n){
     if (node_color(Uncle(n)) == RED)
     {
+        TREE_COUNT(RB_RECOLORS, 1);
         n->parent->color = BLACK;
         Uncle(n)->color = BLACK;
         Grandparent(n)->color = RED;
@@ -415,6 +426,92 @@ node* RedBlack::lookup_node(int _key){
     return n;
 }
 
+/* Igual que lookup_node, pero con los contadores de busqueda (ver TreeCounters) */
+bool RedBlack::Contains(int _key){
+    node* n = this->root;
+    TREE_LOOKUP_BEGIN();
+    while (n != NULL)
+    {
+        TREE_LOOKUP_VISIT(1);
+        if (_key == n->key)
+            break;
+        n = _key < n->key ? n->left : n->right;
+    }
+    TREE_LOOKUP_END();
+    return n != NULL;
+}
+
+/* Igual que lookup_node, pero recordando el ultimo nodo mayor que la llave por el que se paso */
+bool RedBlack::LowerBound(int _key, int& out){
+    node* n = this->root;
+    node* best = NULL;
+    while (n != NULL)
+    {
+        if (_key == n->key)
+        {
+            out = n->key;
+            return true;
+        }
+        else if (_key < n->key)
+        {
+            best = n;
+            n = n->left;
+        }
+        else
+        {
+            n = n->right;
+        }
+    }
+    if (best == NULL)
+        return false;
+    out = best->key;
+    return true;
+}
+
+void RedBlack::free_subtree(node* n){
+    if (n == NULL)
+        return;
+    free_subtree(n->left);
+    free_subtree(n->right);
+    NodeArena::deallocateIn(arena, n, sizeof (rbtree_node));
+}
+
+/*
+ * La llave del medio es la raiz y cada mitad es un subarbol, asi las hojas quedan a lo mas en dos
+ * niveles: todos los caminos a un NIL tienen los nodos de las profundidades 0..red_depth-1 (negros)
+ * y a lo mas uno de profundidad red_depth. Pintando rojos los de esa profundidad todos los caminos
+ * tienen los mismos negros y ningun rojo tiene un hijo rojo
+ */
+node* RedBlack::build_range(const int* keys, size_t count, node* parent, int depth, int red_depth, int threads){
+    if (count == 0)
+        return NULL;
+    size_t mid = count / 2;
+    node* n = (rbtree_node*) NodeArena::allocateIn(arena, sizeof (rbtree_node));
+    n->key = keys[mid];
+    n->parent = parent;
+    n->color = depth == red_depth && depth > 0 ? RED : BLACK;
+    if (threads > 1 && count >= PARALLEL_BUILD_MIN) {
+        std::thread worker([&] {
+            n->left = build_range(keys, mid, n, depth + 1, red_depth, threads / 2);
+        });
+        n->right = build_range(keys + mid + 1, count - mid - 1, n, depth + 1, red_depth, threads - threads / 2);
+        worker.join();
+    } else {
+        n->left = build_range(keys, mid, n, depth + 1, red_depth, 1);
+        n->right = build_range(keys + mid + 1, count - mid - 1, n, depth + 1, red_depth, 1);
+    }
+    return n;
+}
+
+void RedBlack::BuildSorted(const int* keys, size_t count, int threads){
+    free_subtree(root);
+    int red_depth = 0; //profundidad del ultimo nivel: floor(log2(count))
+    while (((size_t) 2 << red_depth) <= count)
+        red_depth++;
+    root = build_range(keys, count, NULL, 0, red_depth, buildThreads(threads));
+    verify_properties();
+}
+
 /* Metodo que se encarga de empezar el proceso de eliminacion */
 void RedBlack::Delete(int _key){
     node* n = lookup_node(_key); //puntero al nodo que se quiere eliminar
@@ -452,7 +549,9 @@ void RedBlack::Delete(int _key){
         delete_case1(n); //empezamos los pasos para eliminar el nodo
     }
     replace_node(n, child);
-    free(n); //liberamos el espacio de memoria
+    if (n->parent == NULL && child != NULL)
+        child->color = BLACK; //si el hijo quedo como raiz tiene que ser negro
+    NodeArena::deallocateIn(arena, n, sizeof (rbtree_node)); //liberamos el espacio de memoria
     verify_properties(); //verificamos que todo este en orden
 }
 
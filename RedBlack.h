@@ -1,6 +1,8 @@
 #ifndef REDBLACK_H
 #define	REDBLACK_H
 
+#include "NodeArena.h"
+
 /* 
  * Rules of a Red/Black tree 
  *      1. A node is either red or black.
@@ -24,6 +26,7 @@ typedef struct rbtree_node {
 class RedBlack {
 private:
     rbtree_node* root;
+    NodeArena* arena; // De donde salen los nodos (NULL: heap normal)
     node* Grandparent(node* n);
     node* Sibling(node* n);
     node* Uncle(node* n);
@@ -56,12 +59,58 @@ private:
     void delete_case6(node* n);
     
     node* lookup_node(int _key);
+    void free_subtree(node* n);
+
+    //arma el subarbol de las llaves [keys, keys+count) ya balanceado (ver BuildSorted)
+    static const size_t PARALLEL_BUILD_MIN = 1 << 15;
+    node* build_range(const int* keys, size_t count, node* parent, int depth, int red_depth, int threads);
+
+    template<class Visitor>
+    static void visit(node* n, Visitor& visitor) {
+        if (n == NULL)
+            return;
+        visit(n->left, visitor);
+        visitor(n->key);
+        visit(n->right, visitor);
+    }
     
 public:
+    // Con 'arena' los nodos salen de ese arena (ver NodeArena), que tiene que vivir mas que el arbol
+    RedBlack(NodeArena* _arena = NULL) {
+        root = NULL;
+        arena = _arena;
+    }
+
+    ~RedBlack() {
+        free_subtree(root);
+    }
+
+    // El destructor libera los nodos: una copia los liberaria dos veces
+    RedBlack(const RedBlack&) = delete;
+    RedBlack& operator=(const RedBlack&) = delete;
+
     static void RBMenu();
     void Insert(int _key);
     void Display(node* ptr, int level);
     void Delete(int _key);
+
+    /* Reemplaza el arbol por uno armado con las llaves ordenadas y sin repetir 'keys' en O(n), sin
+     rotaciones. Los colores se calculan: solo son rojos los nodos del ultimo nivel si no esta completo.
+     Con 'threads' > 1 los subarboles grandes se arman en hilos distintos, 0 usa todos los cpus (ver
+     ParallelBuild.h) */
+    void BuildSorted(const int* keys, size_t count, int threads = 1);
+
+    // Retorna true si la llave esta en el arbol
+    bool Contains(int _key);
+
+    // Busca la menor llave >= _key. Retorna false si no hay
+    bool LowerBound(int _key, int& out);
+
+    // Llama a visitor(llave) para cada llave, de menor a mayor
+    template<class Visitor>
+    void ForEach(Visitor visitor) {
+        visit(root, visitor);
+    }
     
 };
 
@@ -0,0 +1,186 @@
+#ifndef SHARDEDSET_H
+#define	SHARDEDSET_H
+
+/*
+ * Conjunto repartido en N arboles independientes para que varios hilos escriban a la vez.
+ *
+ * Cada arbol (shard) tiene su propio candado y su propio NodeArena, asi dos escrituras que caen en
+ * shards distintos no comparten ni el candado ni las listas de memoria. Las llaves se reparten:
+ *      - SHARD_HASH: por un hash de la llave. La carga queda pareja aunque las llaves esten
+ *        agrupadas, pero lowerBound tiene que preguntarle a todos los shards.
+ *      - SHARD_RANGE: el rango de los enteros se parte en N pedazos iguales. lowerBound y el
+ *        recorrido van shard por shard, pero si las llaves estan en un solo rango un shard se
+ *        lleva todo el trabajo.
+ *
+ * forEach mezcla los shards en orden (k-way merge con un heap): de cada shard se toman las llaves
+ * por grupos con lowerBound, soltando el candado entre un grupo y otro, asi recorrer no detiene a
+ * los escritores. Cada llave sale una vez y en orden, pero los cambios que pasan durante el
+ * recorrido pueden verse o no.
+ *
+ * Sirve cualquier conjunto de OrderedSet.h cuyo constructor reciba el arena como ultimo argumento
+ * (AVLSet, RedBlackSet, BigTreeSet). Todas las operaciones se pueden llamar desde varios hilos.
+ */
+#include <mutex>
+#include <vector>
+#include <queue>
+#include <functional>
+#include "OrderedSet.h"
+
+enum ShardMode {
+    SHARD_HASH, SHARD_RANGE
+};
+
+template<OrderedSet Set>
+class ShardedSet {
+private:
+    static const int SCAN_BATCH = 256; // Llaves que se toman de un shard por cada vez que se bloquea
+
+    struct alignas(64) Shard {
+        std::mutex lock;
+        NodeArena arena;
+        Set set;
+
+        template<class... Args>
+        Shard(Args... args) : set(args..., &arena) {
+        }
+    };
+
+    std::vector<Shard*> shards;
+    ShardMode mode;
+
+    /* Lo siguiente que falta recorrer de un shard: llaves ya leidas y desde donde seguir */
+    struct Cursor {
+        std::vector<int> keys;
+        size_t next;
+        long long from; // Menor llave que falta leer (puede pasar de INT_MAX al terminar)
+    };
+
+    // Lee el siguiente grupo de llaves del shard. Retorna false si no quedan
+    bool refill(int shard, Cursor& cursor) {
+        cursor.keys.clear();
+        cursor.next = 0;
+        std::lock_guard<std::mutex> guard(shards[shard]->lock);
+        int k;
+        while (cursor.keys.size() < (size_t) SCAN_BATCH && cursor.from <= 0x7fffffffLL
+                && shards[shard]->set.lowerBound((int) cursor.from, k)) {
+            cursor.keys.push_back(k);
+            cursor.from = (long long) k + 1;
+        }
+        if (cursor.keys.size() < (size_t) SCAN_BATCH)
+            cursor.from = 0x80000000LL; // Se llego al final del shard
+        return !cursor.keys.empty();
+    }
+
+public:
+    /* 'count' shards. Los demas argumentos son los del constructor de Set sin el arena, que se
+     agrega al final (por ejemplo ShardedSet<BigTreeSet>(8, SHARD_HASH, 16, false, 0)) */
+    template<class... Args>
+    ShardedSet(int count, ShardMode _mode, Args... args) {
+        mode = _mode;
+        for (int i = 0; i < (count > 0 ? count : 1); i++)
+            shards.push_back(new Shard(args...));
+    }
+
+    ~ShardedSet() {
+        for (size_t i = 0; i < shards.size(); i++)
+            delete shards[i];
+    }
+
+    ShardedSet(const ShardedSet&) = delete;
+    ShardedSet& operator=(const ShardedSet&) = delete;
+
+    int shardCount() const {
+        return (int) shards.size();
+    }
+
+    // Shard al que va la llave k
+    int shardOf(int k) const {
+        if (mode == SHARD_RANGE)
+            return (int) (((unsigned long long) ((unsigned int) k ^ 0x80000000U) * shards.size()) >> 32);
+        unsigned int h = (unsigned int) k; // Mezcla final de murmur3
+        h ^= h >> 16;
+        h *= 0x85ebca6bU;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35U;
+        h ^= h >> 16;
+        return (int) (h % shards.size());
+    }
+
+    void insert(int k) {
+        Shard *s = shards[shardOf(k)];
+        std::lock_guard<std::mutex> guard(s->lock);
+        s->set.insert(k);
+    }
+
+    void erase(int k) {
+        Shard *s = shards[shardOf(k)];
+        std::lock_guard<std::mutex> guard(s->lock);
+        s->set.erase(k);
+    }
+
+    bool contains(int k) {
+        Shard *s = shards[shardOf(k)];
+        std::lock_guard<std::mutex> guard(s->lock);
+        return s->set.contains(k);
+    }
+
+    bool lowerBound(int k, int& out) {
+        bool found = false;
+        int first = mode == SHARD_RANGE ? shardOf(k) : 0;
+        for (size_t i = first; i < shards.size(); i++) {
+            int candidate;
+            bool has;
+            {
+                std::lock_guard<std::mutex> guard(shards[i]->lock);
+                has = shards[i]->set.lowerBound(k, candidate);
+            }
+            if (has && (!found || candidate < out)) {
+                out = candidate;
+                found = true;
+                if (mode == SHARD_RANGE) // Los shards siguientes solo tienen llaves mayores
+                    break;
+            }
+        }
+        return found;
+    }
+
+    template<class Visitor>
+    void forEach(Visitor visitor) {
+        typedef std::pair<int, int> Head; // Llave y shard
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heap;
+        std::vector<Cursor> cursors(shards.size());
+        for (size_t i = 0; i < shards.size(); i++) {
+            cursors[i].from = -0x80000000LL;
+            if (refill((int) i, cursors[i]))
+                heap.push(Head(cursors[i].keys[0], (int) i));
+        }
+        while (!heap.empty()) {
+            Head head = heap.top();
+            heap.pop();
+            visitor(head.first);
+            Cursor& c = cursors[head.second];
+            if (++c.next < c.keys.size() || refill(head.second, c))
+                heap.push(Head(c.keys[c.next], head.second));
+        }
+    }
+
+    /* Llama a operation(set) con el shard 'shard' bloqueado, para usar las funciones propias del
+     arbol (por ejemplo engine().insertBatch) */
+    template<class Operation>
+    void withShard(int shard, Operation operation) {
+        std::lock_guard<std::mutex> guard(shards[shard]->lock);
+        operation(shards[shard]->set);
+    }
+
+    // Memoria entregada por los arenas de todos los shards
+    size_t memoryBytes() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < shards.size(); i++)
+            bytes += shards[i]->arena.usedBytes();
+        return bytes;
+    }
+};
+
+static_assert(OrderedSet<ShardedSet<BigTreeSet>>);
+
+#endif	/* SHARDEDSET_H */
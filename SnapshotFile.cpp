@@ -0,0 +1,203 @@
+#include "SnapshotFile.h"
+#include "Checksum.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+
+static const char SNAPSHOT_MAGIC[8] = {'T', 'R', 'E', 'E', 'S', 'N', 'A', 'P'};
+static const size_t HEADER_BYTES = 64; // Los nodos empiezan alineados a una linea de cache
+
+static_assert(sizeof (SnapshotFile::Header) <= HEADER_BYTES);
+static_assert(sizeof (SnapshotFile::Node) == 64);
+
+SnapshotFile::SnapshotFile() {
+    fd = -1;
+    mapped = NULL;
+    mapped_bytes = 0;
+    header = NULL;
+    nodes = NULL;
+    keys = NULL;
+}
+
+SnapshotFile::~SnapshotFile() {
+    close();
+}
+
+static bool writeAll(int fd, const void *data, size_t bytes) {
+    const char *p = (const char*) data;
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, p, bytes);
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+bool SnapshotFile::write(const char *path, const std::vector<int>& sorted) {
+    /* Niveles de abajo hacia arriba: cada nodo toma hasta NODE_KEYS+1 hijos consecutivos. 'lowest'
+     es la menor llave de cada hijo del nivel que se esta armando */
+    std::vector<std::vector<Node> > levels;
+    std::vector<int> lowest;
+    for (size_t i = 0; i < sorted.size(); i += BLOCK_KEYS)
+        lowest.push_back(sorted[i]);
+    while (lowest.size() > 1) {
+        std::vector<Node> level;
+        std::vector<int> next_lowest;
+        for (size_t first = 0; first < lowest.size(); first += NODE_KEYS + 1) {
+            Node node;
+            memset(&node, 0, sizeof (node));
+            size_t children = std::min(lowest.size() - first, (size_t) NODE_KEYS + 1);
+            node.count = (unsigned int) children - 1;
+            node.first = (unsigned int) first;
+            for (size_t j = 1; j < children; j++)
+                node.keys[j - 1] = lowest[first + j];
+            level.push_back(node);
+            next_lowest.push_back(lowest[first]);
+        }
+        levels.push_back(level);
+        lowest.swap(next_lowest);
+    }
+
+    // Se guardan de la raiz hacia abajo: 'first' pasa a ser la posicion en el arreglo de todos los nodos
+    std::vector<Node> all;
+    for (size_t l = levels.size(); l-- > 0;) {
+        size_t below = all.size() + levels[l].size(); // Donde empieza el nivel de abajo
+        for (size_t i = 0; i < levels[l].size(); i++) {
+            all.push_back(levels[l][i]);
+            if (l > 0)
+                all.back().first += (unsigned int) below;
+        }
+    }
+
+    Header h;
+    memset(&h, 0, sizeof (h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof (h.magic));
+    h.version = VERSION;
+    h.levels = (unsigned int) levels.size();
+    h.key_count = sorted.size();
+    h.node_count = all.size();
+    h.nodes_offset = HEADER_BYTES;
+    h.keys_offset = HEADER_BYTES + all.size() * sizeof (Node);
+    h.body_crc = crc32_update(crc32(all.data(), all.size() * sizeof (Node)), sorted.data(), sorted.size() * sizeof (int));
+    h.header_crc = crc32(&h, sizeof (h));
+    char padded[HEADER_BYTES];
+    memset(padded, 0, sizeof (padded));
+    memcpy(padded, &h, sizeof (h));
+
+    std::string tmp = std::string(path) + ".tmp";
+    int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror(tmp.c_str());
+        return false;
+    }
+    bool ok = writeAll(out, padded, sizeof (padded)) && writeAll(out, all.data(), all.size() * sizeof (Node))
+            && writeAll(out, sorted.data(), sorted.size() * sizeof (int)) && fsync(out) == 0;
+    ok = ::close(out) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        perror(path);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotFile::open(const char *path, bool verify) {
+    close();
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) HEADER_BYTES) {
+        printf("%s: no es un snapshot\n", path);
+        close();
+        return false;
+    }
+    void *memory = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        perror(path);
+        close();
+        return false;
+    }
+    mapped = (const char*) memory;
+    mapped_bytes = info.st_size;
+
+    Header h;
+    memcpy(&h, mapped, sizeof (h));
+    unsigned int stored_crc = h.header_crc;
+    h.header_crc = 0;
+    if (memcmp(h.magic, SNAPSHOT_MAGIC, sizeof (h.magic)) != 0 || crc32(&h, sizeof (h)) != stored_crc) {
+        printf("%s: no es un snapshot o el encabezado esta danado\n", path);
+        close();
+        return false;
+    }
+    if (h.version != VERSION) {
+        printf("%s: snapshot version %u (se lee la version %u)\n", path, h.version, VERSION);
+        close();
+        return false;
+    }
+    if (h.nodes_offset != HEADER_BYTES || h.keys_offset != HEADER_BYTES + h.node_count * sizeof (Node)
+            || h.keys_offset + h.key_count * sizeof (int) != mapped_bytes) {
+        printf("%s: el tamanno del snapshot no corresponde al encabezado\n", path);
+        close();
+        return false;
+    }
+    if (verify && crc32(mapped + HEADER_BYTES, mapped_bytes - HEADER_BYTES) != h.body_crc) {
+        printf("%s: el checksum del snapshot no coincide\n", path);
+        close();
+        return false;
+    }
+    madvise(memory, mapped_bytes, MADV_RANDOM); // Las busquedas solo tocan unas paginas
+    header = (const Header*) mapped;
+    nodes = (const Node*) (mapped + h.nodes_offset);
+    keys = (const int*) (mapped + h.keys_offset);
+    return true;
+}
+
+void SnapshotFile::close() {
+    if (mapped != NULL)
+        munmap((void*) mapped, mapped_bytes);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    mapped = NULL;
+    mapped_bytes = 0;
+    header = NULL;
+    nodes = NULL;
+    keys = NULL;
+}
+
+size_t SnapshotFile::findBlock(int k) const {
+    size_t blocks = (size() + BLOCK_KEYS - 1) / BLOCK_KEYS;
+    size_t index = 0;
+    for (unsigned int level = 0; level < header->levels; level++) {
+        if (index >= header->node_count)
+            return blocks; // Archivo danado (abierto sin revisar el checksum)
+        const Node& node = nodes[index];
+        unsigned int count = node.count < (unsigned int) NODE_KEYS ? node.count : NODE_KEYS;
+        index = node.first + (std::upper_bound(node.keys, node.keys + count, k) - node.keys);
+    }
+    return index;
+}
+
+bool SnapshotFile::lowerBound(int k, int& out) const {
+    if (size() == 0)
+        return false;
+    size_t first = findBlock(k) * BLOCK_KEYS;
+    if (first >= size())
+        return false;
+    const int *end = keys + std::min(first + BLOCK_KEYS, size());
+    const int *found = std::lower_bound(keys + first, end, k);
+    if (found == keys + size())
+        return false;
+    out = *found; // Si no esta en el bloque es la primera del siguiente
+    return true;
+}
@@ -0,0 +1,196 @@
+#ifndef SNAPSHOTFILE_H
+#define	SNAPSHOTFILE_H
+
+/*
+ * Archivo con las llaves de un arbol para no tener que reconstruirlo en cada arranque.
+ *
+ * Las llaves se guardan ordenadas en un arbol B+ estatico que se puede usar directamente desde el
+ * archivo mapeado en memoria (mmap), sin leerlo ni convertirlo: abrir es O(1) (mas revisar el
+ * checksum si se pide) y las paginas se cargan a medida que las busquedas las tocan. Nada del
+ * archivo es un puntero, los hijos se referencian por su posicion, asi que sirve en cualquier
+ * direccion donde quede mapeado.
+ *
+ * Estructura del archivo (enteros en el orden de bytes de la maquina, little-endian en x86):
+ *      encabezado: numero magico, version, llaves, nodos, niveles, donde empiezan las secciones,
+ *                  CRC-32 del cuerpo y CRC-32 del encabezado
+ *      nodos     : los nodos internos por nivel, de la raiz hacia abajo. Cada nodo tiene hasta
+ *                  NODE_KEYS separadores y NODE_KEYS+1 hijos consecutivos a partir de 'first'
+ *                  (nodos del nivel siguiente o, en el ultimo nivel, bloques de llaves). El
+ *                  separador j es la menor llave del hijo j+1
+ *      llaves    : todas las llaves ordenadas; el bloque b son las llaves [b*BLOCK_KEYS, (b+1)*BLOCK_KEYS)
+ *
+ * El archivo se escribe en <archivo>.tmp y se renombra al final, asi una caida a medio escribir
+ * deja el snapshot anterior. SnapshotSet (abajo) usa el archivo como conjunto de solo lectura y lo
+ * pasa a un arbol normal la primera vez que se modifica.
+ */
+#include <vector>
+#include "OrderedSet.h"
+
+class SnapshotFile {
+public:
+    static const unsigned int VERSION = 1;
+    static const int NODE_KEYS = 14; // Un nodo ocupa 64 bytes (una linea de cache)
+    static const int BLOCK_KEYS = 16; // Llaves por bloque (tambien 64 bytes)
+
+    struct Header {
+        char magic[8]; // "TREESNAP"
+        unsigned int version;
+        unsigned int levels; // Niveles de nodos internos (0: las llaves caben en un bloque)
+        unsigned long long key_count;
+        unsigned long long node_count;
+        unsigned long long nodes_offset; // Bytes desde el inicio del archivo
+        unsigned long long keys_offset;
+        unsigned int body_crc; // De los bytes despues del encabezado
+        unsigned int header_crc; // Del encabezado con este campo en 0
+    };
+
+    struct Node {
+        unsigned int count; // Separadores (el nodo tiene count+1 hijos)
+        unsigned int first; // Primer hijo
+        int keys[NODE_KEYS];
+    };
+
+private:
+    int fd;
+    const char *mapped;
+    size_t mapped_bytes;
+    const Header *header;
+    const Node *nodes;
+    const int *keys;
+
+    // Bloque donde esta la menor llave >= k (si existe)
+    size_t findBlock(int k) const;
+
+public:
+    SnapshotFile();
+    ~SnapshotFile();
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    /* Escribe las llaves 'sorted' (ordenadas y sin repetir) en 'path' */
+    static bool write(const char *path, const std::vector<int>& sorted);
+
+    /* Mapea el archivo en memoria y revisa el encabezado. Con 'verify' tambien calcula el CRC de
+     todo el archivo, lo que obliga a leerlo completo */
+    bool open(const char *path, bool verify = true);
+
+    void close();
+
+    bool isOpen() const {
+        return header != NULL;
+    }
+
+    size_t size() const {
+        return header == NULL ? 0 : (size_t) header->key_count;
+    }
+
+    bool contains(int k) const {
+        int found;
+        return lowerBound(k, found) && found == k;
+    }
+
+    // Busca la menor llave >= k. Retorna false si no hay
+    bool lowerBound(int k, int& out) const;
+
+    // Llama a visitor(llave) para cada llave, de menor a mayor
+    template<class Visitor>
+    void forEach(Visitor visitor) const {
+        for (size_t i = 0; i < size(); i++)
+            visitor(keys[i]);
+    }
+
+    // Las llaves ordenadas, directamente del archivo
+    const int *data() const {
+        return keys;
+    }
+};
+
+/* Escribe las llaves de cualquier conjunto (ver OrderedSet.h) */
+template<OrderedSet Set>
+bool writeSnapshot(const char *path, Set& set) {
+    std::vector<int> sorted;
+    set.forEach([&sorted](int k) {
+        sorted.push_back(k);
+    });
+    return SnapshotFile::write(path, sorted);
+}
+
+/*
+ * Conjunto que empieza con las llaves de un snapshot. Mientras no se modifica las lecturas van al
+ * archivo mapeado; el primer insert o erase le pasa todas las llaves del archivo al Set (con
+ * bulkLoad si lo tiene, usando todos los cpus) y desde ahi todo va al Set.
+ */
+template<OrderedSet Set>
+class SnapshotSet {
+private:
+    SnapshotFile file;
+    Set set;
+    bool mutable_set; // Las llaves ya estan en 'set'
+
+    void makeMutable() {
+        if (mutable_set)
+            return;
+        mutable_set = true;
+        if constexpr (requires(Set & s, std::vector<int>& sorted) { s.bulkLoad(sorted, 0); }) {
+            std::vector<int> all(file.data(), file.data() + file.size());
+            set.bulkLoad(all, 0);
+        } else
+            file.forEach([this](int k) {
+                set.insert(k);
+            });
+        file.close();
+    }
+
+public:
+    template<class... Args>
+    SnapshotSet(Args... args) : set(args...) {
+        mutable_set = false;
+    }
+
+    // Abre el snapshot (ver SnapshotFile::open). Solo antes de modificar el conjunto
+    bool open(const char *path, bool verify = true) {
+        return !mutable_set && file.open(path, verify);
+    }
+
+    void insert(int k) {
+        makeMutable();
+        set.insert(k);
+    }
+
+    void erase(int k) {
+        makeMutable();
+        set.erase(k);
+    }
+
+    bool contains(int k) {
+        return mutable_set ? set.contains(k) : file.contains(k);
+    }
+
+    bool lowerBound(int k, int& out) {
+        return mutable_set ? set.lowerBound(k, out) : file.lowerBound(k, out);
+    }
+
+    template<class Visitor>
+    void forEach(Visitor visitor) {
+        if (mutable_set)
+            set.forEach(visitor);
+        else
+            file.forEach(visitor);
+    }
+
+    // True cuando el conjunto ya no esta en el archivo sino en el Set
+    bool isMutable() const {
+        return mutable_set;
+    }
+
+    // El Set, con las llaves del snapshot
+    Set& inner() {
+        makeMutable();
+        return set;
+    }
+};
+
+static_assert(OrderedSet<SnapshotSet<BigTreeSet>>);
+
+#endif	/* SNAPSHOTFILE_H */
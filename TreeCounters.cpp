@@ -0,0 +1,107 @@
+#include "TreeCounters.h"
+#include <mutex>
+#include <vector>
+
+thread_local TreeCounters::PerThread TreeCounters::local;
+
+/* Contadores de los hilos vivos y la suma de los que ya terminaron */
+struct CounterRegistry {
+    std::mutex lock;
+    std::vector<TreeCounters::PerThread*> threads;
+    TreeCounters::Snapshot retired{};
+};
+
+static CounterRegistry& registry() {
+    static CounterRegistry instance;
+    return instance;
+}
+
+TreeCounters::PerThread::PerThread() {
+    for (int i = 0; i < TREE_COUNTER_KINDS; i++)
+        counts[i].store(0, std::memory_order_relaxed);
+    for (int d = 0; d < DEPTH_BUCKETS; d++)
+        depth[d].store(0, std::memory_order_relaxed);
+    lookup_depth = 0;
+    CounterRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.threads.push_back(this);
+}
+
+TreeCounters::PerThread::~PerThread() {
+    CounterRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (int i = 0; i < TREE_COUNTER_KINDS; i++)
+        r.retired.counts[i] += counts[i].load(std::memory_order_relaxed);
+    for (int d = 0; d < DEPTH_BUCKETS; d++)
+        r.retired.depth[d] += depth[d].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < r.threads.size(); i++)
+        if (r.threads[i] == this) {
+            r.threads[i] = r.threads.back();
+            r.threads.pop_back();
+            break;
+        }
+}
+
+const char *TreeCounters::name(TreeCounter counter) {
+    static const char *names[TREE_COUNTER_KINDS] = {
+        "avl_rotations", "rb_rotations", "rb_recolors", "bt_splits", "bt_merges", "bt_borrows",
+        "lookups", "lookup_comparisons"
+    };
+    return names[counter];
+}
+
+TreeCounters::Snapshot TreeCounters::snapshot() {
+    CounterRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    Snapshot total = r.retired;
+    for (size_t t = 0; t < r.threads.size(); t++) {
+        PerThread *thread = r.threads[t];
+        for (int i = 0; i < TREE_COUNTER_KINDS; i++)
+            total.counts[i] += thread->counts[i].load(std::memory_order_relaxed);
+        for (int d = 0; d < DEPTH_BUCKETS; d++)
+            total.depth[d] += thread->depth[d].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void TreeCounters::reset() {
+    CounterRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.retired = Snapshot();
+    for (size_t t = 0; t < r.threads.size(); t++) {
+        PerThread *thread = r.threads[t];
+        for (int i = 0; i < TREE_COUNTER_KINDS; i++)
+            thread->counts[i].store(0, std::memory_order_relaxed);
+        for (int d = 0; d < DEPTH_BUCKETS; d++)
+            thread->depth[d].store(0, std::memory_order_relaxed);
+    }
+}
+
+double TreeCounters::Snapshot::comparisonsPerLookup() const {
+    return counts[LOOKUPS] == 0 ? 0 : (double) counts[LOOKUP_COMPARISONS] / counts[LOOKUPS];
+}
+
+double TreeCounters::Snapshot::meanDepth() const {
+    unsigned long long lookups = 0, nodes = 0;
+    for (int d = 0; d < DEPTH_BUCKETS; d++) {
+        lookups += depth[d];
+        nodes += depth[d] * d;
+    }
+    return lookups == 0 ? 0 : (double) nodes / lookups;
+}
+
+void TreeCounters::Snapshot::print(FILE *out, const char *indent) const {
+    for (int i = 0; i < TREE_COUNTER_KINDS; i++)
+        if (counts[i] != 0)
+            fprintf(out, "%s%s %llu\n", indent, name((TreeCounter) i), counts[i]);
+    if (counts[LOOKUPS] == 0)
+        return;
+    fprintf(out, "%scomparisons_per_lookup %.2f\n", indent, comparisonsPerLookup());
+    fprintf(out, "%smean_depth %.2f\n", indent, meanDepth());
+    // Histograma en una linea: "depth profundidad:busquedas ..."
+    fprintf(out, "%sdepth", indent);
+    for (int d = 0; d < DEPTH_BUCKETS; d++)
+        if (depth[d] != 0)
+            fprintf(out, " %d:%llu", d, depth[d]);
+    fprintf(out, "\n");
+}
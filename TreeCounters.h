@@ -0,0 +1,113 @@
+#ifndef TREECOUNTERS_H
+#define	TREECOUNTERS_H
+
+/*
+ * Contadores de lo que hacen los arboles por dentro: rotaciones del AVL y del Rojo-Negro, cambios de
+ * color, divisiones/uniones/prestamos de nodos del Big-Tree, comparaciones por busqueda y un
+ * histograma de la profundidad de las busquedas (cuantos nodos se visitaron).
+ *
+ * Se activan compilando con -DTREE_COUNTERS. Sin esa bandera las macros TREE_COUNT y TREE_LOOKUP_*
+ * no generan codigo y los arboles quedan igual que sin contadores; snapshot() devuelve todo en 0.
+ *
+ * Cada hilo suma en sus propios contadores (sin candados ni operaciones atomicas caras). snapshot()
+ * suma los de todos los hilos, incluyendo los que ya terminaron. reset() los pone en 0; una operacion
+ * que corre al mismo tiempo que reset() puede quedar contada o no.
+ */
+#include <stdio.h>
+#include <atomic>
+
+enum TreeCounter {
+    AVL_ROTATIONS, // Rotaciones simples (RR_Rotate, LL_Rotate). Una doble cuenta como dos
+    RB_ROTATIONS, // Right_Rotate, Left_Rotate
+    RB_RECOLORS, // insert_case3: el padre y el tio pasan a negro y el abuelo a rojo
+    BT_SPLITS, // splitChild
+    BT_MERGES, // merge
+    BT_BORROWS, // borrowFromPrev, borrowFromNext
+    LOOKUPS, // Busquedas (AVLTree::Search, RedBlack::Contains, BigTree::search)
+    LOOKUP_COMPARISONS, // Comparaciones de llaves hechas por esas busquedas
+    TREE_COUNTER_KINDS
+};
+
+class TreeCounters {
+public:
+    static const int DEPTH_BUCKETS = 64; // La ultima cubeta junta todas las profundidades mayores
+
+    struct Snapshot {
+        unsigned long long counts[TREE_COUNTER_KINDS];
+        unsigned long long depth[DEPTH_BUCKETS]; // depth[d]: busquedas que visitaron d nodos
+
+        double comparisonsPerLookup() const;
+        double meanDepth() const;
+
+        // Escribe los contadores distintos de 0, uno por linea ("nombre valor") despues de 'indent'
+        void print(FILE *out, const char *indent = "") const;
+    };
+
+    // Contadores de un hilo
+    struct PerThread {
+        std::atomic<unsigned long long> counts[TREE_COUNTER_KINDS];
+        std::atomic<unsigned long long> depth[DEPTH_BUCKETS];
+        int lookup_depth; // Nodos visitados por la busqueda en curso
+
+        PerThread();
+        ~PerThread();
+
+        // Solo el hilo duenno escribe: no hace falta una suma atomica, basta que la lectura sea entera
+        static void bump(std::atomic<unsigned long long>& counter, unsigned long long n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    static thread_local PerThread local;
+
+    static const char *name(TreeCounter counter);
+
+    static constexpr bool enabled() {
+#ifdef TREE_COUNTERS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static void add(TreeCounter counter, unsigned long long n) {
+        PerThread::bump(local.counts[counter], n);
+    }
+
+    static void lookupBegin() {
+        local.lookup_depth = 0;
+    }
+
+    // La busqueda visito un nodo e hizo 'comparisons' comparaciones de llaves en el
+    static void lookupVisit(unsigned long long comparisons) {
+        PerThread& counters = local;
+        counters.lookup_depth++;
+        PerThread::bump(counters.counts[LOOKUP_COMPARISONS], comparisons);
+    }
+
+    static void lookupEnd() {
+        PerThread& counters = local;
+        int d = counters.lookup_depth < DEPTH_BUCKETS ? counters.lookup_depth : DEPTH_BUCKETS - 1;
+        PerThread::bump(counters.depth[d], 1);
+        PerThread::bump(counters.counts[LOOKUPS], 1);
+    }
+
+    // Suma de los contadores de todos los hilos
+    static Snapshot snapshot();
+
+    static void reset();
+};
+
+#ifdef TREE_COUNTERS
+#define TREE_COUNT(counter, n) TreeCounters::add(counter, n)
+#define TREE_LOOKUP_BEGIN() TreeCounters::lookupBegin()
+#define TREE_LOOKUP_VISIT(comparisons) TreeCounters::lookupVisit(comparisons)
+#define TREE_LOOKUP_END() TreeCounters::lookupEnd()
+#else
+#define TREE_COUNT(counter, n) ((void) 0)
+#define TREE_LOOKUP_BEGIN() ((void) 0)
+#define TREE_LOOKUP_VISIT(comparisons) ((void) 0)
+#define TREE_LOOKUP_END() ((void) 0)
+#endif
+
+#endif	/* TREECOUNTERS_H */
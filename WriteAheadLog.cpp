@@ -0,0 +1,188 @@
+#include "WriteAheadLog.h"
+#include "Checksum.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+
+/* CRC de un registro, sin contar los campos 'crc' y 'pad' */
+static unsigned int recordCrc(const LogRecord& r) {
+    unsigned int crc = crc32(&r.lsn, sizeof (r.lsn));
+    crc = crc32_update(crc, &r.key, sizeof (r.key));
+    return crc32_update(crc, &r.op, sizeof (r.op));
+}
+
+WriteAheadLog::WriteAheadLog(int _commit_delay_us) {
+    fd = -1;
+    next_lsn = 1;
+    durable_lsn = 0;
+    syncs = 0;
+    commit_delay_us = _commit_delay_us;
+    stopping = false;
+    failed = false;
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open(const char* path, std::vector<LogRecord>& records) {
+    fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    //Leemos los registros validos. El primero que este incompleto, corrupto o fuera de orden marca el final
+    records.clear();
+    unsigned long long last = 0;
+    LogRecord buffer[1024];
+    ssize_t got;
+    bool done = false;
+    while (!done && (got = pread(fd, buffer, sizeof (buffer), (off_t) (records.size() * sizeof (LogRecord)))) > 0) {
+        size_t n = got / sizeof (LogRecord);
+        if (n * sizeof (LogRecord) != (size_t) got)
+            done = true;
+        for (size_t i = 0; i < n; i++) {
+            if (buffer[i].crc != recordCrc(buffer[i]) || buffer[i].lsn <= last) {
+                done = true;
+                break;
+            }
+            last = buffer[i].lsn;
+            records.push_back(buffer[i]);
+        }
+    }
+    if (ftruncate(fd, (off_t) (records.size() * sizeof (LogRecord))) != 0) {
+        perror(path);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    next_lsn = last + 1;
+    durable_lsn = last;
+    stopping = false;
+    failed = false;
+    flusher = std::thread(&WriteAheadLog::flusherLoop, this);
+    return true;
+}
+
+void WriteAheadLog::close() {
+    if (fd < 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_one();
+    flusher.join();
+    ::close(fd);
+    fd = -1;
+}
+
+void WriteAheadLog::startAfter(unsigned long long lsn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (lsn >= next_lsn) {
+        next_lsn = lsn + 1;
+        if (pending.empty())
+            durable_lsn = lsn;
+    }
+}
+
+unsigned long long WriteAheadLog::append(LogOp op, int key) {
+    LogRecord r;
+    r.key = key;
+    r.op = op;
+    r.pad = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    r.lsn = next_lsn++;
+    r.crc = recordCrc(r);
+    if (failed)
+        return r.lsn; //El log ya no se escribe, waitDurable() avisa el error
+    pending.push_back(r);
+    if (pending.size() == 1)
+        work_cv.notify_one();
+    return r.lsn;
+}
+
+/*
+ * Hilo de escritura: cada vuelta se lleva todos los registros pendientes, los escribe con un
+ * solo write() y un solo fdatasync() y despierta a todos los que estaban esperando.
+ *
+ * Despues de un error no se escribe nada mas: el grupo que fallo pudo quedar a medias en el archivo
+ * y un grupo posterior que si se escribiera dejaria un hueco en el log. durable_lsn ya no avanza.
+ */
+void WriteAheadLog::flusherLoop() {
+    std::vector<LogRecord> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (pending.empty() && !stopping)
+            work_cv.wait(lock);
+        if (pending.empty() && stopping)
+            break;
+
+        if (commit_delay_us > 0 && !stopping) {
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(commit_delay_us));
+            lock.lock();
+        }
+        batch.swap(pending);
+        lock.unlock();
+
+        size_t bytes = batch.size() * sizeof (LogRecord);
+        bool ok = write(fd, &batch[0], bytes) == (ssize_t) bytes && fdatasync(fd) == 0;
+        if (!ok)
+            perror("write-ahead log");
+
+        lock.lock();
+        if (ok && !failed)
+            durable_lsn = batch.back().lsn;
+        else {
+            failed = true;
+            pending.clear();
+        }
+        syncs++;
+        batch.clear();
+        durable_cv.notify_all();
+    }
+}
+
+bool WriteAheadLog::waitDurable(unsigned long long lsn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (durable_lsn < lsn && !failed)
+        durable_cv.wait(lock);
+    return !failed;
+}
+
+unsigned long long WriteAheadLog::sync() {
+    unsigned long long lsn;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lsn = next_lsn - 1;
+    }
+    waitDurable(lsn);
+    return lsn;
+}
+
+bool WriteAheadLog::reset() {
+    sync();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (failed)
+        return false;
+    if (ftruncate(fd, 0) != 0 || fdatasync(fd) != 0) {
+        perror("write-ahead log");
+        return false;
+    }
+    return true;
+}
+
+bool WriteAheadLog::hasFailed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+unsigned long long WriteAheadLog::syncCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return syncs;
+}
@@ -0,0 +1,86 @@
+#ifndef WRITEAHEADLOG_H
+#define	WRITEAHEADLOG_H
+
+/*
+ * Log de escritura anticipada (write-ahead log) para DurableBigTree.
+ *
+ * Cada insercion o eliminacion agrega un registro al final del log. Cada registro tiene un
+ * numero de secuencia creciente (LSN) y un CRC, asi al recuperar se descarta un registro
+ * escrito a medias.
+ *
+ * Confirmacion en grupo (group commit): append() solo deja el registro en un buffer en memoria.
+ * Un hilo aparte toma todos los registros acumulados, los escribe con un solo write() y hace un
+ * solo fdatasync() por grupo. Mientras ese fdatasync() esta en curso se van juntando los registros
+ * del siguiente grupo, por lo que con muchos escritores el costo de cada fsync se reparte entre
+ * todas las operaciones que llegaron mientras tanto en vez de pagar un fsync por operacion.
+ */
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+enum LogOp {
+    LOG_INSERT = 1, LOG_REMOVE = 2
+};
+
+struct LogRecord {
+    unsigned long long lsn;
+    int key;
+    unsigned int op;
+    unsigned int crc; // CRC de los campos anteriores
+    unsigned int pad;
+};
+
+class WriteAheadLog {
+private:
+    int fd;
+    std::mutex mutex;
+    std::condition_variable work_cv; // El hilo de escritura espera registros
+    std::condition_variable durable_cv; // Los escritores esperan que su registro sea durable
+    std::vector<LogRecord> pending; // Registros que todavia no se escribieron
+    unsigned long long next_lsn;
+    unsigned long long durable_lsn; // Todo registro con LSN <= durable_lsn ya esta en disco
+    unsigned long long syncs; // Cantidad de fdatasync hechos
+    int commit_delay_us;
+    bool stopping;
+    bool failed;
+    std::thread flusher;
+
+    void flusherLoop();
+
+public:
+    /* 'commit_delay_us' es cuanto espera el hilo de escritura antes de cada grupo para juntar
+     * mas registros (0 = escribir apenas haya algo) */
+    WriteAheadLog(int _commit_delay_us = 0);
+    ~WriteAheadLog();
+
+    /* Abre (o crea) el log y devuelve en 'records' los registros validos que tenia, en orden.
+     * Si el final del archivo tiene un registro incompleto o corrupto, se corta ahi */
+    bool open(const char* path, std::vector<LogRecord>& records);
+
+    void close();
+
+    // Los siguientes registros tendran un LSN mayor que 'lsn'
+    void startAfter(unsigned long long lsn);
+
+    // Agrega un registro y retorna su LSN. No espera a que sea durable
+    unsigned long long append(LogOp op, int key);
+
+    /* Espera hasta que el registro 'lsn' este en disco. Retorna false si hubo un error de E/S (en
+     * este registro o en cualquier otro: despues de un error el log ya no escribe nada, ver hasFailed) */
+    bool waitDurable(unsigned long long lsn);
+
+    // Espera a que todos los registros agregados sean durables (o a un error) y retorna el ultimo LSN
+    unsigned long long sync();
+
+    // Vacia el log (despues de un checkpoint). No debe haber append() concurrentes. False si hasFailed()
+    bool reset();
+
+    /* Hubo un error al escribir el log. Los registros desde ese grupo no son durables y no se
+     * escriben mas; al volver a abrir el log se corta donde termina lo que si llego a disco */
+    bool hasFailed();
+
+    unsigned long long syncCount();
+};
+
+#endif	/* WRITEAHEADLOG_H */
@@ -4,9 +4,14 @@
 #include "AVL.h"
 #include "RedBlack.h"
 #include "BigTree.h"
+#include "OpLogReplay.h"
 using namespace std;
 
 int main(int argc, char* argv[]) {
+    // Con argumentos no hay menu: se reproduce un log de operaciones (ver OpLogReplay.h)
+    if (argc > 1)
+        return replayCommand(argc, argv);
+
     int opcion = 0;
     do {
         system("cls");
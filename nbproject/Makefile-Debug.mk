@@ -37,7 +37,19 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 OBJECTFILES= \
 	${OBJECTDIR}/AVL.o \
 	${OBJECTDIR}/BigTree.o \
+	${OBJECTDIR}/BufferPool.o \
+	${OBJECTDIR}/ConcurrentBigTree.o \
+	${OBJECTDIR}/CountingBloomFilter.o \
+	${OBJECTDIR}/DurableBigTree.o \
+	${OBJECTDIR}/LatencyRecorder.o \
+	${OBJECTDIR}/NodeArena.o \
+	${OBJECTDIR}/OpLogReplay.o \
+	${OBJECTDIR}/PagedBigTree.o \
+	${OBJECTDIR}/ParallelBuild.o \
 	${OBJECTDIR}/RedBlack.o \
+	${OBJECTDIR}/SnapshotFile.o \
+	${OBJECTDIR}/TreeCounters.o \
+	${OBJECTDIR}/WriteAheadLog.o \
 	${OBJECTDIR}/main.o
 
 
@@ -45,8 +57,8 @@ OBJECTFILES= \
 CFLAGS=
 
 # CC Compiler Flags
-CCFLAGS=
-CXXFLAGS=
+CCFLAGS=-std=c++20
+CXXFLAGS=-std=c++20
 
 # Fortran Compiler Flags
 FFLAGS=
@@ -55,7 +67,7 @@ FFLAGS=
 ASFLAGS=
 
 # Link Libraries and Options
-LDLIBSOPTIONS=
+LDLIBSOPTIONS=-lpthread
 
 # Build Targets
 .build-conf: ${BUILD_SUBPROJECTS}
@@ -75,11 +87,71 @@ ${OBJECTDIR}/BigTree.o: BigTree.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/BigTree.o BigTree.cpp
 
+${OBJECTDIR}/BufferPool.o: BufferPool.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/BufferPool.o BufferPool.cpp
+
+${OBJECTDIR}/ConcurrentBigTree.o: ConcurrentBigTree.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ConcurrentBigTree.o ConcurrentBigTree.cpp
+
+${OBJECTDIR}/CountingBloomFilter.o: CountingBloomFilter.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/CountingBloomFilter.o CountingBloomFilter.cpp
+
+${OBJECTDIR}/DurableBigTree.o: DurableBigTree.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/DurableBigTree.o DurableBigTree.cpp
+
+${OBJECTDIR}/LatencyRecorder.o: LatencyRecorder.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/LatencyRecorder.o LatencyRecorder.cpp
+
+${OBJECTDIR}/NodeArena.o: NodeArena.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/NodeArena.o NodeArena.cpp
+
+${OBJECTDIR}/OpLogReplay.o: OpLogReplay.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/OpLogReplay.o OpLogReplay.cpp
+
+${OBJECTDIR}/PagedBigTree.o: PagedBigTree.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/PagedBigTree.o PagedBigTree.cpp
+
+${OBJECTDIR}/ParallelBuild.o: ParallelBuild.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ParallelBuild.o ParallelBuild.cpp
+
 ${OBJECTDIR}/RedBlack.o: RedBlack.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/RedBlack.o RedBlack.cpp
 
+${OBJECTDIR}/SnapshotFile.o: SnapshotFile.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/SnapshotFile.o SnapshotFile.cpp
+
+${OBJECTDIR}/TreeCounters.o: TreeCounters.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/TreeCounters.o TreeCounters.cpp
+
+${OBJECTDIR}/WriteAheadLog.o: WriteAheadLog.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/WriteAheadLog.o WriteAheadLog.cpp
+
 ${OBJECTDIR}/main.o: main.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"